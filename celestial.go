@@ -27,6 +27,7 @@ import (
 	"os/signal"
 	"strconv"
 	"syscall"
+	"time"
 
 	log "github.com/sirupsen/logrus"
 	"google.golang.org/grpc"
@@ -62,6 +63,13 @@ func main() {
 	networkInterface := flag.String("network-interface", DEFAULT_IF, "Name of your main network interface")
 	initDelay := flag.Uint64("init-delay", DEFAULT_INIT_DELAY, "Maximum delay when initially booting a machine -- can help reduce load at beginning of emulation")
 	emBackend := flag.String("em-backend", "ebpf", "Backend to use for emulation (ebpf or netem)")
+	ebpfShared := flag.Bool("ebpf-shared", false, "Use one eBPF program and map set for all machines on this host (ebpf backend only)")
+	ebpfIPFamily := flag.String("ebpf-ip-family", "dual", "Address families to shape (dual, ipv4, or ipv6; ebpf backend only)")
+	ebpfNoDelay := flag.Bool("ebpf-no-delay", false, "Only emulate bandwidth, not latency (ebpf backend only)")
+	ebpfTimeHorizon := flag.Duration("ebpf-time-horizon", 2*time.Second, "Drop packets that would be scheduled further into the future (ebpf backend only)")
+	ebpfECNHorizon := flag.Duration("ebpf-ecn-horizon", 0, "ECN mark packets that are scheduled further into the future, 0 disables marking (ebpf backend only)")
+	ebpfRedirect := flag.Bool("ebpf-redirect", false, "Redirect traffic between machines on this host from tap to tap instead of routing it through the host network stack (ebpf backend only)")
+	releaseAfter := flag.Duration("release-after", 0, "Snapshot machines to disk and free their memory after they have been stopped for this long, 0 disables this")
 	debug := flag.Bool("debug", false, "Enable debug logging")
 	trace := flag.Bool("trace", false, "Enable trace logging")
 
@@ -97,7 +105,28 @@ func main() {
 	switch *emBackend {
 	case "ebpf":
 		log.Info("Using eBPF backend")
-		neb = ebpfem.New()
+		c := ebpfem.DefaultConfig()
+		c.Shared = *ebpfShared
+		c.Delay = !*ebpfNoDelay
+		c.TimeHorizon = *ebpfTimeHorizon
+		c.ECNHorizon = *ebpfECNHorizon
+		c.Redirect = *ebpfRedirect
+		switch *ebpfIPFamily {
+		case "dual":
+		case "ipv4":
+			c.IPv6 = false
+		case "ipv6":
+			c.IPv4 = false
+		default:
+			log.Fatal("Invalid IP family for eBPF backend")
+		}
+		if c.Shared {
+			log.Info("Sharing eBPF program and maps between machines")
+		}
+		if c.Redirect {
+			log.Info("Redirecting traffic between local machines in eBPF")
+		}
+		neb = ebpfem.NewWithConfig(c)
 	case "netem":
 		log.Info("Using netem backend")
 		neb = netem.New()
@@ -109,7 +138,7 @@ func main() {
 		panic(err)
 	}
 
-	vb, err := virt.New(*networkInterface, *initDelay, pb, neb)
+	vb, err := virt.New(*networkInterface, *initDelay, *releaseAfter, pb, neb)
 
 	if err != nil {
 		panic(err)
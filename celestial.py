@@ -47,8 +47,9 @@ Then, you can start the emulation run:
 
     python3 celestial.py [celestial.zip] [host1_addr] [host2_addr] ... [hostN_addr]
 
-You can specify as many hosts as you want. The hosts will be assigned machines
-in a round-robin fashion.
+You can specify as many hosts as you want. Satellites are assigned to hosts in
+blocks of neighboring planes, ground stations in a round-robin fashion. Each
+host only receives the link updates of its own machines.
 
 Note that the Celestial emulation run will only for as long as specified in the
 `duration` field of the configuration file. If you want to stop the emulation
@@ -71,6 +72,22 @@ import proto.celestial.celestial_pb2
 import proto.celestial.celestial_pb2_grpc
 
 DEBUG = True
+# send every host only the link diffs for its own machines
+# this saves bandwidth with many hosts, but the next and previous hops of
+# other links go stale on a host, so its HTTP info API, DNS, and SRv6 paths
+# are only correct for paths that start or end on that host
+# only set this to True if you do not use any of these
+PARTITION_DIFFS = False
+# tag every update with the wall-clock time at which it takes effect: hosts
+# stage it as soon as it arrives and commit it at exactly that time, so the
+# next update is sent while the current one is in effect and transfer and
+# staging are off the critical path
+# this needs the clocks of all hosts to be synchronized with this machine
+# (e.g., NTP or PTP), only set this to True if they are, otherwise hosts commit
+# updates at the wrong time
+# with False, every update is sent at its effective time and hosts apply it
+# right away
+SCHEDULE_UPDATES = False
 DEFAULT_PORT = 1969
 
 if __name__ == "__main__":
@@ -118,18 +135,34 @@ if __name__ == "__main__":
             ]
         ],
     ] = {h: [] for h in range(len(hosts))}
-    count = 0
+
+    # this is the logic that assigns machines to hosts
+    # satellites of a shell are split into contiguous blocks of IDs, i.e.,
+    # neighboring planes, so that most ISLs stay on one host and only the
+    # planes at the block boundaries communicate across hosts
+    # ground stations are assigned in a round-robin fashion
+    group_sizes: typing.Dict[int, int] = {}
+    for m_id, _ in inits:
+        g = int(celestial.types.MachineID_group(m_id))
+        group_sizes[g] = group_sizes.get(g, 0) + 1
+
+    group_counts = {g: 0 for g in group_sizes}
+
+    # host of every machine by packed machine ID
+    machine_hosts: typing.Dict[int, int] = {}
 
     for m_id, m_config in inits:
-        # this is the logic that assigns machines to hosts
-        # we just do a round robin assignment for now
-        # this might be suboptimal, because it forces any neighbor
-        # communication to go across the hosts
-        # assinging by shells might be better
-        m_host = count % len(hosts)
+        g = int(celestial.types.MachineID_group(m_id))
+
+        if g == 0:
+            m_host = group_counts[g] % len(hosts)
+        else:
+            m_host = group_counts[g] * len(hosts) // group_sizes[g]
+
+        group_counts[g] += 1
 
         machines[m_host].append((m_id, m_config))
-        count += 1
+        machine_hosts[celestial.proto_util.packed_machineID(m_id)] = m_host
 
     # init the hosts
     logging.info("Initializing hosts...")
@@ -140,56 +173,108 @@ if __name__ == "__main__":
 
     logging.info("Hosts initialized!")
 
+    host_table = celestial.proto_util.HostTable(machine_hosts)
+
     def get_diff(
         t: celestial.types.timestamp_s,
-    ) -> typing.List[proto.celestial.celestial_pb2.StateUpdateRequest]:
-        # we get iterators of the deserialized diffs
+    ) -> typing.List[typing.List[proto.celestial.celestial_pb2.StateUpdateRequest]]:
+        # the diff blocks are views of the mapped trace, nothing is copied
+        # until we build the requests
         t1 = time.perf_counter()
-        s = [
-            *celestial.proto_util.make_update_request_iter(
-                serializer.diff_machines(t), serializer.diff_links(t)
+
+        machine_block = serializer.machine_diff_block(t)
+        link_block = serializer.link_diff_block(t)
+
+        if not PARTITION_DIFFS:
+            s = celestial.proto_util.make_update_requests_from_blocks(
+                machine_block, link_block
             )
-        ]
+
+            logging.debug(f"diffs took {time.perf_counter() - t1} seconds")
+
+            return [s for _ in hosts]
+
+        p = celestial.proto_util.make_host_update_requests_from_blocks(
+            machine_block,
+            link_block,
+            host_table,
+            len(hosts),
+        )
 
         logging.debug(f"diffs took {time.perf_counter() - t1} seconds")
 
-        return s
+        return p
 
     # start the simulation
     timestep: celestial.types.timestamp_s = 0 + config.offset
 
     updates = get_diff(timestep)
 
-    start_time = time.perf_counter()
+    # wall-clock time, as the hosts need to agree on it
+    start_time = time.time()
     logging.info("Starting emulation...")
 
     # install sigterm handler
     signal.signal(signal.SIGTERM, lambda *_: sys.exit(0))
 
     try:
-        while True:
-            logging.info(f"Updating for timestep {timestep}")
-
-            with concurrent.futures.ThreadPoolExecutor() as e:
-                for i in range(len(hosts)):
-                    # need to make some generators
-                    e.submit(hosts[i].update, (u for u in updates))
+        with concurrent.futures.ThreadPoolExecutor(max_workers=len(hosts)) as e:
+            while True:
+                logging.info(f"Updating for timestep {timestep}")
 
-            timestep += config.resolution
+                effective = start_time + (timestep - config.offset)
 
-            if timestep > config.duration + config.offset:
-                break
+                # the first timestep takes effect right away, scheduling it
+                # would only make it late
+                if SCHEDULE_UPDATES and timestep != config.offset:
+                    for i in range(len(hosts)):
+                        celestial.proto_util.schedule_update_requests(
+                            updates[i], timestep, effective
+                        )
 
-            logging.debug(f"getting update for timestep {timestep}")
-
-            # already getting the next timestep to be faster
-            updates = get_diff(timestep)
-
-            logging.debug(
-                f"waiting for {timestep - config.offset - (time.perf_counter() - start_time)} seconds"
-            )
-            while time.perf_counter() - start_time < timestep - config.offset:
-                time.sleep(0.001)
+                futures = [
+                    # need to make some generators
+                    e.submit(hosts[i].update, (u for u in updates[i]))
+                    for i in range(len(hosts))
+                ]
+
+                next_timestep = timestep + config.resolution
+
+                # already getting the next timestep while the hosts are busy
+                if next_timestep <= config.duration + config.offset:
+                    logging.debug(f"getting update for timestep {next_timestep}")
+                    updates = get_diff(next_timestep)
+
+                confirmed = []
+                for i, f in enumerate(futures):
+                    try:
+                        confirmed.append(f.result())
+                    except Exception as ex:
+                        logging.error(f"update of host {i} failed: {ex}")
+
+                # hosts report their exact drift, this also includes the
+                # time until their confirmation arrived here
+                if SCHEDULE_UPDATES and timestep != config.offset and confirmed:
+                    logging.info(
+                        f"timestep {timestep} confirmed by all hosts "
+                        f"{max(confirmed) - effective:.6f} seconds after its "
+                        "effective time"
+                    )
+
+                timestep = next_timestep
+
+                if timestep > config.duration + config.offset:
+                    break
+
+                if SCHEDULE_UPDATES:
+                    # no need to wait, the hosts will commit it on time
+                    continue
+
+                logging.debug(
+                    f"waiting for {timestep - config.offset - (time.time() - start_time)} seconds"
+                )
+                while time.time() - start_time < timestep - config.offset:
+                    time.sleep(0.001)
 
     finally:
         logging.info("got keyboard interrupt, stopping...")
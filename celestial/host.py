@@ -102,12 +102,14 @@ class Host:
         update_requests: typing.Iterator[
             proto.celestial.celestial_pb2.StateUpdateRequest
         ],
-    ) -> None:
+    ) -> float:
         """
-        Send a `update` request to the host.
+        Send a `update` request to the host. A scheduled update (see
+        celestial.proto_util.schedule_update_requests) returns once the
+        host has committed it at its effective time.
 
-        :param machine_diff: An iterator of machine ID and machine state tuples.
-        :param link_diff: An iterator of link tuples.
+        :param update_requests: An iterator of update requests.
+        :return: The wall-clock time at which the host confirmed the update.
         """
 
         t1 = time.perf_counter()
@@ -115,4 +117,4 @@ class Host:
         t2 = time.perf_counter()
         logging.debug(f"update transmission took {t2-t1} seconds")
 
-        return
+        return time.time()
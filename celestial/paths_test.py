@@ -0,0 +1,218 @@
+#
+# This file is part of Celestial (https://github.com/OpenFogStack/celestial).
+# Copyright (c) 2024 Tobias Pfandzelter, The OpenFogStack Team.
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, version 3.
+#
+# This program is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+# General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program. If not, see <http://www.gnu.org/licenses/>.
+#
+
+"""
+Tests the sparse shortest paths of a shell (one Dijkstra search per
+satellite, with _refresh_tree to reuse the trees of the last timestep)
+against the dense Floyd-Warshall it replaces.
+"""
+
+import numpy as np
+import time
+import typing
+
+import celestial.shell
+
+
+def generate_test_grid(
+    planes: int, sats: int, rng: np.random.Generator
+) -> typing.Tuple[np.ndarray, int]:  # type: ignore
+    # a +GRID: every satellite has a link to the next in its plane and to the
+    # same one in the next plane
+    total_sats = planes * sats
+
+    links = np.zeros(2 * total_sats, dtype=celestial.shell.SAT_LINK_DTYPE)
+
+    i = 0
+    for plane in range(planes):
+        for node in range(sats):
+            s = plane * sats + node
+
+            for t in (
+                plane * sats + (node + 1) % sats,
+                ((plane + 1) % planes) * sats + node,
+            ):
+                links[i]["node_1"] = s
+                links[i]["node_2"] = t
+                i += 1
+
+    # random lengths, so that there are no ties between paths
+    links["distance_m"] = rng.integers(1_000_000, 5_000_000, size=len(links))
+
+    # remove some links
+    links["active"] = rng.random(size=len(links)) > 0.1
+
+    return links, i
+
+
+def sparse_paths(
+    links: np.ndarray,  # type: ignore
+    total_links: int,
+    total_sats: int,
+    topology_changed: bool,
+    state: typing.Dict[str, np.ndarray],  # type: ignore
+) -> None:
+    celestial.shell.Shell._numba_sparse_shortest_paths(
+        sat_link_array=links,
+        total_isl_links=total_links,
+        total_sats=total_sats,
+        topology_changed=topology_changed,
+        dist_matrix=state["dist"],
+        next_hops=state["next"],
+        prev_hops=state["prev"],
+        path_order=state["order"],
+    )
+
+
+def dense_paths(
+    links: np.ndarray,  # type: ignore
+    total_links: int,
+    total_sats: int,
+) -> typing.Tuple[np.ndarray, np.ndarray]:  # type: ignore
+    dist = np.empty((total_sats, total_sats), dtype=np.float32)
+    next_hops = np.full((total_sats, total_sats), -1, dtype=np.int16)
+    prev_hops = np.full((total_sats, total_sats), -1, dtype=np.int16)
+
+    celestial.shell.Shell._numba_floyd_warshall(
+        sat_link_array=links,
+        total_isl_links=total_links,
+        total_sats=total_sats,
+        dist_matrix=dist,
+        next_hops=next_hops,
+        prev_hops=prev_hops,
+    )
+
+    return dist, next_hops
+
+
+def link_lengths(
+    links: np.ndarray,  # type: ignore
+    total_links: int,
+    total_sats: int,
+) -> np.ndarray:  # type: ignore
+    w = np.full((total_sats, total_sats), np.inf)
+
+    for link in links[:total_links]:
+        if link["active"]:
+            w[link["node_1"], link["node_2"]] = link["distance_m"]
+            w[link["node_2"], link["node_1"]] = link["distance_m"]
+
+    return w
+
+
+def test_paths(
+    links: np.ndarray,  # type: ignore
+    total_links: int,
+    total_sats: int,
+    topology_changed: bool,
+    state: typing.Dict[str, np.ndarray],  # type: ignore
+) -> None:
+    t1 = time.perf_counter()
+    sparse_paths(links, total_links, total_sats, topology_changed, state)
+    t2 = time.perf_counter()
+    dist_fw, next_fw = dense_paths(links, total_links, total_sats)
+    t3 = time.perf_counter()
+
+    print(f"Sparse time: {t2 - t1}")
+    print(f"Floyd-Warshall time: {t3 - t2}")
+
+    dist = state["dist"]
+
+    # the dense version sums up in float32, so allow for some rounding
+    assert np.array_equal(np.isinf(dist), np.isinf(dist_fw))
+    reachable = ~np.isinf(dist)
+    assert np.allclose(dist[reachable], dist_fw[reachable], rtol=1e-5)
+
+    # shortest paths may tie, so we do not compare hops directly, but check
+    # that the hops lie on a shortest path
+    w = link_lengths(links, total_links, total_sats)
+    s, t = np.nonzero(reachable & ~np.eye(total_sats, dtype=np.bool_))
+
+    n = state["next"][s, t].astype(np.int64)
+    p = state["prev"][s, t].astype(np.int64)
+
+    assert np.all(n >= 0) and np.all(p >= 0)
+    assert np.allclose(w[s, n] + dist[n, t], dist[s, t], rtol=1e-5)
+    assert np.allclose(dist[s, p] + w[p, t], dist[s, t], rtol=1e-5)
+
+    equal = np.sum(state["next"][s, t] == next_fw[s, t])
+    print(f"{equal}/{len(s)} next hops equal to Floyd-Warshall")
+
+    # unchanged links leave all trees valid
+    indptr, indices, weights = csr(links, total_links, total_sats)
+    d = np.empty(total_sats, dtype=np.float64)
+
+    for source in range(total_sats):
+        assert celestial.shell._refresh_tree(
+            source, indptr, indices, weights, d, state["prev"], state["order"]
+        )
+
+
+def csr(
+    links: np.ndarray,  # type: ignore
+    total_links: int,
+    total_sats: int,
+) -> typing.Tuple[np.ndarray, np.ndarray, np.ndarray]:  # type: ignore
+    # the same adjacency as _numba_sparse_shortest_paths builds
+    w = link_lengths(links, total_links, total_sats)
+
+    indptr = np.zeros(total_sats + 1, dtype=np.int32)
+    indices = []
+    weights = []
+
+    for u in range(total_sats):
+        (v,) = np.nonzero(~np.isinf(w[u]))
+        indices.extend(v)
+        weights.extend(w[u, v])
+        indptr[u + 1] = len(indices)
+
+    return (
+        indptr,
+        np.array(indices, dtype=np.int32),
+        np.array(weights, dtype=np.float64),
+    )
+
+
+if __name__ == "__main__":
+    rng = np.random.default_rng(2)
+
+    for planes, sats in [(3, 4), (6, 11), (24, 22), (72, 22)]:
+        links, total_links = generate_test_grid(planes, sats, rng)
+        total_sats = planes * sats
+
+        state = {
+            "dist": np.empty((total_sats, total_sats), dtype=np.float32),
+            "next": np.full((total_sats, total_sats), -1, dtype=np.int16),
+            "prev": np.full((total_sats, total_sats), -1, dtype=np.int16),
+            "order": np.full((total_sats, total_sats), -1, dtype=np.int16),
+        }
+
+        # from scratch
+        test_paths(links, total_links, total_sats, True, state)
+
+        # satellites moved a little: the trees are refreshed, and searched
+        # again where they are no longer shortest
+        links["distance_m"] = (
+            links["distance_m"] * rng.uniform(0.95, 1.05, size=len(links))
+        ).astype(np.uint32)
+        test_paths(links, total_links, total_sats, False, state)
+
+        # links came and went
+        links["active"] = rng.random(size=len(links)) > 0.1
+        test_paths(links, total_links, total_sats, True, state)
+
+    print("Test passed successfully!")
@@ -20,6 +20,8 @@
 import logging
 import typing
 
+import numpy as np
+
 import celestial.config
 import celestial.host
 import celestial.types
@@ -86,22 +88,99 @@ def make_init_request(
     return init_request
 
 
-T = typing.TypeVar("T")
+def packed_machineID(m: celestial.types.MachineID_dtype) -> int:
+    """
+    Encode a machine ID for PackedNetworkDiffs as group << 24 | id.
+    """
+    return celestial.types.MachineID_packed(m)
+
+
+def unpacked_machineID(m: int) -> proto.celestial.celestial_pb2.MachineID:
+    """
+    Decode a machine ID of a diff block (see packed_machineID).
+    """
+    group, id = celestial.types.MachineID_unpacked(m)
+    return proto.celestial.celestial_pb2.MachineID(group=group, id=id)
+
+
+# source, target, blocked, latency_us, bandwidth_kbps, next_hop, prev_hop
+_PackedColumns = typing.Tuple[
+    typing.List[int],
+    typing.List[int],
+    typing.List[bool],
+    typing.List[int],
+    typing.List[int],
+    typing.List[int],
+    typing.List[int],
+]
+
+
+def _make_packed_request(
+    columns: _PackedColumns,
+) -> proto.celestial.celestial_pb2.StateUpdateRequest:
+    source, target, blocked, latency_us, bandwidth_kbps, next_hop, prev_hop = columns
+
+    return proto.celestial.celestial_pb2.StateUpdateRequest(
+        packed_network_diffs=proto.celestial.celestial_pb2.StateUpdateRequest.PackedNetworkDiffs(
+            source=source,
+            target=target,
+            blocked=blocked,
+            latency_us=latency_us,
+            bandwidth_kbps=bandwidth_kbps,
+            next=next_hop,
+            prev=prev_hop,
+        )
+    )
 
 
-def _islice(iterable: typing.Iterator[T], n: int) -> typing.Iterator[T]:
-    count = 0
+def _new_columns() -> _PackedColumns:
+    return ([], [], [], [], [], [], [])
 
-    for i in iterable:
-        if count >= n:
-            break
 
-        yield i
+def _append_link(
+    columns: _PackedColumns,
+    s: int,
+    t: int,
+    link: celestial.types.Link_dtype,
+) -> None:
+    source, target, blocked, latency_us, bandwidth_kbps, next_hop, prev_hop = columns
 
-        count += 1
+    source.append(s)
+    target.append(t)
 
-    if count == 0:
-        raise StopIteration
+    if celestial.types.Link_blocked(link):
+        blocked.append(True)
+        latency_us.append(0)
+        bandwidth_kbps.append(0)
+        next_hop.append(0)
+        prev_hop.append(0)
+    else:
+        blocked.append(False)
+        latency_us.append(int(celestial.types.Link_latency_us(link)))
+        bandwidth_kbps.append(int(celestial.types.Link_bandwidth_kbits(link)))
+        next_hop.append(packed_machineID(celestial.types.Link_next_hop(link)))
+        prev_hop.append(packed_machineID(celestial.types.Link_prev_hop(link)))
+
+
+def _make_machine_request(
+    machine_diff_iter: typing.Iterator[
+        typing.Tuple[celestial.types.MachineID_dtype, celestial.types.VMState]
+    ],
+) -> proto.celestial.celestial_pb2.StateUpdateRequest:
+    return proto.celestial.celestial_pb2.StateUpdateRequest(
+        machine_diffs=[
+            proto.celestial.celestial_pb2.StateUpdateRequest.MachineDiff(
+                id=proto.celestial.celestial_pb2.MachineID(
+                    group=_machineID_group(m_id),
+                    id=_machineID_id(m_id),
+                ),
+                active=proto.celestial.celestial_pb2.VM_STATE_STOPPED
+                if m_state == celestial.types.VMState.STOPPED
+                else proto.celestial.celestial_pb2.VM_STATE_ACTIVE,
+            )
+            for m_id, m_state in machine_diff_iter
+        ],
+    )
 
 
 def make_update_request_iter(
@@ -119,75 +198,180 @@ def make_update_request_iter(
     """
     A function that returns a combined iterator of StateUpdateRequests based on
     iterating over machine_diff_iter and link_diff_iter.
+
+    Link diffs are sent as PackedNetworkDiffs in chunks of at most
+    MAX_DIFF_UPDATE_SIZE links. We only collect plain integers in
+    columns, which is much cheaper than building a NetworkDiff message
+    (with four MachineID messages) per link.
     """
 
-    yield proto.celestial.celestial_pb2.StateUpdateRequest(
+    yield _make_machine_request(machine_diff_iter)
+
+    columns = _new_columns()
+
+    for s, t, link in link_diff_iter:
+        _append_link(columns, packed_machineID(s), packed_machineID(t), link)
+
+        if len(columns[0]) >= MAX_DIFF_UPDATE_SIZE:
+            # the request holds a copy of the columns
+            yield _make_packed_request(columns)
+            columns = _new_columns()
+
+    if len(columns[0]) > 0:
+        yield _make_packed_request(columns)
+
+    logging.debug("generating update requests done")
+
+
+def _make_link_block_request(
+    block: np.ndarray,  # type: ignore
+) -> proto.celestial.celestial_pb2.StateUpdateRequest:
+    blocked = block["blocked"]
+
+    return proto.celestial.celestial_pb2.StateUpdateRequest(
+        packed_network_diffs=proto.celestial.celestial_pb2.StateUpdateRequest.PackedNetworkDiffs(
+            source=block["source"].tolist(),
+            target=block["target"].tolist(),
+            blocked=blocked.tolist(),
+            latency_us=np.where(blocked, 0, block["latency_us"]).tolist(),
+            bandwidth_kbps=np.where(blocked, 0, block["bandwidth_kbits"]).tolist(),
+            next=np.where(blocked, 0, block["next_hop"]).tolist(),
+            prev=np.where(blocked, 0, block["prev_hop"]).tolist(),
+        )
+    )
+
+
+def _make_machine_block_request(
+    block: np.ndarray,  # type: ignore
+) -> proto.celestial.celestial_pb2.StateUpdateRequest:
+    return proto.celestial.celestial_pb2.StateUpdateRequest(
         machine_diffs=[
             proto.celestial.celestial_pb2.StateUpdateRequest.MachineDiff(
-                id=proto.celestial.celestial_pb2.MachineID(
-                    group=_machineID_group(m_id),
-                    id=_machineID_id(m_id),
-                ),
+                id=unpacked_machineID(m),
                 active=proto.celestial.celestial_pb2.VM_STATE_STOPPED
-                if m_state == celestial.types.VMState.STOPPED
+                if state == celestial.types.VMState.STOPPED.value
                 else proto.celestial.celestial_pb2.VM_STATE_ACTIVE,
             )
-            for m_id, m_state in machine_diff_iter
+            for m, state in zip(block["machine"].tolist(), block["state"].tolist())
         ],
     )
 
-    try:
-        while True:
-            t = proto.celestial.celestial_pb2.StateUpdateRequest(
-                network_diffs=[
-                    proto.celestial.celestial_pb2.StateUpdateRequest.NetworkDiff(
-                        source=proto.celestial.celestial_pb2.MachineID(
-                            group=_machineID_group(source),
-                            id=_machineID_id(source),
-                        ),
-                        target=proto.celestial.celestial_pb2.MachineID(
-                            group=_machineID_group(target),
-                            id=_machineID_id(target),
-                        ),
-                        latency_us=typing.cast(
-                            int, celestial.types.Link_latency_us(link)
-                        ),
-                        bandwidth_kbps=typing.cast(
-                            int, celestial.types.Link_bandwidth_kbits(link)
-                        ),
-                        blocked=False,
-                        next=proto.celestial.celestial_pb2.MachineID(
-                            group=_machineID_group(celestial.types.Link_next_hop(link)),
-                            id=_machineID_id(celestial.types.Link_next_hop(link)),
-                        ),
-                        prev=proto.celestial.celestial_pb2.MachineID(
-                            group=_machineID_group(celestial.types.Link_prev_hop(link)),
-                            id=_machineID_id(celestial.types.Link_prev_hop(link)),
-                        ),
-                    )
-                    if not celestial.types.Link_blocked(link)
-                    else proto.celestial.celestial_pb2.StateUpdateRequest.NetworkDiff(
-                        source=proto.celestial.celestial_pb2.MachineID(
-                            group=_machineID_group(source),
-                            id=_machineID_id(source),
-                        ),
-                        target=proto.celestial.celestial_pb2.MachineID(
-                            group=_machineID_group(target),
-                            id=_machineID_id(target),
-                        ),
-                        blocked=True,
-                    )
-                    for source, target, link in _islice(
-                        link_diff_iter, MAX_DIFF_UPDATE_SIZE
-                    )
-                ]
-            )
-            yield t
-    except RuntimeError:
-        # we reached the end of the link diff iterator
-        # we just yield an empty update request
-        # yield proto.celestial.celestial_pb2.StateUpdateRequest()
-
-        # and we are done
-        logging.debug("generating update requests done")
+
+def _append_link_block_requests(
+    requests: typing.List[proto.celestial.celestial_pb2.StateUpdateRequest],
+    block: np.ndarray,  # type: ignore
+) -> None:
+    for i in range(0, len(block), MAX_DIFF_UPDATE_SIZE):
+        requests.append(_make_link_block_request(block[i : i + MAX_DIFF_UPDATE_SIZE]))
+
+
+def make_update_requests_from_blocks(
+    machine_block: np.ndarray,  # type: ignore
+    link_block: np.ndarray,  # type: ignore
+) -> typing.List[proto.celestial.celestial_pb2.StateUpdateRequest]:
+    """
+    Like make_update_request_iter, but takes the diffs of a timestep as
+    blocks (see celestial.types.LINK_DIFF_DTYPE and MACHINE_DIFF_DTYPE), as
+    the ZipDeserializer returns them. The columns of the block go into the
+    PackedNetworkDiffs directly, without a Python object per link.
+    """
+
+    requests = [_make_machine_block_request(machine_block)]
+
+    _append_link_block_requests(requests, link_block)
+
+    return requests
+
+
+class HostTable:
+    """
+    A lookup table for the hosts of machines by packed machine ID that works
+    on whole arrays of machine IDs.
+    """
+
+    def __init__(self, machine_hosts: typing.Dict[int, int]):
+        """
+        :param machine_hosts: The host of every machine, by packed machine ID.
+        """
+        ids = np.fromiter(machine_hosts.keys(), dtype=np.uint32)
+        hosts = np.fromiter(machine_hosts.values(), dtype=np.int64)
+
+        order = np.argsort(ids)
+        self.ids = ids[order]
+        self.hosts = hosts[order]
+
+    def lookup(self, machines: np.ndarray) -> np.ndarray:  # type: ignore
+        """
+        Get the hosts of machines.
+
+        :param machines: Packed machine IDs.
+        :return: The host of each machine.
+        :raises KeyError: If a machine has no host.
+        """
+        i = np.minimum(np.searchsorted(self.ids, machines), len(self.ids) - 1)
+
+        unknown = self.ids[i] != machines
+        if np.any(unknown):
+            raise KeyError(f"no host for machines {machines[unknown][:10]}")
+
+        return self.hosts[i]  # type: ignore
+
+
+def make_host_update_requests_from_blocks(
+    machine_block: np.ndarray,  # type: ignore
+    link_block: np.ndarray,  # type: ignore
+    host_table: HostTable,
+    num_hosts: int,
+) -> typing.List[typing.List[proto.celestial.celestial_pb2.StateUpdateRequest]]:
+    """
+    Like make_update_requests_from_blocks, but partitions the link diffs by
+    host. A host only receives the diffs of links that have an endpoint on
+    that host, as it discards changes for links of remote machines anyway.
+    Machine diffs are small and are sent to every host.
+
+    :param host_table: The hosts of all machines.
+    :param num_hosts: The number of hosts.
+    :return: A list of update requests for each host.
+    """
+
+    machine_request = _make_machine_block_request(machine_block)
+
+    # each diff sets both directions of a link, so the hosts of the source
+    # and the target need it
+    s_host = host_table.lookup(link_block["source"])
+    t_host = host_table.lookup(link_block["target"])
+
+    requests: typing.List[
+        typing.List[proto.celestial.celestial_pb2.StateUpdateRequest]
+    ] = []
+
+    for h in range(num_hosts):
+        r = [machine_request]
+        _append_link_block_requests(r, link_block[(s_host == h) | (t_host == h)])
+        requests.append(r)
+
+    logging.debug("generating host update requests done")
+
+    return requests
+
+
+def schedule_update_requests(
+    requests: typing.List[proto.celestial.celestial_pb2.StateUpdateRequest],
+    timestep: celestial.types.timestamp_s,
+    effective: float,
+) -> None:
+    """
+    Set the effective time of an update. The host stages the update as it
+    arrives and commits it at that time. Only the first request of an update
+    carries the effective time.
+
+    :param requests: The update requests of a host.
+    :param timestep: The timestep of the update, used by hosts to report drift.
+    :param effective: The wall-clock time (seconds since the Unix epoch) at
+        which the update takes effect.
+    """
+    if len(requests) == 0:
         return
+
+    requests[0].effective_unix_us = int(effective * 1_000_000)
+    requests[0].timestep = int(timestep)
@@ -28,6 +28,32 @@ import celestial.types
 import celestial.shell
 
 DELAY_UPDATE_THRESHOLD_US = 500
+# number of upcoming timesteps to calculate satellite positions for at once
+PREFETCH_STEPS = 64
+
+
+def make_shell(config: celestial.config.Config, i: int) -> celestial.shell.Shell:
+    """
+    Create shell i of a configuration.
+
+    :param config: The configuration of the constellation.
+    :param i: The index of the shell in the configuration.
+    :return: The shell.
+    """
+    sc = config.shells[i]
+
+    return celestial.shell.Shell(
+        shell_identifier=i + 1,
+        planes=sc.planes,
+        sats=sc.sats,
+        altitude_km=sc.altitude_km,
+        inclination=sc.inclination,
+        arc_of_ascending_nodes=sc.arc_of_ascending_nodes,
+        eccentricity=sc.eccentricity,
+        isl_bandwidth_kbits=sc.isl_bandwidth_kbits,
+        bbox=config.bbox,
+        ground_stations=config.ground_stations,
+    )
 
 
 class SatgenConstellation:
@@ -40,34 +66,37 @@ class SatgenConstellation:
         self,
         config: celestial.config.Config,
         writer: celestial.serializer.Serializer,
+        with_shells: bool = True,
     ):
         """
         Initialize the constellation.
 
         :param config: The configuration of the constellation.
         :param writer: The serializer to use for writing updates.
+        :param with_shells: Whether to create the shells. Without shells,
+            only the initialization is written and step does nothing, e.g.,
+            because the shells are stepped by satgen_parallel instead.
         """
+        # timesteps are prefetched as a range, which needs whole seconds
+        for name in ("offset", "duration", "resolution"):
+            if not isinstance(getattr(config, name), int):
+                raise ValueError(
+                    f"{name} must be a whole number of seconds, "
+                    f"got {getattr(config, name)}"
+                )
+
         self.current_time: celestial.types.timestamp_s = config.offset
+        self.resolution = config.resolution
+        self.end_time = config.offset + config.duration
+        self.prefetched_until: celestial.types.timestamp_s = config.offset
         self.shells: typing.List[celestial.shell.Shell] = []
         self.ground_stations: typing.List[celestial.types.MachineID_dtype] = []
 
         self.writer = writer
 
-        for i, sc in enumerate(config.shells):
-            s = celestial.shell.Shell(
-                shell_identifier=i + 1,
-                planes=sc.planes,
-                sats=sc.sats,
-                altitude_km=sc.altitude_km,
-                inclination=sc.inclination,
-                arc_of_ascending_nodes=sc.arc_of_ascending_nodes,
-                eccentricity=sc.eccentricity,
-                isl_bandwidth_kbits=sc.isl_bandwidth_kbits,
-                bbox=config.bbox,
-                ground_stations=config.ground_stations,
-            )
-
-            self.shells.append(s)
+        if with_shells:
+            for i in range(len(config.shells)):
+                self.shells.append(make_shell(config, i))
 
         self.nodes: typing.Dict[
             celestial.types.MachineID_dtype, celestial.config.MachineConfig
@@ -132,6 +161,21 @@ class SatgenConstellation:
         """
         self.current_time = t
 
+        if self.current_time >= self.prefetched_until:
+            times = range(
+                self.current_time,
+                min(
+                    self.current_time + PREFETCH_STEPS * self.resolution,
+                    self.end_time,
+                ),
+                self.resolution,
+            )
+
+            for s in self.shells:
+                s.prefetch_positions(times)
+
+            self.prefetched_until = times.stop
+
         for s in self.shells:
             s.step(
                 self.current_time,
@@ -143,6 +187,4 @@ class SatgenConstellation:
             for machine, state in s.get_sat_node_diffs().items():
                 self.writer.diff_machine(self.current_time, machine, state)
 
-            for source, links in s.get_link_diff().items():
-                for target, link in links.items():
-                    self.writer.diff_link(self.current_time, source, target, link)
+            self.writer.diff_link_block(self.current_time, s.get_link_diff_block())
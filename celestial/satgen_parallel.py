@@ -0,0 +1,238 @@
+#
+# This file is part of Celestial (https://github.com/OpenFogStack/celestial).
+# Copyright (c) 2024 Tobias Pfandzelter, The OpenFogStack Team.
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, version 3.
+#
+# This program is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+# General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program. If not, see <http://www.gnu.org/licenses/>.
+#
+
+"""
+Parallel trace generation: shells and ranges of timesteps are generated in
+separate worker processes, each writing its own shard of diff blocks, which
+are then merged into the serializer in timestep order.
+
+Shells are independent of each other. A range of timesteps is independent of
+the timesteps before it, except for the diffs at the start of the range: a
+worker first steps to the timestep before its range (without writing those
+diffs), so that all following diffs are relative to that state. Whether a
+link is blocked and its next hop are always exact, but delays that changed by
+less than the delay update threshold before the range may deviate by up to
+twice the threshold at the start of a range (instead of once), until the
+next update of the link.
+"""
+
+import concurrent.futures
+import math
+import os
+import shutil
+import tempfile
+import typing
+
+import numpy as np
+import tqdm
+
+import celestial.config
+import celestial.satgen_connstellation
+import celestial.types
+import celestial.zip_serializer
+
+# a range of timesteps should be long enough for the extra step at its start
+# not to matter
+MIN_SHARD_STEPS = 32
+
+_SHARD_LINK_FILE = "L"
+_SHARD_MACHINE_FILE = "M"
+
+
+class _Task(typing.NamedTuple):
+    config: celestial.config.Config
+    shell: int
+    times: range
+    shard_dir: str
+
+
+class _Shard(typing.NamedTuple):
+    shell: int
+    times: range
+    shard_dir: str
+    # timestep -> (offset, count)
+    links: typing.Dict[celestial.types.timestamp_s, typing.Tuple[int, int]]
+    machines: typing.Dict[celestial.types.timestamp_s, typing.Tuple[int, int]]
+
+
+def _generate_shard(task: _Task) -> _Shard:
+    """
+    Generate the diffs of one shell for a range of timesteps. Runs in a
+    worker process.
+    """
+    shell = celestial.satgen_connstellation.make_shell(task.config, task.shell)
+    threshold = celestial.satgen_connstellation.DELAY_UPDATE_THRESHOLD_US
+    prefetch = celestial.satgen_connstellation.PREFETCH_STEPS
+
+    os.makedirs(task.shard_dir)
+
+    links = celestial.zip_serializer.BlockWriter(
+        os.path.join(task.shard_dir, _SHARD_LINK_FILE),
+        celestial.types.LINK_DIFF_DTYPE,
+    )
+    machines = celestial.zip_serializer.BlockWriter(
+        os.path.join(task.shard_dir, _SHARD_MACHINE_FILE),
+        celestial.types.MACHINE_DIFF_DTYPE,
+    )
+
+    # the first range starts from the initial state, all others from the
+    # state at the timestep before them
+    if task.times.start > task.config.offset:
+        shell.step(
+            task.times.start - task.times.step,
+            calculate_diffs=True,
+            delay_update_threshold_us=threshold,
+        )
+
+    for i in range(0, len(task.times), prefetch):
+        times = task.times[i : i + prefetch]
+
+        shell.prefetch_positions(times)
+
+        for t in times:
+            shell.step(
+                t,
+                calculate_diffs=True,
+                delay_update_threshold_us=threshold,
+            )
+
+            for machine, state in shell.get_sat_node_diffs().items():
+                machines.add_row(
+                    t, (celestial.types.MachineID_packed(machine), state.value)
+                )
+
+            links.add_block(t, shell.get_link_diff_block())
+
+    links.close()
+    machines.close()
+
+    return _Shard(
+        shell=task.shell,
+        times=task.times,
+        shard_dir=task.shard_dir,
+        links=links.index,
+        machines=machines.index,
+    )
+
+
+def _load(path: str, dtype: np.dtype) -> np.ndarray:  # type: ignore
+    if os.path.getsize(path) == 0:
+        return np.empty(0, dtype=dtype)
+
+    return np.memmap(path, dtype=dtype, mode="r")
+
+
+def _ranges(config: celestial.config.Config, workers: int) -> typing.List[range]:
+    """
+    Split the timesteps of a configuration into ranges, so that there are
+    about twice as many tasks as workers.
+    """
+    times = range(config.offset, config.offset + config.duration, config.resolution)
+
+    per_shell = math.ceil(2 * workers / len(config.shells))
+    n = max(1, min(per_shell, len(times) // MIN_SHARD_STEPS))
+
+    size = math.ceil(len(times) / n)
+
+    return [times[i : i + size] for i in range(0, len(times), size)]
+
+
+def generate(
+    config: celestial.config.Config,
+    serializer: celestial.zip_serializer.ZipSerializer,
+    workers: int,
+) -> None:
+    """
+    Generate the trace of a configuration with a number of worker processes
+    and write it to a serializer. Every worker holds one shell, so memory use
+    grows with the number of workers.
+
+    :param config: The configuration.
+    :param serializer: The serializer to write the trace to.
+    :param workers: The number of worker processes.
+    """
+    # writes the machine initialization and the ground station state
+    celestial.satgen_connstellation.SatgenConstellation(
+        config, serializer, with_shells=False
+    )
+
+    shard_root = tempfile.mkdtemp(prefix="satgen-")
+
+    try:
+        tasks = [
+            _Task(
+                config=config,
+                shell=s,
+                times=r,
+                shard_dir=os.path.join(shard_root, f"{s}-{r.start}"),
+            )
+            for s in range(len(config.shells))
+            for r in _ranges(config, workers)
+        ]
+
+        shards: typing.List[_Shard] = []
+
+        pbar = tqdm.tqdm(total=sum(len(t.times) for t in tasks))
+
+        with concurrent.futures.ProcessPoolExecutor(max_workers=workers) as e:
+            futures = [e.submit(_generate_shard, t) for t in tasks]
+
+            for f in concurrent.futures.as_completed(futures):
+                shard = f.result()
+                shards.append(shard)
+                pbar.update(len(shard.times))
+
+        pbar.close()
+
+        # merge in timestep order, shells in order within a timestep
+        shards.sort(key=lambda s: (s.times.start, s.shell))
+
+        ranges = sorted({s.times for s in shards}, key=lambda r: r.start)
+
+        for r in ranges:
+            in_range = [s for s in shards if s.times == r]
+
+            blocks = [
+                (
+                    s,
+                    _load(
+                        os.path.join(s.shard_dir, _SHARD_LINK_FILE),
+                        celestial.types.LINK_DIFF_DTYPE,
+                    ),
+                    _load(
+                        os.path.join(s.shard_dir, _SHARD_MACHINE_FILE),
+                        celestial.types.MACHINE_DIFF_DTYPE,
+                    ),
+                )
+                for s in in_range
+            ]
+
+            for t in r:
+                for s, links, machines in blocks:
+                    if t in s.machines:
+                        o, c = s.machines[t]
+                        serializer.diff_machine_block(t, machines[o : o + c])
+
+                    if t in s.links:
+                        o, c = s.links[t]
+                        serializer.diff_link_block(t, links[o : o + c])
+
+            for s in in_range:
+                shutil.rmtree(s.shard_dir)
+
+    finally:
+        shutil.rmtree(shard_root, ignore_errors=True)
@@ -18,6 +18,9 @@
 """A protocol for serializers and deserializers"""
 
 import typing
+
+import numpy as np
+
 import celestial.types
 
 
@@ -57,6 +60,19 @@ class Serializer(typing.Protocol):
         """
         ...
 
+    def diff_link_block(
+        self,
+        t: celestial.types.timestamp_s,
+        block: np.ndarray,  # type: ignore
+    ) -> None:
+        """
+        Serialize a block of link updates.
+
+        :param t: The timestamp of the updates.
+        :param block: The link updates as celestial.types.LINK_DIFF_DTYPE.
+        """
+        ...
+
     def diff_machine(
         self,
         t: celestial.types.timestamp_s,
@@ -133,3 +149,25 @@ class Deserializer(typing.Protocol):
         :return: A list of machine state updates.
         """
         ...
+
+    def link_diff_block(
+        self, t: celestial.types.timestamp_s
+    ) -> np.ndarray:  # type: ignore
+        """
+        Deserialize the link updates as a block.
+
+        :param t: The timestamp of the update.
+        :return: The link updates as celestial.types.LINK_DIFF_DTYPE.
+        """
+        ...
+
+    def machine_diff_block(
+        self, t: celestial.types.timestamp_s
+    ) -> np.ndarray:  # type: ignore
+        """
+        Deserialize the machine state updates as a block.
+
+        :param t: The timestamp of the update.
+        :return: The machine state updates as celestial.types.MACHINE_DIFF_DTYPE.
+        """
+        ...
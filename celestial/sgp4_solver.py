@@ -21,6 +21,7 @@ import datetime
 import numpy as np
 import math
 import sgp4.api as sgp4
+import typing
 
 if not sgp4.accelerated:
     import warnings
@@ -90,6 +91,10 @@ class SGP4Solver:
             starttime.second,
         )
 
+        # positions of prefetched timesteps, see prefetch
+        self.prefetched: typing.Dict[celestial.types.timestamp_s, int] = {}
+        self.prefetched_positions = np.empty((0, self.total_sats, 3), dtype=np.int32)
+
     def init_sat_array(self, satellites_array: np.ndarray) -> np.ndarray:  # type: ignore
         """
         Initialize the satellite array with the initial positions.
@@ -161,19 +166,53 @@ class SGP4Solver:
                     ),  # nodeo: right ascension of ascending node (radians)
                 )
 
-                # calculate initial position
-                e, r, d = self.sgp4_solvers[unique_id].sgp4(
-                    self.start_jd, self.start_fr
-                )
-
-                # update satellties array
+        # propagate the whole shell in one call from now on
+        self.sgp4_array = sgp4.SatrecArray(self.sgp4_solvers)
 
-                satellites_array[unique_id]["x"] = np.int32(r[0]) * 1000
-                satellites_array[unique_id]["y"] = np.int32(r[1]) * 1000
-                satellites_array[unique_id]["z"] = np.int32(r[2]) * 1000
+        # calculate initial positions
+        self._write_positions(self._propagate([0])[0], satellites_array)
 
         return satellites_array
 
+    def _propagate(
+        self, times: typing.Sequence[celestial.types.timestamp_s]
+    ) -> np.ndarray:  # type: ignore
+        """
+        Calculate the positions of all satellites at the given times in one
+        batch.
+
+        :param times: The times in seconds since the start of the simulation.
+        :return: The positions in meters with shape (len(times), total_sats, 3).
+        """
+        fr = self.start_fr + (np.asarray(times, dtype=np.float64) / SECONDS_PER_DAY)
+        jd = np.full_like(fr, self.start_jd)
+
+        # r has shape (total_sats, len(times), 3) in km
+        e, r, d = self.sgp4_array.sgp4(jd, fr)
+
+        # positions are truncated to full km, as always
+        return np.swapaxes(r, 0, 1).astype(np.int32) * 1000  # type: ignore
+
+    def _write_positions(
+        self,
+        positions: np.ndarray,  # type: ignore
+        satellites_array: np.ndarray,  # type: ignore
+    ) -> None:
+        satellites_array["x"] = positions[:, 0]
+        satellites_array["y"] = positions[:, 1]
+        satellites_array["z"] = positions[:, 2]
+
+    def prefetch(self, times: typing.Sequence[celestial.types.timestamp_s]) -> None:
+        """
+        Calculate the satellite positions for several upcoming times at once,
+        so that set_time only has to look them up. Replaces the positions of
+        earlier calls.
+
+        :param times: The times in seconds since the start of the simulation.
+        """
+        self.prefetched = {t: i for i, t in enumerate(times)}
+        self.prefetched_positions = self._propagate(times)
+
     def set_time(
         self,
         time: celestial.types.timestamp_s,
@@ -186,13 +225,11 @@ class SGP4Solver:
         :param satellites_array: The satellite array to update.
         :return: The updated satellite array.
         """
-        fr = self.start_fr + (time / SECONDS_PER_DAY)
-
-        for sat_id in range(len(satellites_array)):
-            e, r, d = self.sgp4_solvers[sat_id].sgp4(self.start_jd, fr)
+        if time in self.prefetched:
+            positions = self.prefetched_positions[self.prefetched[time]]
+        else:
+            positions = self._propagate([time])[0]
 
-            satellites_array[sat_id]["x"] = np.int32(r[0]) * 1000
-            satellites_array[sat_id]["y"] = np.int32(r[1]) * 1000
-            satellites_array[sat_id]["z"] = np.int32(r[2]) * 1000
+        self._write_positions(positions, satellites_array)
 
         return satellites_array
@@ -0,0 +1,84 @@
+#
+# This file is part of Celestial (https://github.com/OpenFogStack/celestial).
+# Copyright (c) 2024 Tobias Pfandzelter, The OpenFogStack Team.
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, version 3.
+#
+# This program is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+# General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program. If not, see <http://www.gnu.org/licenses/>.
+#
+
+"""
+Tests the batched and prefetched satellite positions of SGP4Solver against
+propagating every satellite on its own.
+"""
+
+import numpy as np
+import time
+
+import celestial.sgp4_solver
+import celestial.shell
+
+
+def per_satellite_positions(
+    solver: celestial.sgp4_solver.SGP4Solver,
+    t: int,
+    satellites_array: np.ndarray,  # type: ignore
+) -> None:
+    # how positions were calculated before SatrecArray
+    fr = solver.start_fr + (t / celestial.sgp4_solver.SECONDS_PER_DAY)
+
+    for sat_id in range(len(satellites_array)):
+        e, r, d = solver.sgp4_solvers[sat_id].sgp4(solver.start_jd, fr)
+
+        satellites_array[sat_id]["x"] = np.int32(r[0]) * 1000
+        satellites_array[sat_id]["y"] = np.int32(r[1]) * 1000
+        satellites_array[sat_id]["z"] = np.int32(r[2]) * 1000
+
+
+def xyz(satellites_array: np.ndarray) -> np.ndarray:  # type: ignore
+    return np.stack(
+        [satellites_array["x"], satellites_array["y"], satellites_array["z"]], axis=1
+    )
+
+
+def test_sgp4(planes: int, sats: int, altitude_km: float, inclination: float) -> None:
+    solver = celestial.sgp4_solver.SGP4Solver(planes, sats, altitude_km, inclination)
+
+    got = np.zeros(planes * sats, dtype=celestial.shell.SATELLITE_DTYPE)
+    want = np.zeros(planes * sats, dtype=celestial.shell.SATELLITE_DTYPE)
+
+    solver.init_sat_array(got)
+
+    per_satellite_positions(solver, 0, want)
+    assert np.array_equal(xyz(got), xyz(want))
+
+    times = range(0, 600, 10)
+
+    t1 = time.perf_counter()
+    solver.prefetch(times)
+    t2 = time.perf_counter()
+
+    print(f"Prefetch time for {len(times)} timesteps: {t2 - t1}")
+
+    # prefetched, and one that is not
+    for t in list(times) + [605]:
+        solver.set_time(t, got)
+        per_satellite_positions(solver, t, want)
+
+        assert np.array_equal(xyz(got), xyz(want)), t
+
+
+if __name__ == "__main__":
+    test_sgp4(3, 4, 550.0, 53.0)
+    test_sgp4(72, 22, 550.0, 53.0)
+    test_sgp4(36, 20, 1200.0, 87.9)
+
+    print("Test passed successfully!")
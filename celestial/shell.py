@@ -33,6 +33,10 @@ SECONDS_PER_DAY = 86_400
 MIN_COMMS_ALTITUDE_M = 80_000  # meters, height of thermosphere
 LINK_PROPAGATION_S_M = 3.336e-9  # s/m, about 1/c
 CROSSLINK_INTERPOLATION = 1
+# compute shortest paths between satellites with one Dijkstra search per
+# satellite over the sparse +GRID graph (in parallel, reusing the shortest path
+# trees of the previous step where possible) instead of Floyd-Warshall
+SPARSE_ROUTING = True
 
 ### DTYPES ###
 SATELLITE_DTYPE = np.dtype(
@@ -109,6 +113,294 @@ PATH_LINK_DTYPE = np.dtype(
 )
 
 
+@numba.njit  # type: ignore
+def _heap_push(
+    keys: np.ndarray,  # type: ignore
+    values: np.ndarray,  # type: ignore
+    size: int,
+    key: float,
+    value: int,
+) -> int:
+    """
+    Push value with key onto the binary min-heap in keys and values, which
+    holds size elements. Returns the new size.
+    """
+    i = size
+    keys[i] = key
+    values[i] = value
+
+    while i > 0:
+        parent = (i - 1) // 2
+        if keys[parent] <= keys[i]:
+            break
+
+        keys[parent], keys[i] = keys[i], keys[parent]
+        values[parent], values[i] = values[i], values[parent]
+        i = parent
+
+    return size + 1
+
+
+@numba.njit  # type: ignore
+def _heap_pop(
+    keys: np.ndarray,  # type: ignore
+    values: np.ndarray,  # type: ignore
+    size: int,
+) -> typing.Tuple[float, int, int]:
+    """
+    Pop the value with the smallest key from the binary min-heap in keys and
+    values, which holds size elements. Returns key, value, and the new size.
+    """
+    key = keys[0]
+    value = values[0]
+
+    size -= 1
+    keys[0] = keys[size]
+    values[0] = values[size]
+
+    i = 0
+    while True:
+        child = 2 * i + 1
+        if child >= size:
+            break
+
+        if child + 1 < size and keys[child + 1] < keys[child]:
+            child += 1
+
+        if keys[i] <= keys[child]:
+            break
+
+        keys[child], keys[i] = keys[i], keys[child]
+        values[child], values[i] = values[i], values[child]
+        i = child
+
+    return key, value, size
+
+
+@numba.njit  # type: ignore
+def _dijkstra(
+    source: int,
+    indptr: np.ndarray,  # type: ignore
+    indices: np.ndarray,  # type: ignore
+    weights: np.ndarray,  # type: ignore
+    dist: np.ndarray,  # type: ignore
+    next_hops: np.ndarray,  # type: ignore
+    prev_hops: np.ndarray,  # type: ignore
+    path_order: np.ndarray,  # type: ignore
+) -> None:
+    """
+    Calculate the shortest path tree of source in the graph given in
+    compressed sparse row format. Writes the distances to dist, and the next
+    hops, previous hops, and the order in which the nodes were reached to the
+    row of source.
+    """
+    n = dist.shape[0]
+
+    dist[:] = np.inf
+    next_hops[source, :] = -1
+    prev_hops[source, :] = -1
+    path_order[source, :] = -1
+
+    done = np.zeros(n, dtype=np.bool_)
+
+    # every link is relaxed at most once, so this is enough space for the
+    # heap, even with the stale entries we leave in it
+    keys = np.empty(indices.shape[0] + 1, dtype=np.float64)
+    values = np.empty(indices.shape[0] + 1, dtype=np.int32)
+
+    dist[source] = 0.0
+    next_hops[source, source] = np.int16(source)
+    prev_hops[source, source] = np.int16(source)
+    size = _heap_push(keys, values, 0, 0.0, source)
+
+    reached = 0
+    while size > 0:
+        d, u, size = _heap_pop(keys, values, size)
+
+        if done[u]:
+            continue
+
+        done[u] = True
+        path_order[source, reached] = np.int16(u)
+        reached += 1
+
+        if u != source:
+            p = prev_hops[source, u]
+            if p == source:
+                next_hops[source, u] = np.int16(u)
+            else:
+                next_hops[source, u] = next_hops[source, p]
+
+        for e in range(indptr[u], indptr[u + 1]):
+            v = indices[e]
+            new_d = d + weights[e]
+
+            if new_d < dist[v]:
+                dist[v] = new_d
+                prev_hops[source, v] = np.int16(u)
+                size = _heap_push(keys, values, size, new_d, v)
+
+
+@numba.njit  # type: ignore
+def _refresh_tree(
+    source: int,
+    indptr: np.ndarray,  # type: ignore
+    indices: np.ndarray,  # type: ignore
+    weights: np.ndarray,  # type: ignore
+    dist: np.ndarray,  # type: ignore
+    prev_hops: np.ndarray,  # type: ignore
+    path_order: np.ndarray,  # type: ignore
+) -> bool:
+    """
+    Update the distances along the existing shortest path tree of source
+    with the current link distances. Returns False if the tree is no longer
+    a shortest path tree, i.e., if any link offers a shorter path to a node.
+    """
+    n = dist.shape[0]
+
+    dist[:] = np.inf
+    dist[source] = 0.0
+
+    # parents are always reached before their children
+    for k in range(1, n):
+        v = path_order[source, k]
+        if v == -1:
+            break
+
+        p = prev_hops[source, v]
+        w = np.inf
+        for e in range(indptr[p], indptr[p + 1]):
+            if indices[e] == v:
+                w = weights[e]
+                break
+
+        if w == np.inf:
+            return False
+
+        dist[v] = dist[p] + w
+
+    for u in range(n):
+        if dist[u] == np.inf:
+            continue
+
+        for e in range(indptr[u], indptr[u + 1]):
+            if dist[u] + weights[e] < dist[indices[e]]:
+                return False
+
+    return True
+
+
+# the most cells of the satellite grid, larger cells are used if necessary
+MAX_SAT_GRID_CELLS = 1 << 15
+
+
+@numba.njit  # type: ignore
+def _build_sat_grid(
+    satellites_array: np.ndarray,  # type: ignore
+    total_sats: int,
+    min_cell_size: float,
+) -> typing.Tuple[
+    np.ndarray, float, np.ndarray, np.ndarray, np.ndarray  # type: ignore
+]:
+    """
+    Bucket the satellites into a uniform grid of cubes in ECEF coordinates
+    with an edge length of at least min_cell_size.
+
+    :return: The origin of the grid, the edge length of a cell, the number of
+        cells along each axis, and the satellites of each cell in compressed
+        sparse row format (satellites of cell c are
+        cell_sats[cell_start[c] : cell_start[c + 1]], ordered by ID).
+    """
+    origin = np.full(3, np.inf)
+    upper = np.full(3, -np.inf)
+
+    for i in range(total_sats):
+        origin[0] = min(origin[0], np.float64(satellites_array[i]["x"]))
+        origin[1] = min(origin[1], np.float64(satellites_array[i]["y"]))
+        origin[2] = min(origin[2], np.float64(satellites_array[i]["z"]))
+        upper[0] = max(upper[0], np.float64(satellites_array[i]["x"]))
+        upper[1] = max(upper[1], np.float64(satellites_array[i]["y"]))
+        upper[2] = max(upper[2], np.float64(satellites_array[i]["z"]))
+
+    extent = upper - origin
+
+    cell_size = min_cell_size
+    dims = np.empty(3, dtype=np.int64)
+
+    while True:
+        for a in range(3):
+            dims[a] = np.int64(extent[a] // cell_size) + 1
+
+        if dims[0] * dims[1] * dims[2] <= MAX_SAT_GRID_CELLS:
+            break
+
+        cell_size *= 2
+
+    cell_start = np.zeros(dims[0] * dims[1] * dims[2] + 1, dtype=np.int64)
+    sat_cells = np.empty(total_sats, dtype=np.int64)
+
+    for i in range(total_sats):
+        cx = np.int64((satellites_array[i]["x"] - origin[0]) // cell_size)
+        cy = np.int64((satellites_array[i]["y"] - origin[1]) // cell_size)
+        cz = np.int64((satellites_array[i]["z"] - origin[2]) // cell_size)
+
+        sat_cells[i] = (cx * dims[1] + cy) * dims[2] + cz
+        cell_start[sat_cells[i] + 1] += 1
+
+    for c in range(len(cell_start) - 1):
+        cell_start[c + 1] += cell_start[c]
+
+    cell_sats = np.empty(total_sats, dtype=np.int64)
+    fill = cell_start[:-1].copy()
+
+    for i in range(total_sats):
+        cell_sats[fill[sat_cells[i]]] = i
+        fill[sat_cells[i]] += 1
+
+    return origin, cell_size, dims, cell_start, cell_sats
+
+
+@numba.njit  # type: ignore
+def _sat_grid_candidates(
+    x: float,
+    y: float,
+    z: float,
+    origin: np.ndarray,  # type: ignore
+    cell_size: float,
+    dims: np.ndarray,  # type: ignore
+    cell_start: np.ndarray,  # type: ignore
+    cell_sats: np.ndarray,  # type: ignore
+    candidates: np.ndarray,  # type: ignore
+) -> int:
+    """
+    Collect the satellites in the cell of a point and all neighboring cells,
+    i.e., all satellites within cell_size of the point (and some more).
+
+    :return: The number of satellites written to candidates.
+    """
+    c = np.empty(3, dtype=np.int64)
+    c[0] = np.int64((x - origin[0]) // cell_size)
+    c[1] = np.int64((y - origin[1]) // cell_size)
+    c[2] = np.int64((z - origin[2]) // cell_size)
+
+    lo = np.empty(3, dtype=np.int64)
+    hi = np.empty(3, dtype=np.int64)
+    for a in range(3):
+        lo[a] = max(c[a] - 1, 0)
+        hi[a] = min(c[a] + 1, dims[a] - 1)
+
+    n = 0
+    for cx in range(lo[0], hi[0] + 1):
+        for cy in range(lo[1], hi[1] + 1):
+            for cz in range(lo[2], hi[2] + 1):
+                cell = (cx * dims[1] + cy) * dims[2] + cz
+                for i in range(cell_start[cell], cell_start[cell + 1]):
+                    candidates[n] = cell_sats[i]
+                    n += 1
+
+    return n
+
+
 class Shell:
     """
     A shell is a group of satellites of a constellation that share orbital
@@ -195,7 +487,29 @@ class Shell:
             (PATH_MATRIX_SIZE, PATH_MATRIX_SIZE), dtype=PATH_DTYPE
         )
 
-        self.link_diff: celestial.types.LinkDiff = {}
+        # shortest paths between satellites, kept between steps so that
+        # shortest path trees can be reused if the topology does not change
+        self.sat_dist_matrix = np.empty(
+            (self.total_sats, self.total_sats), dtype=np.float32
+        )
+        self.sat_next_hops = np.full(
+            (self.total_sats, self.total_sats), -1, dtype=np.int16
+        )
+        self.sat_prev_hops = np.full(
+            (self.total_sats, self.total_sats), -1, dtype=np.int16
+        )
+        # the order in which the nodes were added to the shortest path tree
+        # of each satellite, -1 terminated
+        self.sat_path_order = np.full(
+            (self.total_sats, self.total_sats), -1, dtype=np.int16
+        )
+        self.sat_link_active = np.zeros(LINK_ARRAY_SIZE, dtype=np.bool_)
+        self.sat_paths_valid = False
+
+        # the changed paths of the last step, link_diff is built from it on
+        # demand
+        self.path_diff = np.zeros(0, dtype=PATH_LINK_DTYPE)
+        self.link_diff: typing.Optional[celestial.types.LinkDiff] = {}
 
         self.nodes_diff: celestial.types.MachineDiff = {}
 
@@ -227,6 +541,11 @@ class Shell:
 
         self._init_ground_stations(ground_stations)
 
+        self.packed_machine_ids = np.array(
+            [celestial.types.MachineID_packed(m) for m in self.machine_ids],
+            dtype=np.uint32,
+        )
+
         self._init_plus_grid_links()
 
         self.max_isl_range = self._calculate_max_ISL_distance()
@@ -319,8 +638,6 @@ class Shell:
 
         self._update_paths()
 
-        self.link_diff = {}
-
         path_diff = np.zeros(
             (self.total_sats + self.total_gst) ** 2, dtype=PATH_LINK_DTYPE
         )
@@ -334,20 +651,23 @@ class Shell:
             path_diff=path_diff,
         )[0]
 
-        for link in path_diff[:total_link_diff]:
-            n1 = self._get_machine_id(link["node_1"])
+        self.path_diff = path_diff[:total_link_diff].copy()
+        self.link_diff = None
 
-            n2 = self._get_machine_id(link["node_2"])
+        self.curr_paths[self.path_diff["node_1"], self.path_diff["node_2"]] = (
+            self.path_diff["path"]
+        )
 
-            self.link_diff.setdefault(n1, {})[n2] = celestial.types.Link(
-                latency_us=link["path"]["delay_us"],
-                bandwidth_kbits=link["path"]["bandwidth_kbits"],
-                blocked=not link["path"]["active"],
-                next_hop=self._get_machine_id(link["path"]["next_hop"]),
-                prev_hop=self._get_machine_id(link["path"]["prev_hop"]),
-            )
+    def prefetch_positions(
+        self, times: typing.Sequence[celestial.types.timestamp_s]
+    ) -> None:
+        """
+        Calculate the satellite positions for several upcoming steps in one
+        batch, so that step only has to look them up.
 
-            self.curr_paths[link["node_1"]][link["node_2"]] = link["path"]
+        :param times: The times of the upcoming steps.
+        """
+        self.solver.prefetch(times)
 
     def _get_machine_id(self, node: int) -> celestial.types.MachineID_dtype:
         """
@@ -382,8 +702,47 @@ class Shell:
         :return: A dictionary of machine IDs to a dictionary of machine IDs to
             the link between them.
         """
+        if self.link_diff is not None:
+            return self.link_diff
+
+        self.link_diff = {}
+
+        for link in self.path_diff:
+            n1 = self._get_machine_id(link["node_1"])
+
+            n2 = self._get_machine_id(link["node_2"])
+
+            self.link_diff.setdefault(n1, {})[n2] = celestial.types.Link(
+                latency_us=link["path"]["delay_us"],
+                bandwidth_kbits=link["path"]["bandwidth_kbits"],
+                blocked=not link["path"]["active"],
+                next_hop=self._get_machine_id(link["path"]["next_hop"]),
+                prev_hop=self._get_machine_id(link["path"]["prev_hop"]),
+            )
+
         return self.link_diff
 
+    def get_link_diff_block(self) -> np.ndarray:  # type: ignore
+        """
+        Get all differences in links since the last timestep as a block of
+        link diffs, without creating a Python object per link.
+
+        :return: A structured array of celestial.types.LINK_DIFF_DTYPE.
+        """
+        d = self.path_diff
+
+        block = np.empty(len(d), dtype=celestial.types.LINK_DIFF_DTYPE)
+        block["source"] = self.packed_machine_ids[d["node_1"]]
+        block["target"] = self.packed_machine_ids[d["node_2"]]
+        block["latency_us"] = d["path"]["delay_us"]
+        block["bandwidth_kbits"] = d["path"]["bandwidth_kbits"]
+        block["blocked"] = ~d["path"]["active"]
+        # like _get_machine_id, -1 (no path) is the last node
+        block["next_hop"] = self.packed_machine_ids[d["path"]["next_hop"]]
+        block["prev_hop"] = self.packed_machine_ids[d["path"]["prev_hop"]]
+
+        return block
+
     def get_sat_positions(self) -> np.ndarray:  # type: ignore
         """
         Get the positions of all satellites at the current timestep.
@@ -717,11 +1076,40 @@ class Shell:
             link_array[isl_idx]["distance_m"] = np.uint32(d)
 
         gst_link_id = 0
+
+        if len(gst_array) == 0:
+            return (gst_link_id,)
+
+        # only satellites in the grid cells around a ground station can be in
+        # its range, as cells are at least as large as the largest range
+        max_range = 1
+        for gst in gst_array:
+            max_range = max(max_range, int(gst["max_stg_range"]))
+
+        origin, cell_size, dims, cell_start, cell_sats = _build_sat_grid(
+            satellites_array, total_sats, np.float64(max_range)
+        )
+
+        candidates = np.empty(total_sats, dtype=np.int64)
+
         MAX_INT32 = np.uint32(np.iinfo(np.uint32).max)
         for gst in gst_array:
             shortest_d = MAX_INT32
 
-            for sat_idx in range(total_sats):
+            total_candidates = _sat_grid_candidates(
+                np.float64(gst["x"]),
+                np.float64(gst["y"]),
+                np.float64(gst["z"]),
+                origin,
+                cell_size,
+                dims,
+                cell_start,
+                cell_sats,
+                candidates,
+            )
+
+            # in order of IDs, which decides between links of the same length
+            for sat_idx in np.sort(candidates[:total_candidates]):
                 # calculate distance
                 d = np.uint32(
                     math.sqrt(
@@ -768,10 +1156,39 @@ class Shell:
         Update the network topology of the constellation and re-calculate
         all paths between nodes. Just calls the numba-optimized code.
         """
+        if SPARSE_ROUTING:
+            active = self.link_array["active"][: self.total_isl_links]
+            topology_changed = not self.sat_paths_valid or not np.array_equal(
+                active, self.sat_link_active[: self.total_isl_links]
+            )
+            self.sat_link_active[: self.total_isl_links] = active
+
+            self._numba_sparse_shortest_paths(
+                sat_link_array=self.link_array,
+                total_isl_links=self.total_isl_links,
+                total_sats=self.total_sats,
+                topology_changed=topology_changed,
+                dist_matrix=self.sat_dist_matrix,
+                next_hops=self.sat_next_hops,
+                prev_hops=self.sat_prev_hops,
+                path_order=self.sat_path_order,
+            )
+            self.sat_paths_valid = True
+        else:
+            self._numba_floyd_warshall(
+                sat_link_array=self.link_array,
+                total_isl_links=self.total_isl_links,
+                total_sats=self.total_sats,
+                dist_matrix=self.sat_dist_matrix,
+                next_hops=self.sat_next_hops,
+                prev_hops=self.sat_prev_hops,
+            )
+
         self._numba_update_paths(
-            sat_link_array=self.link_array,
-            total_isl_links=self.total_isl_links,
             total_sats=self.total_sats,
+            dist_matrix=self.sat_dist_matrix,
+            next_hops=self.sat_next_hops,
+            prev_hops=self.sat_prev_hops,
             path_matrix=self.path_matrix,
             gst_array=self.gst_array,
             total_gst=self.total_gst,
@@ -781,24 +1198,86 @@ class Shell:
         )
 
     @staticmethod
-    @numba.njit  # type: ignore
-    def _numba_update_paths(
+    @numba.njit(parallel=True)  # type: ignore
+    def _numba_sparse_shortest_paths(
         sat_link_array: np.ndarray,  # type: ignore
         total_isl_links: int,
         total_sats: int,
-        path_matrix: np.ndarray,  # type: ignore
-        gst_array: np.ndarray,  # type: ignore
-        total_gst: int,
-        gst_links_array: np.ndarray,  # type: ignore
-        total_gst_links: int,
-        isl_bandwidth_kbits: int,
+        topology_changed: bool,
+        dist_matrix: np.ndarray,  # type: ignore
+        next_hops: np.ndarray,  # type: ignore
+        prev_hops: np.ndarray,  # type: ignore
+        path_order: np.ndarray,  # type: ignore
     ) -> None:
         """
-        Actual implementation of _update_paths optimized with numba.
+        Calculate the shortest paths between all satellites with one Dijkstra
+        search per satellite, in parallel. The +GRID graph has at most four
+        links per satellite, so this is much cheaper than Floyd-Warshall.
+
+        If no link was activated or deactivated since the last call, the
+        shortest path trees of the last call are checked first: only the
+        distances along the tree are updated, and the search is only repeated
+        if any link now offers a shorter path.
         """
-        dist_matrix = np.empty((total_sats, total_sats), dtype=np.float32)
-        next_hops = np.empty((total_sats, total_sats), dtype=np.int16)
+        # adjacency of the active links in compressed sparse row format
+        indptr = np.zeros(total_sats + 1, dtype=np.int32)
+
+        for link in sat_link_array[:total_isl_links]:
+            if not link["active"]:
+                continue
+
+            indptr[link["node_1"] + 1] += 1
+            indptr[link["node_2"] + 1] += 1
+
+        for i in range(total_sats):
+            indptr[i + 1] += indptr[i]
+
+        indices = np.empty(indptr[total_sats], dtype=np.int32)
+        weights = np.empty(indptr[total_sats], dtype=np.float64)
+        fill = indptr[:total_sats].copy()
+
+        for link in sat_link_array[:total_isl_links]:
+            if not link["active"]:
+                continue
 
+            n1 = link["node_1"]
+            n2 = link["node_2"]
+
+            indices[fill[n1]] = n2
+            weights[fill[n1]] = np.float64(link["distance_m"])
+            fill[n1] += 1
+
+            indices[fill[n2]] = n1
+            weights[fill[n2]] = np.float64(link["distance_m"])
+            fill[n2] += 1
+
+        for s in numba.prange(total_sats):
+            dist = np.empty(total_sats, dtype=np.float64)
+
+            if topology_changed or not _refresh_tree(
+                s, indptr, indices, weights, dist, prev_hops, path_order
+            ):
+                _dijkstra(
+                    s, indptr, indices, weights, dist, next_hops, prev_hops, path_order
+                )
+
+            for t in range(total_sats):
+                dist_matrix[s, t] = np.float32(dist[t])
+
+    @staticmethod
+    @numba.njit  # type: ignore
+    def _numba_floyd_warshall(
+        sat_link_array: np.ndarray,  # type: ignore
+        total_isl_links: int,
+        total_sats: int,
+        dist_matrix: np.ndarray,  # type: ignore
+        next_hops: np.ndarray,  # type: ignore
+        prev_hops: np.ndarray,  # type: ignore
+    ) -> None:
+        """
+        Calculate the shortest paths between all satellites with
+        Floyd-Warshall, optimized with numba.
+        """
         for i in range(total_sats):
             for j in range(total_sats):
                 dist_matrix[i, j] = np.inf
@@ -834,6 +1313,30 @@ class Shell:
                         next_hops[i, j] = next_hops[i, k]
                         next_hops[j, i] = next_hops[j, k]
 
+        # paths are symmetric, the previous hop on the path from i to j is the
+        # next hop on the path from j to i
+        for i in range(total_sats):
+            for j in range(total_sats):
+                prev_hops[i, j] = next_hops[j, i]
+
+    @staticmethod
+    @numba.njit  # type: ignore
+    def _numba_update_paths(
+        total_sats: int,
+        dist_matrix: np.ndarray,  # type: ignore
+        next_hops: np.ndarray,  # type: ignore
+        prev_hops: np.ndarray,  # type: ignore
+        path_matrix: np.ndarray,  # type: ignore
+        gst_array: np.ndarray,  # type: ignore
+        total_gst: int,
+        gst_links_array: np.ndarray,  # type: ignore
+        total_gst_links: int,
+        isl_bandwidth_kbits: int,
+    ) -> None:
+        """
+        Actual implementation of _update_paths optimized with numba. Fills
+        the path matrix from the shortest paths between satellites.
+        """
         for i in range(total_sats):
             for j in range(i + 1, total_sats):
                 # if i == j:
@@ -847,7 +1350,7 @@ class Shell:
                     next_hops[i, j]
                 )  # will be -1 if inactive
                 path_matrix[i, j]["prev_hop"] = np.int16(
-                    next_hops[j, i]
+                    prev_hops[i, j]
                 )  # will be -1 if inactive
 
                 d = np.uint32(dist_matrix[i, j] * (LINK_PROPAGATION_S_M * 1e6))
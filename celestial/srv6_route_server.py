@@ -17,19 +17,23 @@
 
 """SRv6路由可视化服务器，接收路由管理器发送的路由信息并转发给动画系统"""
 
+import collections
 import threading
 import logging
 import json
 import time
 import ipaddress
 from typing import Dict, List, Optional, Any
-from http.server import HTTPServer, BaseHTTPRequestHandler
+from http.server import ThreadingHTTPServer, BaseHTTPRequestHandler
 from multiprocessing.connection import Connection as MultiprocessingConnection
 
 # 配置日志
 logging.basicConfig(level=logging.INFO, format='%(asctime)s - %(name)s - %(levelname)s - %(message)s')
 logger = logging.getLogger("SRv6RouteServer")
 
+# 每秒最多发送给动画进程的路由消息数
+MAX_ROUTE_MESSAGES_PER_SECOND = 20
+
 class SRv6RouteData:
     """SRv6路由数据结构"""
     def __init__(self, data: Dict[str, Any]):
@@ -59,6 +63,26 @@ class SRv6RouteData:
             return []
         return [self._parse_ipv6_to_node_info(segment) for segment in self.segments]
     
+    def key(self) -> str:
+        """路由的键，同一个键只保留最新的路由"""
+        return f"{self.source_ip}->{self.destination_ip}"
+
+    def to_message(self) -> Dict[str, Any]:
+        """构建发送给动画进程的路由消息"""
+        source_shell, source_id = self.get_source_node_info()
+        target_shell, target_id = self.get_destination_node_info()
+
+        return {
+            "type": "srv6_route",
+            "source": {"shell": source_shell, "id": source_id},
+            "target": {"shell": target_shell, "id": target_id},
+            "segments": [
+                {"shell": shell, "id": node_id}
+                for shell, node_id in self.get_segment_node_infos()
+            ],
+            "timestamp": self.timestamp,
+        }
+
     def _parse_ipv6_to_node_info(self, ipv6_str: str) -> tuple:
         """将IPv6地址解析为节点信息(shell, id)"""
         try:
@@ -89,138 +113,174 @@ class SRv6RouteData:
             logger.error(f"解析IPv6地址出错: {e}")
             return 0, 0
 
+class RouteCoalescer:
+    """
+    合并待发送的路由：每个source->destination键只保留最新的路由，由一个发送
+    线程按限定速率发给动画进程。接收路由的请求不会被发送阻塞，待发送的消息
+    数也不会超过路由键的个数。
+    """
+
+    def __init__(self, conn, rate: float = MAX_ROUTE_MESSAGES_PER_SECOND):
+        self.conn = conn
+        self.interval = 1.0 / rate
+
+        # 键 -> 最新的路由消息，按键第一次进入队列的顺序发送，
+        # 频繁更新的键不会饿死其他键
+        self.pending: "collections.OrderedDict[str, Dict[str, Any]]" = (
+            collections.OrderedDict()
+        )
+        self.cond = threading.Condition()
+        self.running = True
+
+        self.received = 0
+        self.sent = 0
+
+        self.thread = threading.Thread(target=self._run, daemon=True)
+        self.thread.start()
+
+    def put(self, key: str, msg: Dict[str, Any]) -> None:
+        """加入一条路由，替换同一个键还未发送的路由"""
+        with self.cond:
+            self.pending[key] = msg
+            self.received += 1
+            self.cond.notify()
+
+    def stats(self) -> Dict[str, int]:
+        with self.cond:
+            return {
+                "received": self.received,
+                "sent": self.sent,
+                "pending": len(self.pending),
+            }
+
+    def stop(self) -> None:
+        with self.cond:
+            self.running = False
+            self.cond.notify()
+        self.thread.join()
+
+    def _run(self) -> None:
+        while True:
+            with self.cond:
+                while self.running and not self.pending:
+                    self.cond.wait()
+
+                if not self.running:
+                    return
+
+                _, msg = self.pending.popitem(last=False)
+
+            try:
+                self.conn.send(msg)
+            except Exception as e:
+                logger.error(f"发送路由数据到动画进程失败: {e}")
+
+            with self.cond:
+                self.sent += 1
+
+            # 限制发送速率，给动画进程处理的时间
+            time.sleep(self.interval)
+
+
 class SRv6RouteHandler(BaseHTTPRequestHandler):
     """处理SRv6路由请求的HTTP处理器"""
     
-    # 类变量，存储最近的路由数据
+    # 类变量，存储最近的路由数据，处理器在多个线程中运行
     recent_routes: Dict[str, SRv6RouteData] = {}
-    
-    def get_animation_conn(self):
-        """获取动画连接，直接从SRv6RouteServer获取"""
-        # 直接从服务器类变量获取，简化连接对象管理
-        if hasattr(SRv6RouteServer, 'animation_conn_instance') and SRv6RouteServer.animation_conn_instance is not None:
-            # 确保返回的是visualized_celestial.py中创建的parent_conn
-            return SRv6RouteServer.animation_conn_instance
-        # 没有可用连接则返回None
-        logger.warning("没有可用的animation_conn连接")
-        return None
-    
+    recent_routes_lock = threading.Lock()
+
+    def _respond(self, code: int, body: Dict[str, Any]) -> None:
+        self.send_response(code)
+        self.send_header("Content-type", "application/json")
+        self.end_headers()
+        self.wfile.write(json.dumps(body).encode())
+
+    def _not_found(self) -> None:
+        self.send_response(404)
+        self.send_header("Content-type", "text/plain")
+        self.end_headers()
+        self.wfile.write(b"Not Found")
+
+    def _accept(self, route_data: Dict[str, Any]) -> None:
+        """存储一条路由并交给合并队列发送"""
+        srv6_route = SRv6RouteData(route_data)
+        route_key = srv6_route.key()
+
+        with self.recent_routes_lock:
+            self.recent_routes[route_key] = srv6_route
+
+        coalescer = SRv6RouteServer.coalescer_instance
+        if coalescer is None:
+            return
+
+        coalescer.put(route_key, srv6_route.to_message())
+
     def do_GET(self):
         """处理GET请求"""
         if self.path == "/api/status":
-            self.send_response(200)
-            self.send_header("Content-type", "application/json")
-            self.end_headers()
-            status = {
+            with self.recent_routes_lock:
+                routes_count = len(self.recent_routes)
+
+            status: Dict[str, Any] = {
                 "status": "running",
-                "routes_count": len(self.recent_routes),
+                "routes_count": routes_count,
                 "timestamp": time.time()
             }
-            self.wfile.write(json.dumps(status).encode())
+
+            coalescer = SRv6RouteServer.coalescer_instance
+            if coalescer is not None:
+                status["queue"] = coalescer.stats()
+
+            self._respond(200, status)
         else:
-            self.send_response(404)
-            self.send_header("Content-type", "text/plain")
-            self.end_headers()
-            self.wfile.write(b"Not Found")
-    
+            self._not_found()
+
     def do_POST(self):
-        """处理POST请求，接收路由信息"""
-        if self.path == "/api/route":
-            content_length = int(self.headers.get('Content-Length', 0))
-            post_data = self.rfile.read(content_length)
-            
-            try:
-                route_data = json.loads(post_data.decode('utf-8'))
-                # logger.info(f"接收到路由数据: {route_data['source']} -> {route_data['destination']}")
-                
-                # 解析路由数据
-                srv6_route = SRv6RouteData(route_data)
-                
-                # 存储路由数据
-                route_key = f"{srv6_route.source_ip}->{srv6_route.destination_ip}"
-                self.recent_routes[route_key] = srv6_route
-                
-                # 获取动画连接，使用新的get_animation_conn方法
-                animation_conn = self.get_animation_conn()
-                
-                # 如果有动画连接，发送路由数据
-                if animation_conn:
-                    try:
-                        # 获取源节点和目标节点信息
-                        source_shell, source_id = srv6_route.get_source_node_info()
-                        target_shell, target_id = srv6_route.get_destination_node_info()
-                        
-                        # 获取中间节点信息
-                        segment_nodes = srv6_route.get_segment_node_infos()
-                        
-                        # 构建路由消息
-                        route_msg = {
-                            "type": "srv6_route",
-                            "source": {
-                                "shell": source_shell,
-                                "id": source_id
-                            },
-                            "target": {
-                                "shell": target_shell,
-                                "id": target_id
-                            },
-                            "segments": [
-                                {"shell": shell, "id": node_id} 
-                                for shell, node_id in segment_nodes
-                            ],
-                            "timestamp": srv6_route.timestamp
-                        }
-                        
-                        # 发送到动画进程前记录详细信息
-                        # logger.info(f"准备发送路由数据到动画进程，详细信息: {json.dumps(route_msg)}")
-                        try:
-                            
-                            # 直接使用获取到的连接对象发送消息
-                            animation_conn.send(route_msg)
-                            
-                            # logger.info(f"已成功发送路由数据到动画进程: {source_shell}/{source_id} -> {target_shell}/{target_id}")
-                            # 发送后等待一小段时间，确保消息被处理
-                            time.sleep(0.1)
-                        except Exception as e:
-                            logger.error(f"发送路由数据到动画进程失败: {e}")
-                            import traceback
-                            logger.error(traceback.format_exc())
-                    except Exception as e:
-                        logger.error(f"发送路由数据到动画进程时出错: {e}")
-                else:
-                    logger.warning("没有动画连接，无法发送路由数据到动画进程")
-                
-                # 返回成功响应
-                self.send_response(200)
-                self.send_header("Content-type", "application/json")
-                self.end_headers()
-                response = {"status": "success", "message": "Route data received"}
-                self.wfile.write(json.dumps(response).encode())
-            except json.JSONDecodeError as e:
-                logger.error(f"解析JSON数据出错: {e}")
-                self.send_response(400)
-                self.send_header("Content-type", "application/json")
-                self.end_headers()
-                error = {"status": "error", "message": "Invalid JSON data"}
-                self.wfile.write(json.dumps(error).encode())
-            except Exception as e:
-                logger.error(f"处理路由数据时出错: {e}")
-                self.send_response(500)
-                self.send_header("Content-type", "application/json")
-                self.end_headers()
-                error = {"status": "error", "message": str(e)}
-                self.wfile.write(json.dumps(error).encode())
-        else:
-            self.send_response(404)
-            self.send_header("Content-type", "text/plain")
-            self.end_headers()
-            self.wfile.write(b"Not Found")
+        """
+        处理POST请求，接收路由信息：/api/route 接收一条路由，/api/routes
+        接收一组路由（列表，或 {"routes": [...]}）
+        """
+        if self.path not in ("/api/route", "/api/routes"):
+            self._not_found()
+            return
+
+        content_length = int(self.headers.get('Content-Length', 0))
+        post_data = self.rfile.read(content_length)
+
+        try:
+            data = json.loads(post_data.decode('utf-8'))
+
+            if self.path == "/api/route":
+                routes = [data]
+            elif isinstance(data, list):
+                routes = data
+            else:
+                routes = data.get("routes", [])
+
+            for route_data in routes:
+                self._accept(route_data)
+
+            # 返回成功响应
+            response = {
+                "status": "success",
+                "message": "Route data received",
+                "accepted": len(routes)
+            }
+            self._respond(200, response)
+        except json.JSONDecodeError as e:
+            logger.error(f"解析JSON数据出错: {e}")
+            self._respond(400, {"status": "error", "message": "Invalid JSON data"})
+        except Exception as e:
+            logger.error(f"处理路由数据时出错: {e}")
+            self._respond(500, {"status": "error", "message": str(e)})
 
 class SRv6RouteServer:
     """SRv6路由服务器，接收路由管理器发送的路由信息"""
     
     # 添加类变量存储animation_conn，确保所有处理器实例都能访问
     animation_conn_instance = None
+    # 向animation_conn发送路由的合并队列
+    coalescer_instance: Optional[RouteCoalescer] = None
     
     def __init__(self, host="0.0.0.0", port=8080, animation_conn=None):
         """初始化服务器
@@ -281,7 +341,16 @@ class SRv6RouteServer:
             return
         
         try:
-            self.server = HTTPServer((self.host, self.port), SRv6RouteHandler)
+            if SRv6RouteServer.animation_conn_instance is not None:
+                SRv6RouteServer.coalescer_instance = RouteCoalescer(
+                    SRv6RouteServer.animation_conn_instance
+                )
+            else:
+                logger.warning("没有可用的animation_conn连接")
+
+            # 每个请求一个线程，路由管理器的请求不会互相阻塞
+            self.server = ThreadingHTTPServer((self.host, self.port), SRv6RouteHandler)
+            self.server.daemon_threads = True
             self.server_thread = threading.Thread(target=self.server.serve_forever)
             self.server_thread.daemon = True
             self.server_thread.start()
@@ -299,6 +368,10 @@ class SRv6RouteServer:
         try:
             # 清除animation_conn_instance引用
             SRv6RouteServer.animation_conn_instance = None
+
+            if SRv6RouteServer.coalescer_instance is not None:
+                SRv6RouteServer.coalescer_instance.stop()
+                SRv6RouteServer.coalescer_instance = None
             
             # 关闭HTTP服务器
             self.server.shutdown()
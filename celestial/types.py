@@ -80,6 +80,38 @@ def MachineID_name(machine_id: MachineID_dtype) -> str:
     return machine_id[2]
 
 
+def MachineID_packed(machine_id: MachineID_dtype) -> int:
+    """
+    Encode a machine ID as a single integer group << 24 | id, as used in
+    diff blocks and PackedNetworkDiffs. The name is lost.
+
+    :param machine_id: The machine ID.
+    :return: The packed machine ID.
+    """
+    return (int(machine_id[0]) << 24) | int(machine_id[1])
+
+
+def MachineID_unpacked(packed: int) -> typing.Tuple[int, int]:
+    """
+    Decode the group and ID of a packed machine ID (see MachineID_packed).
+
+    :param packed: The packed machine ID.
+    :return: The group and ID of the machine.
+    """
+    return int(packed) >> 24, int(packed) & 0xFFFFFF
+
+
+def MachineID_from_packed(packed: int) -> MachineID_dtype:
+    """
+    Restore a machine ID from its packed form.
+
+    :param packed: The packed machine ID.
+    :return: The machine ID, without a name.
+    """
+    group, id = MachineID_unpacked(packed)
+    return MachineID(group=group, id=id)
+
+
 Link_dtype = typing.Tuple[
     np.uint32, np.uint32, np.bool_, MachineID_dtype, MachineID_dtype
 ]
@@ -159,6 +191,29 @@ def Link_prev_hop(link: Link_dtype) -> MachineID_dtype:
     return link[4]
 
 
+# a block of link diffs as a numpy structured array, machine IDs are packed
+# (see MachineID_packed)
+LINK_DIFF_DTYPE = np.dtype(
+    [
+        ("source", "<u4"),
+        ("target", "<u4"),
+        ("latency_us", "<u4"),
+        ("bandwidth_kbits", "<u4"),
+        ("blocked", "?"),
+        ("next_hop", "<u4"),
+        ("prev_hop", "<u4"),
+    ]
+)
+
+# a block of machine diffs as a numpy structured array, machine IDs are
+# packed and the state is a VMState value
+MACHINE_DIFF_DTYPE = np.dtype(
+    [
+        ("machine", "<u4"),
+        ("state", "u1"),
+    ]
+)
+
 MachineState = typing.Dict[
     MachineID_dtype,
     VMState,
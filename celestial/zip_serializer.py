@@ -23,17 +23,28 @@ import shutil
 import subprocess
 import struct
 import typing
+import zipfile
+
+import numpy as np
 
 import celestial.types
 import celestial.config
 
+_FORMAT_VERSION = 2
+
+_VERSION_FILE = "v"
 _CONFIG_FILE = "c"
 _INIT_FILE = "i"
+# all link and machine diff blocks, one after the other, stored uncompressed
+_DIFF_LINK_BLOCKS_FILE = "L"
+_DIFF_MACHINE_BLOCKS_FILE = "M"
+# where the blocks of each timestep are
+_INDEX_FILE = "x"
+
+# version 1 had one compressed file of diffs per timestep
 _DIFF_LINK_FILE_PREFIX = "l"
 _DIFF_MACHINE_FILE_PREFIX = "m"
 
-_MAX_WRITERS = 100
-
 
 def _config_to_bytes(config: celestial.config.Config) -> bytes:
     """
@@ -125,141 +136,157 @@ def _init_from_str(
         raise ValueError(f"Invalid init string: {s}: {e}")
 
 
-# struct format strings
-# https://docs.python.org/3/library/struct.html
-#  we always force little-endian byte order
-# diff_link
-# (source_machine_id_group:uint8/B,source_machine_id_id:uint16/H,target_machine_id_group:uint8/B,target_machine_id_id:uint16/H,link_latency:uint32/I,link_bandwidth:uint32/I,link_blocked:bool/?,link_next_hop_machine_id_group:uint8/B,link_next_hop_machine_id_id:uint16/H,link_prev_hop_machine_id_group:uint8/B,link_prev_hop_machine_id_id:uint16/H)
-_DIFF_LINK_FMT = "<BHBHII?BHBH"
-# diff_machine
-# (machine_id_group:uint8/B,machine_id_id:uint16/H,vm_state:uint8/B)
-_DIFF_MACHINE_FMT = "<BHB"
+# index entry of a timestep, offsets and counts are in diffs, not in bytes
+_INDEX_DTYPE = np.dtype(
+    [
+        ("t", "<i8"),
+        ("link_offset", "<u8"),
+        ("link_count", "<u8"),
+        ("machine_offset", "<u8"),
+        ("machine_count", "<u8"),
+    ]
+)
+
+# version 1 diffs, these mirror the (packed, little-endian) struct format
+# strings of version 1
+# diff_link "<BHBHII?BHBH"
+_V1_DIFF_LINK_DTYPE = np.dtype(
+    [
+        ("source_group", "u1"),
+        ("source_id", "<u2"),
+        ("target_group", "u1"),
+        ("target_id", "<u2"),
+        ("latency_us", "<u4"),
+        ("bandwidth_kbits", "<u4"),
+        ("blocked", "?"),
+        ("next_hop_group", "u1"),
+        ("next_hop_id", "<u2"),
+        ("prev_hop_group", "u1"),
+        ("prev_hop_id", "<u2"),
+    ]
+)
+# diff_machine "<BHB"
+_V1_DIFF_MACHINE_DTYPE = np.dtype(
+    [
+        ("group", "u1"),
+        ("id", "<u2"),
+        ("state", "u1"),
+    ]
+)
 
 
-def _diff_link_to_bytes(
-    source: celestial.types.MachineID_dtype,
-    target: celestial.types.MachineID_dtype,
-    link: celestial.types.Link_dtype,
-) -> bytes:
-    """
-    Serialize a link diff to bytes using the struct format string.
+def _pack(group: np.ndarray, id: np.ndarray) -> np.ndarray:  # type: ignore
+    return (group.astype(np.uint32) << 24) | id.astype(np.uint32)  # type: ignore
 
-    :param source: The source machine ID of the link.
-    :param target: The target machine ID of the link.
-    :param link: The link to serialize.
-    :returns: The serialized link as bytes.
-    """
-    return struct.pack(
-        _DIFF_LINK_FMT,
-        celestial.types.MachineID_group(source),
-        celestial.types.MachineID_id(source),
-        celestial.types.MachineID_group(target),
-        celestial.types.MachineID_id(target),
-        celestial.types.Link_latency_us(link),
-        celestial.types.Link_bandwidth_kbits(link),
-        celestial.types.Link_blocked(link),
-        celestial.types.MachineID_group(celestial.types.Link_next_hop(link)),
-        celestial.types.MachineID_id(celestial.types.Link_next_hop(link)),
-        celestial.types.MachineID_group(celestial.types.Link_prev_hop(link)),
-        celestial.types.MachineID_id(celestial.types.Link_prev_hop(link)),
-    )
-
-
-def _diff_link_from_bytes(
-    b: bytes,
-) -> typing.Iterator[
-    typing.Tuple[
-        celestial.types.MachineID_dtype,
-        celestial.types.MachineID_dtype,
-        celestial.types.Link_dtype,
-    ]
-]:
+
+def _link_block_from_v1(b: bytes) -> np.ndarray:  # type: ignore
     """
-    Restore link diffs from bytes using the struct format string.
+    Convert version 1 link diffs of a timestep to a link diff block.
 
     :param b: Bytes of all serialized links in a timestep.
-    :returns: The restored links as an iterator.
+    :returns: The link diff block.
     """
+    v1 = np.frombuffer(b, dtype=_V1_DIFF_LINK_DTYPE)
 
-    # conveniently, we don't have to type-cast everything
-    # let's hope our types never change!
-    return (
-        (
-            (source_machine_id_group, source_machine_id_id, ""),
-            (target_machine_id_group, target_machine_id_id, ""),
-            (
-                link_latency_us,
-                link_bandwidth_kbits,
-                link_blocked,
-                (link_next_hop_machine_id_group, link_next_hop_machine_id_id, ""),
-                (link_prev_hop_machine_id_group, link_prev_hop_machine_id_id, ""),
-            ),
-        )
-        for (
-            source_machine_id_group,
-            source_machine_id_id,
-            target_machine_id_group,
-            target_machine_id_id,
-            link_latency_us,
-            link_bandwidth_kbits,
-            link_blocked,
-            link_next_hop_machine_id_group,
-            link_next_hop_machine_id_id,
-            link_prev_hop_machine_id_group,
-            link_prev_hop_machine_id_id,
-        ) in struct.iter_unpack(_DIFF_LINK_FMT, b)
-    )
-
-
-def _diff_machine_to_bytes(
-    machine: celestial.types.MachineID_dtype, s: celestial.types.VMState
-) -> bytes:
-    """
-    Serialize a machine diff to bytes using the struct format string.
+    block = np.empty(len(v1), dtype=celestial.types.LINK_DIFF_DTYPE)
+    block["source"] = _pack(v1["source_group"], v1["source_id"])
+    block["target"] = _pack(v1["target_group"], v1["target_id"])
+    block["latency_us"] = v1["latency_us"]
+    block["bandwidth_kbits"] = v1["bandwidth_kbits"]
+    block["blocked"] = v1["blocked"]
+    block["next_hop"] = _pack(v1["next_hop_group"], v1["next_hop_id"])
+    block["prev_hop"] = _pack(v1["prev_hop_group"], v1["prev_hop_id"])
 
-    :param machine: The machine ID of the machine to serialize.
-    :param s: The VM state of the machine to serialize.
-    :returns: The serialized machine diff as bytes.
-    """
-    return struct.pack(
-        _DIFF_MACHINE_FMT,
-        celestial.types.MachineID_group(machine),
-        celestial.types.MachineID_id(machine),
-        s.value,
-    )
-
-
-def _diff_machine_from_bytes(
-    b: bytes,
-) -> typing.Iterator[
-    typing.Tuple[celestial.types.MachineID_dtype, celestial.types.VMState]
-]:
+    return block
+
+
+def _machine_block_from_v1(b: bytes) -> np.ndarray:  # type: ignore
     """
-    Restore machine diffs from bytes using the struct format string.
+    Convert version 1 machine diffs of a timestep to a machine diff block.
 
     :param b: Bytes of all serialized machines in a timestep.
-    :returns: The restored machines as an iterator.
+    :returns: The machine diff block.
     """
+    v1 = np.frombuffer(b, dtype=_V1_DIFF_MACHINE_DTYPE)
 
-    return (
-        (
-            celestial.types.MachineID(machine_id_group, machine_id_id),
-            celestial.types.VMState(vm_state),
-        )
-        for machine_id_group, machine_id_id, vm_state in struct.iter_unpack(
-            _DIFF_MACHINE_FMT, b
-        )
-    )
+    block = np.empty(len(v1), dtype=celestial.types.MACHINE_DIFF_DTYPE)
+    block["machine"] = _pack(v1["group"], v1["id"])
+    block["state"] = v1["state"]
+
+    return block
+
+
+class BlockWriter:
+    """
+    Appends the diff blocks of one kind to a file. Diffs are collected until
+    the timestep changes, so timesteps must come in order.
+    """
+
+    def __init__(self, path: str, dtype: np.dtype):  # type: ignore
+        self.f = open(path, "wb")
+        self.dtype = dtype
+        self.written = 0
+
+        self.t: typing.Optional[celestial.types.timestamp_s] = None
+        self.rows: typing.List[typing.Tuple[typing.Any, ...]] = []
+        self.blocks: typing.List[np.ndarray] = []  # type: ignore
+
+        # timestep -> (offset, count)
+        self.index: typing.Dict[
+            celestial.types.timestamp_s, typing.Tuple[int, int]
+        ] = {}
+
+    def _switch(self, t: celestial.types.timestamp_s) -> None:
+        if t == self.t:
+            return
+
+        self.flush()
+
+        if t in self.index:
+            raise ValueError(f"diffs for timestep {t} were already written")
+
+        self.t = t
+
+    def add_row(
+        self, t: celestial.types.timestamp_s, row: typing.Tuple[typing.Any, ...]
+    ) -> None:
+        self._switch(t)
+        self.rows.append(row)
+
+    def add_block(
+        self, t: celestial.types.timestamp_s, block: np.ndarray  # type: ignore
+    ) -> None:
+        self._switch(t)
+        self.blocks.append(block.astype(self.dtype, copy=False))
+
+    def flush(self) -> None:
+        if self.t is None:
+            return
+
+        block = np.concatenate([np.array(self.rows, dtype=self.dtype), *self.blocks])
+
+        self.f.write(block.tobytes())
+        self.index[self.t] = (self.written, len(block))
+        self.written += len(block)
+
+        self.t = None
+        self.rows = []
+        self.blocks = []
+
+    def close(self) -> None:
+        self.flush()
+        self.f.close()
 
 
 class ZipSerializer:
     """
     The ZipSerializer implements the Serializer interface and serializes
     Celestial initialization and updates to a custom .zip format file.
-    We use mostly bytes for serialization, except for the initialization
-    file, which is serialized to CSV.
-    This combination allows us efficient compression and fast serialization
-    for updates without being too hairy to implement for initialization.
+    Updates are stored as numpy structured arrays, one block per timestep,
+    with an index of where the blocks of each timestep are. The blocks are
+    stored uncompressed, so that the ZipDeserializer can map them into
+    memory and go straight to any timestep. The initialization file is
+    serialized to CSV.
 
     Note that the resulting .zip file is not meant for manual inspection
     but should be used with the ZipDeserializer to restore the initialization
@@ -310,26 +337,14 @@ class ZipSerializer:
         with open(os.path.join(self.write_dir, _CONFIG_FILE), "wb") as f:
             f.write(_config_to_bytes(config))
 
-        self.writers: typing.Dict[str, typing.IO[bytes]] = {}
-
-    def _get_writer(self, n: str) -> typing.IO[bytes]:
-        """
-        Get the writer for a file.
-
-        :param n: The filename of the file to get the writer for.
-        :returns: The writer.
-        """
-        if n not in self.writers:
-            # before we open a new writer, make sure we don't have too many
-            if len(self.writers) >= _MAX_WRITERS:
-                # close all the writers
-                # just to make sure we don't get over the file handler limit
-                for w in self.writers.values():
-                    w.close()
-                self.writers = {}
-
-            self.writers[n] = open(os.path.join(self.write_dir, n), "wb")
-        return self.writers[n]
+        self.links = BlockWriter(
+            os.path.join(self.write_dir, _DIFF_LINK_BLOCKS_FILE),
+            celestial.types.LINK_DIFF_DTYPE,
+        )
+        self.machines = BlockWriter(
+            os.path.join(self.write_dir, _DIFF_MACHINE_BLOCKS_FILE),
+            celestial.types.MACHINE_DIFF_DTYPE,
+        )
 
     def init_machine(
         self,
@@ -354,18 +369,39 @@ class ZipSerializer:
         link: celestial.types.Link_dtype,
     ) -> None:
         """
-        Write a link diff to the link diff file.
+        Add a link diff to the block of its timestep.
 
         :param t: The timestamp of the link diff.
         :param source: The source machine ID of the link.
         :param target: The target machine ID of the link.
         :param link: The link to serialize.
         """
-
-        self._get_writer(f"{_DIFF_LINK_FILE_PREFIX}{t}").write(
-            _diff_link_to_bytes(source, target, link)
+        self.links.add_row(
+            t,
+            (
+                celestial.types.MachineID_packed(source),
+                celestial.types.MachineID_packed(target),
+                celestial.types.Link_latency_us(link),
+                celestial.types.Link_bandwidth_kbits(link),
+                celestial.types.Link_blocked(link),
+                celestial.types.MachineID_packed(celestial.types.Link_next_hop(link)),
+                celestial.types.MachineID_packed(celestial.types.Link_prev_hop(link)),
+            ),
         )
 
+    def diff_link_block(
+        self,
+        t: celestial.types.timestamp_s,
+        block: np.ndarray,  # type: ignore
+    ) -> None:
+        """
+        Add a block of link diffs to the block of its timestep.
+
+        :param t: The timestamp of the link diffs.
+        :param block: The link diffs as celestial.types.LINK_DIFF_DTYPE.
+        """
+        self.links.add_block(t, block)
+
     def diff_machine(
         self,
         t: celestial.types.timestamp_s,
@@ -373,29 +409,67 @@ class ZipSerializer:
         s: celestial.types.VMState,
     ) -> None:
         """
-        Write a machine diff to the machine diff file.
+        Add a machine diff to the block of its timestep.
 
         :param t: The timestamp of the machine diff.
         :param machine: The machine ID of the machine to serialize.
         :param s: The VM state of the machine to serialize.
         """
-        self._get_writer(f"{_DIFF_MACHINE_FILE_PREFIX}{t}").write(
-            _diff_machine_to_bytes(machine, s)
-        )
+        self.machines.add_row(t, (celestial.types.MachineID_packed(machine), s.value))
+
+    def diff_machine_block(
+        self,
+        t: celestial.types.timestamp_s,
+        block: np.ndarray,  # type: ignore
+    ) -> None:
+        """
+        Add a block of machine diffs to the block of its timestep.
+
+        :param t: The timestamp of the machine diffs.
+        :param block: The machine diffs as celestial.types.MACHINE_DIFF_DTYPE.
+        """
+        self.machines.add_block(t, block)
 
     def persist(self) -> None:
         """
         Persist the serialized initialization and updates to a .zip file.
-
-        :raises FileExistsError: If the output file already exists.
         """
-        # close all writers
-        for w in self.writers.values():
-            w.close()
+        self.links.close()
+        self.machines.close()
+
+        timesteps = sorted(self.links.index.keys() | self.machines.index.keys())
 
-        # zip the temporary directory
-        # filename = os.path.join(self.tmp_dir, self.filename)
-        shutil.make_archive(self.filename, "zip", self.write_dir)
+        index = np.zeros(len(timesteps), dtype=_INDEX_DTYPE)
+
+        for i, t in enumerate(timesteps):
+            index[i]["t"] = t
+            index[i]["link_offset"], index[i]["link_count"] = self.links.index.get(
+                t, (0, 0)
+            )
+            (
+                index[i]["machine_offset"],
+                index[i]["machine_count"],
+            ) = self.machines.index.get(t, (0, 0))
+
+        with open(os.path.join(self.write_dir, _INDEX_FILE), "wb") as f:
+            f.write(index.tobytes())
+
+        with open(os.path.join(self.write_dir, _VERSION_FILE), "w") as f:
+            f.write(str(_FORMAT_VERSION))
+
+        with zipfile.ZipFile(f"{self.filename}.zip", "w") as z:
+            for n in (_VERSION_FILE, _CONFIG_FILE, _INIT_FILE, _INDEX_FILE):
+                p = os.path.join(self.write_dir, n)
+                if os.path.exists(p):
+                    z.write(p, n, compress_type=zipfile.ZIP_DEFLATED)
+
+            # the blocks must stay uncompressed to be mapped into memory
+            for n in (_DIFF_LINK_BLOCKS_FILE, _DIFF_MACHINE_BLOCKS_FILE):
+                z.write(
+                    os.path.join(self.write_dir, n),
+                    n,
+                    compress_type=zipfile.ZIP_STORED,
+                )
 
         # remove the temporary directory
         shutil.rmtree(self.tmp_dir)
@@ -405,7 +479,9 @@ class ZipDeserializer:
     """
     The ZipDeserializer implements the Deserializer interface and deserializes
     Celestial initialization and updates from a custom .zip format file created
-    by the ZipSerializer.
+    by the ZipSerializer. The diff blocks are mapped into memory directly from
+    the .zip file, nothing is unpacked. Files of version 1 (one compressed
+    file per timestep) can still be read.
     """
 
     def __init__(self, filename: str):
@@ -414,30 +490,66 @@ class ZipDeserializer:
 
         :param filename: The filename of the .zip file to deserialize from.
 
-        :raises FileExistsError: If `mktemp` fails and the temporary directory
-            `./tmp` already exists.
+        :raises ValueError: If the .zip file has an unknown version.
         """
         self.filename = filename
+        self.zip = zipfile.ZipFile(self.filename)
 
-        # create a temporary directory
-        # check if the `mktemp` command is available
-        self.tmp_dir = "./.tmp"
-        if subprocess.run(["which", "mktemp"], capture_output=True).returncode == 0:
-            self.tmp_dir = (
-                subprocess.run(["mktemp", "-d"], capture_output=True)
-                .stdout.decode("utf-8")
-                .strip()
-            )
-        else:
-            print("WARNING: `mktemp` command not found. Using `./.tmp` instead.")
-            try:
-                os.makedirs(self.tmp_dir, exist_ok=False)
-            except FileExistsError:
-                print("ERROR: `./.tmp` already exists. Please remove it and try again.")
-                raise
+        names = set(self.zip.namelist())
+
+        self.version = 1
+        if _VERSION_FILE in names:
+            self.version = int(self.zip.read(_VERSION_FILE))
+
+        if self.version == 1:
+            self.names = names
+            return
+
+        if self.version != _FORMAT_VERSION:
+            raise ValueError(f"unknown version {self.version} of {self.filename}")
+
+        index = np.frombuffer(self.zip.read(_INDEX_FILE), dtype=_INDEX_DTYPE)
+        self.index = {int(e["t"]): e for e in index}
+
+        self.link_blocks = self._map(
+            _DIFF_LINK_BLOCKS_FILE, celestial.types.LINK_DIFF_DTYPE
+        )
+        self.machine_blocks = self._map(
+            _DIFF_MACHINE_BLOCKS_FILE, celestial.types.MACHINE_DIFF_DTYPE
+        )
+
+    def _map(self, name: str, dtype: np.dtype) -> np.ndarray:  # type: ignore
+        """
+        Map an uncompressed file in the .zip file into memory.
+
+        :param name: The name of the file in the .zip file.
+        :param dtype: The dtype of the array in the file.
+        :returns: The (read-only) array.
+        :raises ValueError: If the file is compressed.
+        """
+        info = self.zip.getinfo(name)
+
+        if info.compress_type != zipfile.ZIP_STORED:
+            raise ValueError(f"{name} in {self.filename} is compressed")
+
+        if info.file_size == 0:
+            return np.empty(0, dtype=dtype)
 
-        # unzip the file
-        shutil.unpack_archive(self.filename, self.tmp_dir)
+        # the data follows the local file header, which has a fixed size of 30
+        # bytes plus the file name and an extra field
+        with open(self.filename, "rb") as f:
+            f.seek(info.header_offset)
+            header = f.read(30)
+
+        name_len, extra_len = struct.unpack("<HH", header[26:30])
+
+        return np.memmap(
+            self.filename,
+            dtype=dtype,
+            mode="r",
+            offset=info.header_offset + 30 + name_len + extra_len,
+            shape=(info.file_size // dtype.itemsize,),
+        )
 
     def config(self) -> celestial.config.Config:
         """
@@ -446,9 +558,7 @@ class ZipDeserializer:
 
         :returns: The restored configuration.
         """
-        p = os.path.join(self.tmp_dir, _CONFIG_FILE)
-        with open(p, "rb") as f:
-            return _config_from_bytes(f.read())
+        return _config_from_bytes(self.zip.read(_CONFIG_FILE))
 
     def init_machines(
         self,
@@ -461,11 +571,61 @@ class ZipDeserializer:
 
         :returns: A list of the restored machine initializations.
         """
-        p = os.path.join(self.tmp_dir, _INIT_FILE)
-        if not os.path.exists(p):
+        if _INIT_FILE not in self.zip.namelist():
             return []
-        with open(p, "r") as f:
-            return [_init_from_str(line) for line in f.readlines()]
+
+        return [
+            _init_from_str(line)
+            for line in self.zip.read(_INIT_FILE).decode("utf-8").splitlines()
+        ]
+
+    def link_diff_block(
+        self, t: celestial.types.timestamp_s
+    ) -> np.ndarray:  # type: ignore
+        """
+        Get the link diffs of a timestep as a block. For version 2 files, this
+        is a read-only view of the mapped .zip file.
+
+        :param t: The timestep to restore the link diffs for.
+        :returns: The link diffs as celestial.types.LINK_DIFF_DTYPE.
+        """
+        if self.version == 1:
+            n = f"{_DIFF_LINK_FILE_PREFIX}{t}"
+            if n not in self.names:
+                return np.empty(0, dtype=celestial.types.LINK_DIFF_DTYPE)
+
+            return _link_block_from_v1(self.zip.read(n))
+
+        if t not in self.index:
+            return np.empty(0, dtype=celestial.types.LINK_DIFF_DTYPE)
+
+        e = self.index[t]
+        offset = int(e["link_offset"])
+        return self.link_blocks[offset : offset + int(e["link_count"])]
+
+    def machine_diff_block(
+        self, t: celestial.types.timestamp_s
+    ) -> np.ndarray:  # type: ignore
+        """
+        Get the machine diffs of a timestep as a block. For version 2 files,
+        this is a read-only view of the mapped .zip file.
+
+        :param t: The timestep to restore the machine diffs for.
+        :returns: The machine diffs as celestial.types.MACHINE_DIFF_DTYPE.
+        """
+        if self.version == 1:
+            n = f"{_DIFF_MACHINE_FILE_PREFIX}{t}"
+            if n not in self.names:
+                return np.empty(0, dtype=celestial.types.MACHINE_DIFF_DTYPE)
+
+            return _machine_block_from_v1(self.zip.read(n))
+
+        if t not in self.index:
+            return np.empty(0, dtype=celestial.types.MACHINE_DIFF_DTYPE)
+
+        e = self.index[t]
+        offset = int(e["machine_offset"])
+        return self.machine_blocks[offset : offset + int(e["machine_count"])]
 
     def diff_links(
         self, t: celestial.types.timestamp_s
@@ -477,24 +637,24 @@ class ZipDeserializer:
         ]
     ]:
         """
-        Restore the link diffs from the link diff file copied to the .zip file
-        for a given timestep.
+        Restore the link diffs of a timestep. Prefer link_diff_block, this
+        creates Python objects for every link.
 
         :param t: The timestep to restore the link diffs for.
         :returns: An iterator of the restored link diffs.
         """
-
-        p = os.path.join(self.tmp_dir, f"{_DIFF_LINK_FILE_PREFIX}{t}")
-
-        if not os.path.exists(p):
-            yield from ()  # return empty iterator
-            return
-
-        with open(p, "rb") as f:
-            for ld in _diff_link_from_bytes(f.read()):
-                yield ld
-
-        return
+        for d in self.link_diff_block(t):
+            yield (
+                celestial.types.MachineID_from_packed(d["source"]),
+                celestial.types.MachineID_from_packed(d["target"]),
+                celestial.types.Link(
+                    latency_us=d["latency_us"],
+                    bandwidth_kbits=d["bandwidth_kbits"],
+                    blocked=d["blocked"],
+                    next_hop=celestial.types.MachineID_from_packed(d["next_hop"]),
+                    prev_hop=celestial.types.MachineID_from_packed(d["prev_hop"]),
+                ),
+            )
 
     def diff_machines(
         self, t: celestial.types.timestamp_s
@@ -502,20 +662,13 @@ class ZipDeserializer:
         typing.Tuple[celestial.types.MachineID_dtype, celestial.types.VMState]
     ]:
         """
-        Restore the machine diffs from the machine diff file copied to the .zip
-        file for a given timestep.
+        Restore the machine diffs of a timestep.
 
         :param t: The timestep to restore the machine diffs for.
         :returns: An iterator of the restored machine diffs.
         """
-        p = os.path.join(self.tmp_dir, f"{_DIFF_MACHINE_FILE_PREFIX}{t}")
-
-        if not os.path.exists(p):
-            yield from ()  # return empty iterator
-            return
-
-        with open(p, "rb") as f:
-            for md in _diff_machine_from_bytes(f.read()):
-                yield md
-
-        return
+        for d in self.machine_diff_block(t):
+            yield (
+                celestial.types.MachineID_from_packed(d["machine"]),
+                celestial.types.VMState(int(d["state"])),
+            )
@@ -96,3 +96,67 @@ static __always_inline int parse_ipv6hdr(struct hdr_cursor *nh,
 
     return ipv6h->nexthdr; // Return the next protocol (next header)
 }
+
+// maximum number of IPv6 extension headers we walk before giving up
+#define IPV6_EXT_MAX_CHAIN 6
+
+// parse_ipv6_ext walks the IPv6 extension headers (hop-by-hop, destination
+// options, and routing headers) starting at the cursor, and performs necessary
+// bounds checks.
+// If one of them is a Segment Routing Header (RFC 8754) and the packet has
+// already passed a segment endpoint, prev_hop is set to the segment that was
+// active before the current one, i.e., the machine that sent the packet on
+// this hop. Segments are stored in reverse order, so that is
+// segments[segments_left + 1].
+// returns the next protocol after the extension headers
+static __always_inline int parse_ipv6_ext(struct hdr_cursor *nh,
+                                          void *data_end,
+                                          int nexthdr,
+                                          struct in6_addr **prev_hop)
+{
+#pragma unroll
+    for (int i = 0; i < IPV6_EXT_MAX_CHAIN; i++)
+    {
+        if (nexthdr == IPPROTO_HOPOPTS || nexthdr == IPPROTO_DSTOPTS)
+        {
+            struct ipv6_opt_hdr *opt = nh->pos;
+
+            if (nh->pos + sizeof(*opt) > data_end)
+                return TC_ACT_SHOT;
+
+            nexthdr = opt->nexthdr;
+            nh->pos += (opt->hdrlen + 1) * 8;
+            continue;
+        }
+
+        if (nexthdr == IPPROTO_ROUTING)
+        {
+            struct ipv6_sr_hdr *srh = nh->pos;
+
+            if (nh->pos + sizeof(*srh) > data_end)
+                return TC_ACT_SHOT;
+
+            if (srh->type == IPV6_SRCRT_TYPE_4 && srh->segments_left < srh->first_segment)
+            {
+                struct in6_addr *seg = nh->pos + sizeof(*srh) + (srh->segments_left + 1) * sizeof(struct in6_addr);
+
+// ignore compare-distinct-pointer-types warning
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wcompare-distinct-pointer-types"
+                if (seg + 1 > data_end)
+#pragma GCC diagnostic pop
+                    return TC_ACT_SHOT;
+
+                *prev_hop = seg;
+            }
+
+            nexthdr = srh->nexthdr;
+            nh->pos += (srh->hdrlen + 1) * 8;
+            continue;
+        }
+
+        return nexthdr;
+    }
+
+    return nexthdr;
+}
@@ -21,21 +21,176 @@ struct handle_kbps_delay
 {
     __u32 throttle_rate_kbps;
     __u32 delay_us;
+    // departure time of the last packet on this link, owned by the datapath,
+    // only used for links without a machine index, see LINK_PACING
+    __u64 last_tstamp;
 } HANDLE_KBPS_DELAY;
 
+// The maps can either belong to a single machine or be shared by all
+// machines on a host (SHARED_MODE). Either way, the entries are keyed by the
+// ifindex of the machine's tap, so that the same program works for both.
+
+// Link tables are longest-prefix-match tries keyed by the tap ifindex and
+// the source network of a link, so a whole machine network (/30 or /126) is
+// a single entry. The ifindex is always matched in full, i.e., prefixlen is
+// 32 + the prefix length of the network.
+struct ipv4_lpm_key
+{
+    __u32 prefixlen;
+    __u32 ifindex;
+    __u32 addr;
+};
+
+struct ipv6_lpm_key
+{
+    __u32 prefixlen;
+    __u32 ifindex;
+    struct in6_addr addr;
+};
+
+// There are two generations of the link tables (and the reachable set). The
+// datapath reads through the generation in LINK_GENERATION, while user space
+// fills the other one and then flips LINK_GENERATION, so that packets see
+// either the old or the new state of a timestep, never a mix.
+struct
+{
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __type(key, __u32);
+    __type(value, __u32);
+    __uint(max_entries, 1);
+} LINK_GENERATION SEC(".maps");
+
+// In SHARED_MODE, each machine flips its own generation, keyed by ifindex.
 struct
 {
     __uint(type, BPF_MAP_TYPE_HASH);
     __type(key, __u32);
-    __type(value, HANDLE_KBPS_DELAY);
+    __type(value, __u32);
+    __uint(max_entries, 16384);
+    __uint(map_flags, BPF_F_NO_PREALLOC);
+} VM_GENERATION SEC(".maps");
+
+#define LINK_TABLE_V4(name)                           \
+    struct                                            \
+    {                                                 \
+        __uint(type, BPF_MAP_TYPE_LPM_TRIE);          \
+        __type(key, struct ipv4_lpm_key);             \
+        __type(value, HANDLE_KBPS_DELAY);             \
+        __uint(max_entries, 65535);                   \
+        __uint(map_flags, BPF_F_NO_PREALLOC);         \
+    } name SEC(".maps")
+
+#define LINK_TABLE_V6(name)                           \
+    struct                                            \
+    {                                                 \
+        __uint(type, BPF_MAP_TYPE_LPM_TRIE);          \
+        __type(key, struct ipv6_lpm_key);             \
+        __type(value, HANDLE_KBPS_DELAY);             \
+        __uint(max_entries, 65535);                   \
+        __uint(map_flags, BPF_F_NO_PREALLOC);         \
+    } name SEC(".maps")
+
+LINK_TABLE_V4(IP_HANDLE_KBPS_DELAY_0);
+LINK_TABLE_V4(IP_HANDLE_KBPS_DELAY_1);
+
+// IPv6 maps
+LINK_TABLE_V6(IPV6_HANDLE_KBPS_DELAY_0);
+LINK_TABLE_V6(IPV6_HANDLE_KBPS_DELAY_1);
+
+// Links are blocked by default. The links that are not blocked are kept in a
+// bitmap indexed by the machine index of the link source, so that a zeroed
+// bitmap blocks every link and blocked traffic is dropped with an array lookup
+// before anything else is done. The machine index follows the address layout
+// in getNet (pkg/virt/net.go): 10.[group].[id>>6].[id<<2] is machine index
+// group << 14 | id. Machines in groups beyond REACHABLE_MAX_GROUPS are
+// reachable only if they have a link table entry. Both generations share the
+// map, generation 1 starts at word REACHABLE_WORDS.
+#define REACHABLE_MAX_GROUPS 16
+#define REACHABLE_GROUP_SHIFT 14
+#define REACHABLE_WORDS ((REACHABLE_MAX_GROUPS << REACHABLE_GROUP_SHIFT) / 64)
+
+struct
+{
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __type(key, __u32);
+    __type(value, __u64);
+    __uint(max_entries, 2 * REACHABLE_WORDS);
+} REACHABLE_SET SEC(".maps");
+
+// In SHARED_MODE, a bitmap per machine would be too large, so we only keep
+// the words that have bits set, keyed by ifindex and word.
+struct reachable_key
+{
+    __u32 ifindex;
+    __u32 word;
+};
+
+struct
+{
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __type(key, struct reachable_key);
+    __type(value, __u64);
+    __uint(max_entries, 1 << 20);
+    __uint(map_flags, BPF_F_NO_PREALLOC);
+} REACHABLE_SET_SHARED SEC(".maps");
+
+// Per-link traffic counters, keyed by the tap ifindex and the machine index
+// of the link source. The map is per-CPU so that counting does not need
+// atomics on the hot path, user space sums up the values of all CPUs.
+struct link_stats_key
+{
+    __u32 ifindex;
+    __u32 index;
+};
+
+struct link_stats
+{
+    __u64 packets;
+    __u64 bytes;
+    __u64 drops;
+    __u64 ecn_marks;
+};
+
+struct
+{
+    __uint(type, BPF_MAP_TYPE_PERCPU_HASH);
+    __type(key, struct link_stats_key);
+    __type(value, struct link_stats);
     __uint(max_entries, 65535);
-} IP_HANDLE_KBPS_DELAY SEC(".maps");
+    __uint(map_flags, BPF_F_NO_PREALLOC);
+} LINK_STATS SEC(".maps");
 
-// IPv6 map
+// Departure time of the last packet on a link, keyed like LINK_STATS. The
+// pacing state is kept out of the link tables, so that it is neither reset by
+// rewriting a link nor left behind in the inactive generation by a flip.
+// Entries are only created for sources that have a link.
 struct
 {
     __uint(type, BPF_MAP_TYPE_HASH);
-    __type(key, struct in6_addr); // 使用 IPv6 地址作为 key
-    __type(value, HANDLE_KBPS_DELAY);
+    __type(key, struct link_stats_key);
+    __type(value, __u64);
     __uint(max_entries, 65535);
-} IPV6_HANDLE_KBPS_DELAY SEC(".maps");
+    __uint(map_flags, BPF_F_NO_PREALLOC);
+} LINK_PACING SEC(".maps");
+
+// Machines on this host that tc_redirect forwards to directly, keyed by
+// machine index. The map is shared by the programs of all machines on a host,
+// also when SHARED_MODE is off, as any machine may send to any other.
+struct redirect_target
+{
+    // tap of the machine
+    __u32 ifindex;
+    // MAC address of the machine and of its tap, i.e., the destination and
+    // source of what the host would send to the machine
+    __u8 mac[ETH_ALEN];
+    __u8 tap_mac[ETH_ALEN];
+};
+
+struct
+{
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __type(key, __u32);
+    __type(value, struct redirect_target);
+    __uint(max_entries, 16384);
+    __uint(map_flags, BPF_F_NO_PREALLOC);
+} REDIRECT_TARGETS SEC(".maps");
@@ -23,6 +23,7 @@
 #include <linux/in.h>
 #include <linux/ip.h>
 #include <linux/ipv6.h>
+#include <linux/seg6.h>
 #include <linux/pkt_cls.h>
 #include <linux/tcp.h>
 #include <bpf/bpf_helpers.h>
@@ -30,112 +31,218 @@
 #include "helpers.h"
 #include "maps.h"
 
-#define TIME_HORIZON_NS (2000 * 1000 * 1000)
 #define NS_PER_SEC 1000000000
-#define ECN_HORIZON_NS 999999000000
 #define NS_PER_US 1000
 
-// IPv4 flow map
-struct {
-    __uint(type, BPF_MAP_TYPE_HASH);
-    __type(key, uint32_t);
-    __type(value, uint64_t);
-    __uint(max_entries, 65535);
-} ipv4_flow_map SEC(".maps");
-
-// IPv6 flow map
-struct {
-    __uint(type, BPF_MAP_TYPE_HASH);
-    __type(key, struct in6_addr); // 使用结构体作为键
-    __type(value, uint64_t);
-    __uint(max_entries, 65535);
-} ipv6_flow_map SEC(".maps");
-
-static inline int throttle_flow_ipv4(struct __sk_buff *skb, __u32 ip_address, uint32_t *throttle_rate_kbps)
+// These are set at load time (see loadObjects), the verifier treats them as
+// constants and prunes the code paths that are switched off.
+// one program and map set for all machines on a host
+volatile const __u32 SHARED_MODE = 0;
+// which address families to shape, other traffic passes unchanged
+volatile const __u32 ENABLE_IPV4 = 1;
+volatile const __u32 ENABLE_IPV6 = 1;
+// inject link latency, otherwise only bandwidth is emulated
+volatile const __u32 ENABLE_DELAY = 1;
+// packets that would depart later than this are dropped
+volatile const __u64 TIME_HORIZON_NS = 2000 * 1000 * 1000;
+// packets that depart later than this are ECN marked, 0 disables marking
+volatile const __u64 ECN_HORIZON_NS = 0;
+
+// Number of times a CPU retries to claim a departure slot when other CPUs
+// concurrently transmit on the same link before the packet is dropped.
+#define PACING_CAS_RETRIES 8
+
+// The pacing state of a link is the departure time of its last packet,
+// last_tstamp, which is written in place through the pointer we got from
+// bpf_map_lookup_elem, so a packet needs no map update.
+// Several CPUs may transmit on the same link at once, so the departure slot
+// is claimed with a compare-and-swap on last_tstamp. A CPU that loses the race
+// recomputes its slot from the winner's timestamp, no pacing update is lost.
+static inline int throttle_flow(struct __sk_buff *skb, struct handle_kbps_delay *hbd, __u64 *last_tstamp_p, struct link_stats *stats)
 {
-    // 处理 IPv4 流量的逻辑
-    if (*throttle_rate_kbps == 0)
+    uint32_t throttle_rate_kbps = hbd->throttle_rate_kbps;
+
+    if (throttle_rate_kbps == 0)
     {
         return TC_ACT_SHOT;
     }
 
-    uint32_t key = ip_address;
-    uint64_t *last_tstamp = bpf_map_lookup_elem(&ipv4_flow_map, &key);
-    uint64_t delay_ns = ((uint64_t)skb->len) * NS_PER_SEC / 1000 / *throttle_rate_kbps;
+    uint64_t delay_ns = ((uint64_t)skb->len) * NS_PER_SEC / 1000 / throttle_rate_kbps;
 
     uint64_t now = bpf_ktime_get_ns();
-    uint64_t tstamp, next_tstamp = 0;
-
-    if (last_tstamp)
-        next_tstamp = *last_tstamp + delay_ns;
-
-    tstamp = skb->tstamp;
+    uint64_t tstamp = skb->tstamp;
     if (tstamp < now)
         tstamp = now;
 
-    if (next_tstamp <= tstamp)
+    for (int i = 0; i < PACING_CAS_RETRIES; i++)
     {
-        if (bpf_map_update_elem(&ipv4_flow_map, &key, &tstamp, BPF_ANY))
+        uint64_t last_tstamp = *last_tstamp_p;
+        uint64_t next_tstamp = 0;
+
+        if (last_tstamp)
+            next_tstamp = last_tstamp + delay_ns;
+
+        if (next_tstamp <= tstamp)
+        {
+            if (__sync_val_compare_and_swap(last_tstamp_p, last_tstamp, tstamp) != last_tstamp)
+                continue;
+
+            return TC_ACT_OK;
+        }
+
+        if (next_tstamp - now >= TIME_HORIZON_NS)
             return TC_ACT_SHOT;
 
+        if (__sync_val_compare_and_swap(last_tstamp_p, last_tstamp, next_tstamp) != last_tstamp)
+            continue;
+
+        if (ECN_HORIZON_NS && next_tstamp - now >= ECN_HORIZON_NS && bpf_skb_ecn_set_ce(skb) && stats)
+            stats->ecn_marks++;
+
+        skb->tstamp = next_tstamp;
+
         return TC_ACT_OK;
     }
 
-    if (next_tstamp - now >= TIME_HORIZON_NS)
-        return TC_ACT_SHOT;
+    // the link is so contended that we could not get a slot, treat this like
+    // a full queue
+    return TC_ACT_SHOT;
+}
 
-    if (next_tstamp - now >= ECN_HORIZON_NS)
-        bpf_skb_ecn_set_ce(skb);
+// machine_index converts the IPv4 address (host byte order) of a machine into
+// its machine index. Returns 0 if the address is not a machine address.
+static __always_inline int machine_index(__u32 ip_address, __u32 *index)
+{
+    if ((ip_address >> 24) != 10)
+        return 0;
 
-    if (bpf_map_update_elem(&ipv4_flow_map, &key, &next_tstamp, BPF_EXIST))
-        return TC_ACT_SHOT;
+    // [group].[id>>6].[id<<2] shifted down by two is group << 14 | id
+    *index = (ip_address >> 2) & ((1 << 22) - 1);
 
-    skb->tstamp = next_tstamp;
+    return 1;
+}
 
-    return TC_ACT_OK;
+// machine_index_ipv6 does the same for an fd00::[a]:[b]:[c]:[d] address,
+// where each group holds one byte of the machine's IPv4 address.
+static __always_inline int machine_index_ipv6(struct in6_addr *ip_address, __u32 *index)
+{
+    __u8 *a = ip_address->in6_u.u6_addr8;
+
+    if (a[0] != 0xfd || a[1] != 0x00)
+        return 0;
+
+    return machine_index(((__u32)a[9] << 24) | ((__u32)a[11] << 16) | ((__u32)a[13] << 8) | (__u32)a[15], index);
 }
 
-static inline int throttle_flow_ipv6(struct __sk_buff *skb, struct in6_addr *ip_address, uint32_t *throttle_rate_kbps)
+// link_generation returns the generation of the link tables to use.
+static __always_inline __u32 link_generation(__u32 ifindex)
 {
-    // 处理 IPv6 流量的逻辑
-    if (*throttle_rate_kbps == 0)
-    {
-        return TC_ACT_SHOT;
-    }
+    __u32 zero = 0;
+    __u32 *gen;
 
-    uint64_t *last_tstamp = bpf_map_lookup_elem(&ipv6_flow_map, ip_address);
-    uint64_t delay_ns = ((uint64_t)skb->len) * NS_PER_SEC / 1000 / *throttle_rate_kbps;
+    if (SHARED_MODE)
+        gen = bpf_map_lookup_elem(&VM_GENERATION, &ifindex);
+    else
+        gen = bpf_map_lookup_elem(&LINK_GENERATION, &zero);
 
-    uint64_t now = bpf_ktime_get_ns();
-    uint64_t tstamp, next_tstamp = 0;
+    if (gen && *gen)
+        return 1;
 
-    if (last_tstamp)
-        next_tstamp = *last_tstamp + delay_ns;
+    return 0;
+}
 
-    tstamp = skb->tstamp;
-    if (tstamp < now)
-        tstamp = now;
+// check_reachable checks the reachable-set bitmap of a generation for a
+// machine index. Returns TC_ACT_OK if the link is reachable, TC_ACT_SHOT if it
+// is blocked, and TC_ACT_UNSPEC if the machine is not covered by the bitmap,
+// in which case the link table decides.
+static __always_inline int check_reachable(__u32 ifindex, __u32 gen, __u32 index)
+{
+    __u32 word = index / 64;
+    __u64 *bits;
 
-    if (next_tstamp <= tstamp)
+    if (word >= REACHABLE_WORDS)
+        return TC_ACT_UNSPEC;
+
+    word += gen * REACHABLE_WORDS;
+
+    if (SHARED_MODE)
     {
-        if (bpf_map_update_elem(&ipv6_flow_map, ip_address, &tstamp, BPF_ANY))
-            return TC_ACT_SHOT;
+        struct reachable_key key = {
+            .ifindex = ifindex,
+            .word = word,
+        };
 
-        return TC_ACT_OK;
+        bits = bpf_map_lookup_elem(&REACHABLE_SET_SHARED, &key);
+    }
+    else
+    {
+        bits = bpf_map_lookup_elem(&REACHABLE_SET, &word);
     }
 
-    if (next_tstamp - now >= TIME_HORIZON_NS)
+    // a missing word has no reachable links
+    if (!bits || !((*bits >> (index % 64)) & 1))
         return TC_ACT_SHOT;
 
-    if (next_tstamp - now >= ECN_HORIZON_NS)
-        bpf_skb_ecn_set_ce(skb);
+    return TC_ACT_OK;
+}
 
-    if (bpf_map_update_elem(&ipv6_flow_map, ip_address, &next_tstamp, BPF_EXIST))
-        return TC_ACT_SHOT;
+// get_stats returns this CPU's counters for the link to a machine index,
+// creating them for the first packet on the link.
+static __always_inline struct link_stats *get_stats(__u32 ifindex, __u32 index)
+{
+    struct link_stats_key key = {
+        .ifindex = ifindex,
+        .index = index,
+    };
 
-    skb->tstamp = next_tstamp;
+    struct link_stats *stats = bpf_map_lookup_elem(&LINK_STATS, &key);
 
-    return TC_ACT_OK;
+    if (stats)
+        return stats;
+
+    struct link_stats zero = {};
+    bpf_map_update_elem(&LINK_STATS, &key, &zero, BPF_NOEXIST);
+
+    return bpf_map_lookup_elem(&LINK_STATS, &key);
+}
+
+// get_pacing returns the pacing state of the link to a machine index,
+// creating it for the first packet on the link. IPv4 and IPv6 traffic on a
+// link share it.
+static __always_inline __u64 *get_pacing(__u32 ifindex, __u32 index)
+{
+    struct link_stats_key key = {
+        .ifindex = ifindex,
+        .index = index,
+    };
+
+    __u64 *last_tstamp = bpf_map_lookup_elem(&LINK_PACING, &key);
+
+    if (last_tstamp)
+        return last_tstamp;
+
+    __u64 zero = 0;
+    bpf_map_update_elem(&LINK_PACING, &key, &zero, BPF_NOEXIST);
+
+    return bpf_map_lookup_elem(&LINK_PACING, &key);
+}
+
+// account counts a packet with its verdict, stats may be NULL.
+static __always_inline int account(struct __sk_buff *skb, struct link_stats *stats, int verdict)
+{
+    if (!stats)
+        return verdict;
+
+    if (verdict == TC_ACT_SHOT)
+    {
+        stats->drops++;
+        return verdict;
+    }
+
+    stats->packets++;
+    stats->bytes += skb->len;
+
+    return verdict;
 }
 
 static inline int inject_delay(struct __sk_buff *skb, uint32_t *delay_us)
@@ -168,72 +275,265 @@ int tc_main(struct __sk_buff *skb)
     int eth_type;
     int ip_type;
 
+    __u32 ifindex = skb->ifindex;
+    __u32 gen = link_generation(ifindex);
+
     nh.pos = data;
 
     eth_type = parse_ethhdr(&nh, data_end, &eth);
-    if (eth_type == bpf_htons(ETH_P_IP))
+    if (ENABLE_IPV4 && eth_type == bpf_htons(ETH_P_IP))
     {
         ip_type = parse_iphdr(&nh, data_end, &iphdr);
         if (ip_type == IPPROTO_ICMP || ip_type == IPPROTO_TCP || ip_type == IPPROTO_UDP)
         {
             __u32 ip_address = iphdr->saddr;
-            __u32 *throttle_rate_kbps;
             __u32 *delay_us;
 
+            struct link_stats *stats = NULL;
+            __u32 index;
+
+            // traffic that does not come from a machine is not emulated
+            int reachable = TC_ACT_OK;
+            int from_machine = machine_index(bpf_ntohl(ip_address), &index);
+
+            if (from_machine)
+            {
+                stats = get_stats(ifindex, index);
+
+                reachable = check_reachable(ifindex, gen, index);
+                if (reachable == TC_ACT_SHOT)
+                {
+                    return account(skb, stats, TC_ACT_SHOT);
+                }
+            }
+
+            struct ipv4_lpm_key key = {
+                .prefixlen = 64,
+                .ifindex = ifindex,
+                .addr = ip_address,
+            };
+
             struct handle_kbps_delay *val_struct;
-            val_struct = bpf_map_lookup_elem(&IP_HANDLE_KBPS_DELAY, &ip_address);
+            if (gen)
+                val_struct = bpf_map_lookup_elem(&IP_HANDLE_KBPS_DELAY_1, &key);
+            else
+                val_struct = bpf_map_lookup_elem(&IP_HANDLE_KBPS_DELAY_0, &key);
 
+            // machines outside the reachable set are blocked unless they
+            // have a link
             if (!val_struct)
             {
-                return TC_ACT_OK;
+                return account(skb, stats, reachable == TC_ACT_UNSPEC ? TC_ACT_SHOT : TC_ACT_OK);
             }
 
-            throttle_rate_kbps = &val_struct->throttle_rate_kbps;
+            // only links that exist get pacing state, so that blocked and
+            // unknown sources cannot fill LINK_PACING
+            __u64 *pacing = NULL;
+            if (from_machine)
+                pacing = get_pacing(ifindex, index);
 
-            int ret = throttle_flow_ipv4(skb, ip_address, throttle_rate_kbps);
+            int ret = throttle_flow(skb, val_struct, pacing ? pacing : &val_struct->last_tstamp, stats);
 
             if (ret != TC_ACT_OK)
             {
-                return ret;
+                return account(skb, stats, ret);
+            }
+
+            if (!ENABLE_DELAY)
+            {
+                return account(skb, stats, TC_ACT_OK);
             }
 
             delay_us = &val_struct->delay_us;
 
-            return inject_delay(skb, delay_us);
+            return account(skb, stats, inject_delay(skb, delay_us));
         }
     }
-    else if (eth_type == bpf_htons(ETH_P_IPV6))
+    else if (ENABLE_IPV6 && eth_type == bpf_htons(ETH_P_IPV6))
     {
+        struct in6_addr *prev_hop = NULL;
+        struct in6_addr *saddr;
+
         ip_type = parse_ipv6hdr(&nh, data_end, &ipv6hdr);
+        if (ip_type == TC_ACT_SHOT)
+        {
+            return TC_ACT_OK;
+        }
+
+        saddr = &ipv6hdr->saddr;
+
+        // SRv6 packets carry a routing header, step over it to the payload
+        ip_type = parse_ipv6_ext(&nh, data_end, ip_type, &prev_hop);
+
+        // IPv6-in-IPv6 (e.g., SRv6 H.Encaps): the link is that of the inner
+        // source, unless a segment endpoint has already forwarded the packet
+        if (ip_type == IPPROTO_IPV6)
+        {
+            struct ipv6hdr *inner;
+            struct in6_addr *inner_prev_hop = NULL;
+
+            ip_type = parse_ipv6hdr(&nh, data_end, &inner);
+            if (ip_type == TC_ACT_SHOT)
+            {
+                return TC_ACT_OK;
+            }
+
+            saddr = &inner->saddr;
+            ip_type = parse_ipv6_ext(&nh, data_end, ip_type, &inner_prev_hop);
+        }
+
+        // the previous segment is the machine that sent the packet on this hop
+        if (prev_hop)
+        {
+            saddr = prev_hop;
+        }
+
         if (ip_type == IPPROTO_ICMPV6 || ip_type == IPPROTO_TCP || ip_type == IPPROTO_UDP)
         {
-            struct in6_addr ip_address = ipv6hdr->saddr;
-            uint32_t *throttle_rate_kbps;
+            struct in6_addr ip_address = *saddr;
             uint32_t *delay_us;
 
+            struct link_stats *stats = NULL;
+            __u32 index;
+
+            // traffic that does not come from a machine is not emulated
+            int reachable = TC_ACT_OK;
+            int from_machine = machine_index_ipv6(&ip_address, &index);
+
+            if (from_machine)
+            {
+                stats = get_stats(ifindex, index);
+
+                reachable = check_reachable(ifindex, gen, index);
+                if (reachable == TC_ACT_SHOT)
+                {
+                    return account(skb, stats, TC_ACT_SHOT);
+                }
+            }
+
+            struct ipv6_lpm_key key = {
+                .prefixlen = 160,
+                .ifindex = ifindex,
+                .addr = ip_address,
+            };
+
             struct handle_kbps_delay *val_struct;
-            val_struct = bpf_map_lookup_elem(&IPV6_HANDLE_KBPS_DELAY, &ip_address);
+            if (gen)
+                val_struct = bpf_map_lookup_elem(&IPV6_HANDLE_KBPS_DELAY_1, &key);
+            else
+                val_struct = bpf_map_lookup_elem(&IPV6_HANDLE_KBPS_DELAY_0, &key);
 
+            // machines outside the reachable set are blocked unless they
+            // have a link
             if (!val_struct)
             {
-                return TC_ACT_OK;
+                return account(skb, stats, reachable == TC_ACT_UNSPEC ? TC_ACT_SHOT : TC_ACT_OK);
             }
 
-            throttle_rate_kbps = &val_struct->throttle_rate_kbps;
+            // only links that exist get pacing state, so that blocked and
+            // unknown sources cannot fill LINK_PACING
+            __u64 *pacing = NULL;
+            if (from_machine)
+                pacing = get_pacing(ifindex, index);
 
-            int ret = throttle_flow_ipv6(skb, &ip_address, throttle_rate_kbps);
+            int ret = throttle_flow(skb, val_struct, pacing ? pacing : &val_struct->last_tstamp, stats);
 
             if (ret != TC_ACT_OK)
             {
-                return ret;
+                return account(skb, stats, ret);
+            }
+
+            if (!ENABLE_DELAY)
+            {
+                return account(skb, stats, TC_ACT_OK);
             }
 
             delay_us = &val_struct->delay_us;
 
-            return inject_delay(skb, delay_us);
+            return account(skb, stats, inject_delay(skb, delay_us));
         }
     }
     return TC_ACT_OK;
 }
 
+// redirect_to forwards a packet straight to the tap of a machine on this
+// host, doing what the host would do when routing it: the Ethernet header is
+// rewritten and the receive timestamp is cleared. The packet then takes the
+// egress path of the destination tap, so tc_main and the fq qdisc emulate the
+// link as before.
+static __always_inline int redirect_to(struct __sk_buff *skb, struct ethhdr *eth, struct redirect_target *target)
+{
+    __builtin_memcpy(eth->h_dest, target->mac, ETH_ALEN);
+    __builtin_memcpy(eth->h_source, target->tap_mac, ETH_ALEN);
+
+    skb->tstamp = 0;
+
+    return bpf_redirect(target->ifindex, 0);
+}
+
+// tc_redirect runs on ingress of a tap, i.e., on what a machine sends. Traffic
+// to machines on the same host bypasses the host network stack, everything
+// else (e.g., to machines on other hosts through pkg/peer) passes unchanged.
+SEC("tc")
+int tc_redirect(struct __sk_buff *skb)
+{
+    void *data_end = (void *)(unsigned long long)skb->data_end;
+    void *data = (void *)(unsigned long long)skb->data;
+
+    struct hdr_cursor nh;
+    struct ethhdr *eth;
+    struct iphdr *iphdr;
+    struct ipv6hdr *ipv6hdr;
+
+    struct redirect_target *target;
+    int eth_type;
+    __u32 index;
+
+    nh.pos = data;
+
+    eth_type = parse_ethhdr(&nh, data_end, &eth);
+    if (ENABLE_IPV4 && eth_type == bpf_htons(ETH_P_IP))
+    {
+        if (parse_iphdr(&nh, data_end, &iphdr) == TC_ACT_SHOT)
+            return TC_ACT_OK;
+
+        if (!machine_index(bpf_ntohl(iphdr->daddr), &index))
+            return TC_ACT_OK;
+
+        target = bpf_map_lookup_elem(&REDIRECT_TARGETS, &index);
+
+        // the host answers expired packets
+        if (!target || iphdr->ttl <= 1)
+            return TC_ACT_OK;
+
+        // decrement the TTL and update the checksum incrementally, as
+        // ip_decrease_ttl in the kernel does
+        __u32 check = (__u32)iphdr->check + (__u32)bpf_htons(0x0100);
+        iphdr->check = (__u16)(check + (check >= 0xFFFF));
+        iphdr->ttl--;
+
+        return redirect_to(skb, eth, target);
+    }
+    else if (ENABLE_IPV6 && eth_type == bpf_htons(ETH_P_IPV6))
+    {
+        if (parse_ipv6hdr(&nh, data_end, &ipv6hdr) == TC_ACT_SHOT)
+            return TC_ACT_OK;
+
+        // with SRv6, the destination is the next segment
+        if (!machine_index_ipv6(&ipv6hdr->daddr, &index))
+            return TC_ACT_OK;
+
+        target = bpf_map_lookup_elem(&REDIRECT_TARGETS, &index);
+
+        if (!target || ipv6hdr->hop_limit <= 1)
+            return TC_ACT_OK;
+
+        ipv6hdr->hop_limit--;
+
+        return redirect_to(skb, eth, target);
+    }
+
+    return TC_ACT_OK;
+}
+
 char _license[] SEC("license") = "GPL";
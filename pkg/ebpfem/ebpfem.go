@@ -21,16 +21,16 @@
 
 /*
 * 目前的代码可以对ipv6链路进行带宽和延迟的控制
-* 不过处理ipv6是直接对126子网中的两个ip分别控制
-* 可能会存在问题
+* IPv4 和 IPv6 链路都以子网前缀 (/30 与 /126) 为键写入 LPM trie，
+* 每次链路更新只需要一次 map 写入
  */
 
 package ebpfem
 
 import (
-	"fmt"
 	"net"
 
+	"github.com/cilium/ebpf"
 	"github.com/pkg/errors"
 	log "github.com/sirupsen/logrus"
 	"github.com/vishvananda/netlink"
@@ -38,17 +38,50 @@ import (
 	"github.com/OpenFogStack/celestial/pkg/orchestrator"
 )
 
-//go:generate env BPF2GO_FLAGS="-O3" go run github.com/cilium/ebpf/cmd/bpf2go -target amd64 edt ebpf/net.c -- -I./ebpf/headers
+//go:generate env BPF2GO_FLAGS="-O3" go run github.com/cilium/ebpf/cmd/bpf2go -target amd64 edt ebpf/net.c -- -I./ebpf/headers -mcpu=v3
 
 func New() *EBPFem {
+	return NewWithConfig(DefaultConfig())
+}
+
+// NewShared creates an EBPFem that loads the eBPF program and its maps only
+// once and attaches the same program to the taps of all machines, instead of
+// loading a copy per machine.
+func NewShared() *EBPFem {
+	c := DefaultConfig()
+	c.Shared = true
+
+	return NewWithConfig(c)
+}
+
+// NewWithConfig creates an EBPFem that loads the program variant selected by
+// the config.
+func NewWithConfig(c Config) *EBPFem {
 	return &EBPFem{
-		vms: make(map[orchestrator.MachineID]*vm),
+		vms:    make(map[orchestrator.MachineID]*vm),
+		config: c,
 	}
 }
 
 func (e *EBPFem) Stop() error {
 	e.Lock()
 	defer e.Unlock()
+
+	if e.redirect != nil {
+		err := e.redirect.Close()
+		if err != nil {
+			return errors.WithStack(err)
+		}
+	}
+
+	if e.config.Shared {
+		if e.objs == nil {
+			return nil
+		}
+
+		return errors.WithStack(e.objs.Close())
+	}
+
 	for _, v := range e.vms {
 		err := v.objs.Close()
 		if err != nil {
@@ -58,21 +91,78 @@ func (e *EBPFem) Stop() error {
 	return nil
 }
 
+// getObjects returns the eBPF objects for a new machine. In shared mode, these
+// are loaded for the first machine and then reused.
+func (e *EBPFem) getObjects(id orchestrator.MachineID) (*edtObjects, error) {
+	redirect, err := e.redirectMap()
+	if err != nil {
+		return nil, err
+	}
+
+	if !e.config.Shared {
+		log.Tracef("loading ebpf objects for %s", id.String())
+		return loadObjects(e.config, redirect)
+	}
+
+	e.Lock()
+	defer e.Unlock()
+
+	if e.objs == nil {
+		log.Debugf("loading shared ebpf objects")
+		objs, err := loadObjects(e.config, redirect)
+		if err != nil {
+			return nil, err
+		}
+		e.objs = objs
+	}
+
+	return e.objs, nil
+}
+
+// redirectMap returns the REDIRECT_TARGETS map shared by the objects of all
+// machines, creating it for the first machine. Every machine may send to
+// every other, so there is only one map even if the objects are not shared.
+// Returns nil if redirect is disabled.
+func (e *EBPFem) redirectMap() (*ebpf.Map, error) {
+	if !e.config.Redirect {
+		return nil, nil
+	}
+
+	e.Lock()
+	defer e.Unlock()
+
+	if e.redirect == nil {
+		log.Debugf("creating redirect map")
+		m, err := newRedirectMap()
+		if err != nil {
+			return nil, err
+		}
+		e.redirect = m
+	}
+
+	return e.redirect, nil
+}
+
 func (e *EBPFem) Register(id orchestrator.MachineID, netIf string) error {
 	v := &vm{
-		netIf: netIf,
-		objs:  &edtObjects{},
-		hbd:   make(map[string]*handleKbpsDelay),
+		netIf:     netIf,
+		shared:    e.config.Shared,
+		links:     make(map[string]*link),
+		reachable: make(map[uint32]uint64),
+		behind:    newDirty(),
+		staged:    newDirty(),
 	}
 
 	v.Lock()
 	defer v.Unlock()
 
-	log.Tracef("loading ebpf objects for %s", id.String())
-	if err := loadEdtObjects(v.objs, nil); err != nil {
+	objs, err := e.getObjects(id)
+	if err != nil {
 		return errors.WithStack(err)
 	}
 
+	v.objs = objs
+
 	progFd := v.objs.edtPrograms.TcMain.FD()
 
 	log.Tracef("getting interface %s", v.netIf)
@@ -82,6 +172,16 @@ func (e *EBPFem) Register(id orchestrator.MachineID, netIf string) error {
 		return errors.WithStack(err)
 	}
 
+	// all our map entries are keyed by the tap
+	v.ifindex = uint32(iface.Attrs().Index)
+
+	// all links are blocked by default, only traffic from the machine's own
+	// network passes until links are unblocked
+	err = v.allowSelf(idNet(id))
+	if err != nil {
+		return errors.WithStack(err)
+	}
+
 	// Create clsact qdisc
 	log.Tracef("creating clsact qdisc for %s", v.netIf)
 	_, err = createClsactQdisc(iface)
@@ -106,6 +206,17 @@ func (e *EBPFem) Register(id orchestrator.MachineID, netIf string) error {
 		return errors.WithStack(err)
 	}
 
+	// what the machine sends to machines on this host is redirected on
+	// ingress of its tap
+	if e.config.Redirect {
+		log.Tracef("attaching redirect bpf program for %s", v.netIf)
+		_, err = createTCBpfFilter(iface, v.objs.edtPrograms.TcRedirect.FD(), netlink.HANDLE_MIN_INGRESS, "edt_redirect")
+		if err != nil {
+			log.Errorf("error attaching redirect bpf program for %s", v.netIf)
+			return errors.WithStack(err)
+		}
+	}
+
 	e.Lock()
 	e.vms[id] = v
 	e.Unlock()
@@ -113,207 +224,196 @@ func (e *EBPFem) Register(id orchestrator.MachineID, netIf string) error {
 	return nil
 }
 
-func (v *vm) getHBD(target net.IPNet) *handleKbpsDelay {
-	hbd, ok := v.hbd[target.String()]
-	if ok {
-		return hbd
+// AddLocal lets other machines on this host send to a registered machine
+// with the given MAC address directly, their traffic is redirected to its tap
+// without passing the host network stack. The links of the machine are still
+// emulated on its tap. Does nothing if redirect is disabled.
+func (e *EBPFem) AddLocal(id orchestrator.MachineID, mac net.HardwareAddr) error {
+	if !e.config.Redirect {
+		return nil
 	}
 
-	hbd = &handleKbpsDelay{
-		throttleRateKbps: DEFAULT_BANDWIDTH_KBPS,
-		delayUs:          DEFAULT_LATENCY_US,
-	}
-
-	v.hbd[target.String()] = hbd
-
-	return hbd
-}
-
-func (e *EBPFem) SetBandwidth(source orchestrator.MachineID, target net.IPNet, bandwidthKbits uint64) error {
-	e.RLock()
-	v, ok := e.vms[source]
-	e.RUnlock()
-
-	if !ok {
-		return errors.Errorf("machine %d-%d does not exist", source.Group, source.Id)
+	v, err := e.vmFor(id)
+	if err != nil {
+		return err
 	}
 
-	v.Lock()
-	defer v.Unlock()
-
-	hbd := v.getHBD(target)
-	hbd.throttleRateKbps = uint32(bandwidthKbits)
-
-	// 处理 IPv4
-	ips, err := parseNetToLongs(target)
+	iface, err := getIface(v.netIf)
 	if err != nil {
 		return errors.WithStack(err)
 	}
 
-	for _, ip := range ips {
-		log.Tracef("updating bandwidth for %d to %d", ip, bandwidthKbits)
-		err = v.objs.IP_HANDLE_KBPS_DELAY.Put(ip, hbd)
-		if err != nil {
-			return errors.WithStack(err)
-		}
-	}
+	tapMac := iface.Attrs().HardwareAddr
 
-	// 处理 IPv6
-	ipv6 := net.ParseIP(fmt.Sprintf("fd00::%x:%x:%x:%x", target.IP[0], target.IP[1], target.IP[2], target.IP[3]))
-	err = v.objs.IPV6HANDLE_KBPS_DELAY.Put(ipv6, hbd)
-	if err != nil {
-		return errors.WithStack(err)
+	target := edtRedirectTarget{
+		Ifindex: v.ifindex,
 	}
 
-	// 处理另一个地址
-	ipv6MinusOne := ipv6.To16()
-	ipv6MinusOne[15]-- // 减去1
-	err = v.objs.IPV6HANDLE_KBPS_DELAY.Put(ipv6MinusOne, hbd)
-	if err != nil {
-		return errors.WithStack(err)
+	if len(mac) != len(target.Mac) || len(tapMac) != len(target.TapMac) {
+		return errors.Errorf("cannot redirect to %s (%s) on %s (%s), not an Ethernet address", id.String(), mac.String(), v.netIf, tapMac.String())
 	}
 
-	return nil
+	copy(target.Mac[:], mac)
+	copy(target.TapMac[:], tapMac)
+
+	log.Tracef("redirecting traffic to %d-%d to %s", id.Group, id.Id, v.netIf)
+
+	return errors.WithStack(e.redirect.Put(redirectIndex(id), target))
 }
 
-func (e *EBPFem) SetLatency(source orchestrator.MachineID, target net.IPNet, latency uint32) error {
+// vmFor returns the vm of a registered source machine.
+func (e *EBPFem) vmFor(source orchestrator.MachineID) (*vm, error) {
 	e.RLock()
 	v, ok := e.vms[source]
 	e.RUnlock()
 	if !ok {
-		return errors.Errorf("machine %d-%d does not exist", source.Group, source.Id)
+		return nil, errors.Errorf("machine %d-%d does not exist", source.Group, source.Id)
 	}
 
-	v.Lock()
-	defer v.Unlock()
-
-	hbd := v.getHBD(target)
-	hbd.delayUs = uint32(latency)
+	return v, nil
+}
 
-	// 处理 IPv4
-	ips, err := parseNetToLongs(target)
+// applyNow changes a single link and makes the change visible to the
+// datapath right away. Updates staged with UpdateLinks stay invisible until
+// the next CommitLinks.
+func (e *EBPFem) applyNow(source orchestrator.MachineID, target net.IPNet, c orchestrator.LinkChange) error {
+	v, err := e.vmFor(source)
 	if err != nil {
-		return errors.WithStack(err)
+		return err
 	}
 
-	for _, ip := range ips {
-		log.Tracef("updating latency for %d to %d", ip, latency)
-		err = v.objs.IP_HANDLE_KBPS_DELAY.Put(ip, hbd)
-		if err != nil {
-			return errors.WithStack(err)
-		}
-	}
+	v.Lock()
+	defer v.Unlock()
 
-	// 处理 IPv6
-	ipv6 := net.ParseIP(fmt.Sprintf("fd00::%x:%x:%x:%x", target.IP[0], target.IP[1], target.IP[2], target.IP[3]))
-	err = v.objs.IPV6HANDLE_KBPS_DELAY.Put(ipv6, hbd)
-	if err != nil {
-		return errors.WithStack(err)
-	}
+	return v.applyNow([]orchestrator.NetLinkUpdate{{Target: target, LinkChange: c}})
+}
 
-	// 处理另一个地址
-	ipv6MinusOne := ipv6.To16()
-	ipv6MinusOne[15]-- // 减去1
-	err = v.objs.IPV6HANDLE_KBPS_DELAY.Put(ipv6MinusOne, hbd)
-	if err != nil {
-		return errors.WithStack(err)
-	}
+func (e *EBPFem) SetBandwidth(source orchestrator.MachineID, target net.IPNet, bandwidthKbits uint64) error {
+	return e.applyNow(source, target, orchestrator.LinkChange{
+		BlockedChanged:   true,
+		BandwidthKbps:    bandwidthKbits,
+		BandwidthChanged: true,
+	})
+}
 
-	return nil
+func (e *EBPFem) SetLatency(source orchestrator.MachineID, target net.IPNet, latency uint32) error {
+	return e.applyNow(source, target, orchestrator.LinkChange{
+		BlockedChanged: true,
+		LatencyUs:      latency,
+		LatencyChanged: true,
+	})
 }
 
 func (e *EBPFem) UnblockLink(source orchestrator.MachineID, target net.IPNet) error {
-	e.RLock()
-	v, ok := e.vms[source]
-	e.RUnlock()
-	if !ok {
-		return errors.Errorf("machine %d-%d does not exist", source.Group, source.Id)
-	}
+	return e.applyNow(source, target, orchestrator.LinkChange{
+		BlockedChanged: true,
+	})
+}
 
-	v.Lock()
-	defer v.Unlock()
+func (e *EBPFem) BlockLink(source orchestrator.MachineID, target net.IPNet) error {
+	return e.applyNow(source, target, orchestrator.LinkChange{
+		Blocked:        true,
+		BlockedChanged: true,
+	})
+}
 
-	hbd := v.getHBD(target)
-	// 处理 IPv4
-	ips, err := parseNetToLongs(target)
+// UpdateLinks stages a batch of link updates for one source machine. The
+// updates are written into the inactive generation of the link tables, with
+// a single BPF_MAP_UPDATE_BATCH per table, and only become visible to the
+// datapath with the next CommitLinks.
+func (e *EBPFem) UpdateLinks(source orchestrator.MachineID, updates []orchestrator.NetLinkUpdate) error {
+	v, err := e.vmFor(source)
 	if err != nil {
-		return errors.WithStack(err)
+		return err
 	}
 
-	for _, ip := range ips {
-		log.Tracef("unblocking for %d", ip)
-		err = v.objs.IP_HANDLE_KBPS_DELAY.Put(ip, hbd)
-		if err != nil {
-			return errors.WithStack(err)
-		}
+	if len(updates) == 0 {
+		return nil
 	}
 
-	// 处理 IPv6
-	ipv6 := net.ParseIP(fmt.Sprintf("fd00::%x:%x:%x:%x", target.IP[0], target.IP[1], target.IP[2], target.IP[3]))
-	err = v.objs.IPV6HANDLE_KBPS_DELAY.Put(ipv6, hbd)
-	if err != nil {
-		return errors.WithStack(err)
-	}
+	v.Lock()
+	defer v.Unlock()
 
-	// 处理另一个地址
-	ipv6MinusOne := ipv6.To16()
-	ipv6MinusOne[15]-- // 减去1
-	err = v.objs.IPV6HANDLE_KBPS_DELAY.Put(ipv6MinusOne, hbd)
-	if err != nil {
-		return errors.WithStack(err)
+	log.Tracef("staging %d link updates for %d-%d", len(updates), source.Group, source.Id)
+
+	return v.stage(updates)
+}
+
+// CommitLinks makes all staged link updates visible by flipping the link
+// table generation of every machine that has staged updates. Each machine
+// switches from the old to the new state at once.
+func (e *EBPFem) CommitLinks() error {
+	e.RLock()
+	defer e.RUnlock()
+
+	for id, v := range e.vms {
+		v.Lock()
+		err := v.commit()
+		v.Unlock()
+
+		if err != nil {
+			return errors.Wrapf(err, "could not commit links for %d-%d", id.Group, id.Id)
+		}
 	}
 
 	return nil
 }
 
-func (e *EBPFem) BlockLink(source orchestrator.MachineID, target net.IPNet) error {
+// LinkStats returns the traffic counters of all links of a source machine
+// that have seen traffic. The counters are kept per CPU in the datapath, we
+// sum them up here. We only look up the links the machine knows about, in
+// shared mode LINK_STATS also holds the links of all other machines. Drops
+// from machines that were never linked, and are blocked by default, are
+// counted in LINK_STATS too but not returned.
+func (e *EBPFem) LinkStats(source orchestrator.MachineID) ([]orchestrator.NetLinkStats, error) {
 	e.RLock()
 	v, ok := e.vms[source]
 	e.RUnlock()
 	if !ok {
-		return errors.Errorf("machine %d-%d does not exist", source.Group, source.Id)
+		return nil, errors.Errorf("machine %d-%d does not exist", source.Group, source.Id)
 	}
 
 	v.Lock()
-	defer v.Unlock()
-
-	// 处理 IPv4
-	ips, err := parseNetToLongs(target)
-	if err != nil {
-		return errors.WithStack(err)
+	indices := make([]uint32, 0, len(v.links))
+	for _, l := range v.links {
+		if index, ok := machineIndex(l.target); ok {
+			indices = append(indices, index)
+		}
 	}
+	v.Unlock()
+
+	stats := make([]orchestrator.NetLinkStats, 0)
+
+	var perCPU []edtLinkStats
+
+	for _, index := range indices {
+		key := edtLinkStatsKey{
+			Ifindex: v.ifindex,
+			Index:   index,
+		}
 
-	for _, ip := range ips {
-		log.Tracef("blocking for %d", ip)
-		err = v.objs.IP_HANDLE_KBPS_DELAY.Put(ip, &handleKbpsDelay{
-			throttleRateKbps: BLOCKED_BANDWIDTH_KBPS,
-			delayUs:          BLOCKED_LATENCY_US,
-		})
+		err := v.objs.LINK_STATS.Lookup(&key, &perCPU)
+		if errors.Is(err, ebpf.ErrKeyNotExist) {
+			// no traffic on this link yet
+			continue
+		}
 		if err != nil {
-			return errors.WithStack(err)
+			return nil, errors.WithStack(err)
 		}
-	}
 
-	// 处理 IPv6
-	ipv6 := net.ParseIP(fmt.Sprintf("fd00::%x:%x:%x:%x", target.IP[0], target.IP[1], target.IP[2], target.IP[3]))
-	err = v.objs.IPV6HANDLE_KBPS_DELAY.Put(ipv6, &handleKbpsDelay{
-		throttleRateKbps: BLOCKED_BANDWIDTH_KBPS,
-		delayUs:          BLOCKED_LATENCY_US,
-	})
-	if err != nil {
-		return errors.WithStack(err)
-	}
+		s := orchestrator.NetLinkStats{
+			Target: machineNet(index),
+		}
 
-	// 处理另一个地址
-	ipv6MinusOne := ipv6.To16()
-	ipv6MinusOne[15]-- // 减去1
-	err = v.objs.IPV6HANDLE_KBPS_DELAY.Put(ipv6MinusOne, &handleKbpsDelay{
-		throttleRateKbps: BLOCKED_BANDWIDTH_KBPS,
-		delayUs:          BLOCKED_LATENCY_US,
-	})
-	if err != nil {
-		return errors.WithStack(err)
+		for _, c := range perCPU {
+			s.Packets += c.Packets
+			s.Bytes += c.Bytes
+			s.Drops += c.Drops
+			s.ECNMarks += c.EcnMarks
+		}
+
+		stats = append(stats, s)
 	}
 
-	return nil
+	return stats, nil
 }
@@ -22,10 +22,13 @@
 package ebpfem
 
 import (
+	"bytes"
+	"encoding/binary"
 	"fmt"
 	"net"
 	"os/exec"
 	"testing"
+	"time"
 
 	"github.com/pkg/errors"
 	log "github.com/sirupsen/logrus"
@@ -165,4 +168,334 @@ func TestBasic(t *testing.T) {
 	if err != nil {
 		t.Fatalf("error blocking link: %s", errors.WithStack(err))
 	}
+
+	// update several links at once
+	err = e.UpdateLinks(id, []orchestrator.NetLinkUpdate{
+		{
+			Target: target,
+			LinkChange: orchestrator.LinkChange{
+				Blocked:          false,
+				BlockedChanged:   true,
+				LatencyUs:        200,
+				LatencyChanged:   true,
+				BandwidthKbps:    1000,
+				BandwidthChanged: true,
+			},
+		},
+		{
+			Target: net.IPNet{
+				IP:   net.IPv4(10, 1, 0, 8),
+				Mask: net.IPv4Mask(255, 255, 255, 252),
+			},
+			LinkChange: orchestrator.LinkChange{
+				Blocked:        true,
+				BlockedChanged: true,
+			},
+		},
+	})
+
+	if err != nil {
+		t.Fatalf("error updating links: %s", errors.WithStack(err))
+	}
+
+	// changing a single link must not publish the staged updates
+	gen := e.vms[id].gen
+
+	err = e.SetLatency(id, net.IPNet{
+		IP:   net.IPv4(10, 1, 0, 12),
+		Mask: net.IPv4Mask(255, 255, 255, 252),
+	}, 100)
+
+	if err != nil {
+		t.Fatalf("error setting latency: %s", errors.WithStack(err))
+	}
+
+	if e.vms[id].gen != gen {
+		t.Fatalf("setting latency committed staged link updates")
+	}
+
+	err = e.CommitLinks()
+
+	if err != nil {
+		t.Fatalf("error committing links: %s", errors.WithStack(err))
+	}
+}
+
+func Test_machineIndex(t *testing.T) {
+	tests := []struct {
+		name   string
+		target net.IPNet
+		want   uint32
+		wantOk bool
+	}{
+		{
+			name: "test1",
+			target: net.IPNet{
+				IP:   net.IPv4(10, 1, 0, 6),
+				Mask: net.CIDRMask(30, 32),
+			},
+			want:   1<<REACHABLE_GROUP_SHIFT | 1,
+			wantOk: true,
+		},
+		{
+			name: "test2",
+			target: net.IPNet{
+				IP:   net.IPv4(10, 0, 1, 10),
+				Mask: net.CIDRMask(30, 32),
+			},
+			want:   66,
+			wantOk: true,
+		},
+		{
+			name: "test3",
+			target: net.IPNet{
+				IP:   net.IPv4(10, REACHABLE_MAX_GROUPS, 0, 6),
+				Mask: net.CIDRMask(30, 32),
+			},
+			wantOk: false,
+		},
+		{
+			name: "test4",
+			target: net.IPNet{
+				IP:   net.IPv4(192, 168, 0, 6),
+				Mask: net.CIDRMask(30, 32),
+			},
+			wantOk: false,
+		},
+	}
+	for _, tt := range tests {
+		t.Run(tt.name, func(t *testing.T) {
+			got, ok := machineIndex(tt.target)
+			if ok != tt.wantOk {
+				t.Fatalf("machineIndex() ok = %v, want %v", ok, tt.wantOk)
+			}
+			if ok && got != tt.want {
+				t.Errorf("machineIndex() got = %v, want %v", got, tt.want)
+			}
+			if ok && !machineNet(got).IP.Equal(tt.target.IP) {
+				t.Errorf("machineNet() got = %v, want %v", machineNet(got).IP, tt.target.IP)
+			}
+		})
+	}
+}
+
+// verdicts of our programs, see linux/pkt_cls.h
+const (
+	tcActOk       = 0
+	tcActShot     = 2
+	tcActRedirect = 7
+)
+
+// benchPacket is an Ethernet frame with a UDP packet from source.
+func benchPacket(source net.IP) []byte {
+	const payload = 64
+
+	p := make([]byte, 14+20+8+payload)
+
+	// Ethernet: the addresses do not matter, the type is IPv4
+	binary.BigEndian.PutUint16(p[12:14], 0x0800)
+
+	ip := p[14:34]
+	ip[0] = 0x45
+	binary.BigEndian.PutUint16(ip[2:4], uint16(20+8+payload))
+	ip[8] = 64
+	ip[9] = 17 // UDP
+	copy(ip[12:16], source.To4())
+	copy(ip[16:20], net.IPv4(10, 1, 0, 2).To4())
+
+	udp := p[34:42]
+	binary.BigEndian.PutUint16(udp[0:2], 1969)
+	binary.BigEndian.PutUint16(udp[2:4], 1969)
+	binary.BigEndian.PutUint16(udp[4:6], uint16(8+payload))
+
+	return p
+}
+
+// BenchmarkTcMain runs tc_main with BPF_PROG_TEST_RUN on a packet from a peer
+// machine and reports the time per packet and packets per second. The
+// program runs on the loopback device, so the link tables are keyed by its
+// ifindex.
+func BenchmarkTcMain(b *testing.B) {
+	self := orchestrator.MachineID{Group: 1, Id: 0}
+	peer := orchestrator.MachineID{Group: 1, Id: 1}
+
+	benchmarks := []struct {
+		name string
+		link *orchestrator.LinkChange
+		// want is the expected verdict, -1 if it may change
+		want int
+	}{
+		{
+			name: "blocked",
+			want: tcActShot,
+		},
+		{
+			name: "delay",
+			link: &orchestrator.LinkChange{
+				BlockedChanged:   true,
+				LatencyUs:        10_000,
+				LatencyChanged:   true,
+				BandwidthKbps:    UNLIMITED_BANDWIDTH_KBPS,
+				BandwidthChanged: true,
+			},
+			want: tcActOk,
+		},
+		{
+			// packets are paced, until they are too far in the future and
+			// dropped at the time horizon
+			name: "paced",
+			link: &orchestrator.LinkChange{
+				BlockedChanged:   true,
+				LatencyUs:        10_000,
+				LatencyChanged:   true,
+				BandwidthKbps:    DEFAULT_BANDWIDTH_KBPS,
+				BandwidthChanged: true,
+			},
+			want: -1,
+		},
+	}
+
+	for _, shared := range []bool{false, true} {
+		for _, bm := range benchmarks {
+			b.Run(fmt.Sprintf("%s-shared=%t", bm.name, shared), func(b *testing.B) {
+				c := DefaultConfig()
+				c.Shared = shared
+
+				objs, err := loadObjects(c, nil)
+				if err != nil {
+					b.Fatal(err)
+				}
+				defer objs.Close()
+
+				v := &vm{
+					objs:      objs,
+					shared:    shared,
+					ifindex:   1,
+					links:     make(map[string]*link),
+					reachable: make(map[uint32]uint64),
+					behind:    newDirty(),
+					staged:    newDirty(),
+				}
+
+				err = v.allowSelf(idNet(self))
+				if err != nil {
+					b.Fatal(err)
+				}
+
+				if bm.link != nil {
+					err = v.stage([]orchestrator.NetLinkUpdate{{Target: idNet(peer), LinkChange: *bm.link}})
+					if err != nil {
+						b.Fatal(err)
+					}
+
+					err = v.commit()
+					if err != nil {
+						b.Fatal(err)
+					}
+				}
+
+				b.ResetTimer()
+
+				ret, perPacket, err := objs.TcMain.Benchmark(benchPacket(idNet(peer).IP), b.N, nil)
+
+				b.StopTimer()
+
+				if err != nil {
+					b.Fatal(err)
+				}
+
+				if bm.want >= 0 && ret != uint32(bm.want) {
+					b.Fatalf("tc_main returned %d, want %d", ret, bm.want)
+				}
+
+				b.ReportMetric(float64(perPacket.Nanoseconds()), "ns/packet")
+				if perPacket > 0 {
+					b.ReportMetric(float64(time.Second)/float64(perPacket), "packets/s")
+				}
+			})
+		}
+	}
+}
+
+// Test_tcRedirect runs tc_redirect with BPF_PROG_TEST_RUN on packets to a
+// machine on this host and to one that is not.
+func Test_tcRedirect(t *testing.T) {
+	local := orchestrator.MachineID{Group: 1, Id: 0}
+	source := idNet(orchestrator.MachineID{Group: 1, Id: 1}).IP
+
+	c := DefaultConfig()
+	c.Redirect = true
+
+	redirect, err := newRedirectMap()
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer redirect.Close()
+
+	objs, err := loadObjects(c, redirect)
+	if err != nil {
+		t.Fatal(err)
+	}
+	defer objs.Close()
+
+	target := edtRedirectTarget{
+		Ifindex: 1,
+		Mac:     [6]uint8{0xaa, 0xce, 0x01, 0x00, 0x00, 0x02},
+		TapMac:  [6]uint8{0x02, 0x00, 0x00, 0x00, 0x00, 0x01},
+	}
+
+	// benchPacket is addressed to local
+	ret, _, err := objs.TcRedirect.Test(benchPacket(source))
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	if ret != tcActOk {
+		t.Fatalf("tc_redirect returned %d for a machine on another host, want %d", ret, tcActOk)
+	}
+
+	err = redirect.Put(redirectIndex(local), target)
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	in := benchPacket(source)
+	binary.BigEndian.PutUint16(in[14+10:14+12], ^onesComplementSum(in[14:34]))
+
+	ret, out, err := objs.TcRedirect.Test(in)
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	if ret != tcActRedirect {
+		t.Fatalf("tc_redirect returned %d for a machine on this host, want %d", ret, tcActRedirect)
+	}
+
+	if !bytes.Equal(out[0:6], target.Mac[:]) || !bytes.Equal(out[6:12], target.TapMac[:]) {
+		t.Errorf("got addresses %x -> %x, want %x -> %x", out[6:12], out[0:6], target.TapMac, target.Mac)
+	}
+
+	// the TTL is decremented and the checksum still adds up
+	if out[14+8] != 63 {
+		t.Errorf("got TTL %d, want 63", out[14+8])
+	}
+
+	if sum := onesComplementSum(out[14:34]); sum != 0xffff {
+		t.Errorf("IPv4 header checksum does not add up after the TTL decrement, sum is %#x", sum)
+	}
+}
+
+// onesComplementSum is the Internet checksum sum of a header, it is 0xffff
+// for a header with a correct checksum.
+func onesComplementSum(h []byte) uint16 {
+	var sum uint32
+	for i := 0; i+1 < len(h); i += 2 {
+		sum += uint32(binary.BigEndian.Uint16(h[i : i+2]))
+	}
+
+	for sum > 0xffff {
+		sum = sum&0xffff + sum>>16
+	}
+
+	return uint16(sum)
 }
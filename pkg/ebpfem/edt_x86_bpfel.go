@@ -15,9 +15,43 @@ import (
 type edtHandleKbpsDelay struct {
 	ThrottleRateKbps uint32
 	DelayUs          uint32
+	LastTstamp       uint64
 }
 
-type edtIn6Addr struct{ In6U struct{ U6Addr8 [16]uint8 } }
+type edtIpv4LpmKey struct {
+	Prefixlen uint32
+	Ifindex   uint32
+	Addr      uint32
+}
+
+type edtIpv6LpmKey struct {
+	Prefixlen uint32
+	Ifindex   uint32
+	Addr      struct{ In6U struct{ U6Addr8 [16]uint8 } }
+}
+
+type edtLinkStats struct {
+	Packets  uint64
+	Bytes    uint64
+	Drops    uint64
+	EcnMarks uint64
+}
+
+type edtLinkStatsKey struct {
+	Ifindex uint32
+	Index   uint32
+}
+
+type edtReachableKey struct {
+	Ifindex uint32
+	Word    uint32
+}
+
+type edtRedirectTarget struct {
+	Ifindex uint32
+	Mac     [6]uint8
+	TapMac  [6]uint8
+}
 
 // loadEdt returns the embedded CollectionSpec for edt.
 func loadEdt() (*ebpf.CollectionSpec, error) {
@@ -60,17 +94,25 @@ type edtSpecs struct {
 //
 // It can be passed ebpf.CollectionSpec.Assign.
 type edtProgramSpecs struct {
-	TcMain *ebpf.ProgramSpec `ebpf:"tc_main"`
+	TcMain     *ebpf.ProgramSpec `ebpf:"tc_main"`
+	TcRedirect *ebpf.ProgramSpec `ebpf:"tc_redirect"`
 }
 
 // edtMapSpecs contains maps before they are loaded into the kernel.
 //
 // It can be passed ebpf.CollectionSpec.Assign.
 type edtMapSpecs struct {
-	IPV6HANDLE_KBPS_DELAY *ebpf.MapSpec `ebpf:"IPV6_HANDLE_KBPS_DELAY"`
-	IP_HANDLE_KBPS_DELAY  *ebpf.MapSpec `ebpf:"IP_HANDLE_KBPS_DELAY"`
-	Ipv4FlowMap           *ebpf.MapSpec `ebpf:"ipv4_flow_map"`
-	Ipv6FlowMap           *ebpf.MapSpec `ebpf:"ipv6_flow_map"`
+	IPV6HANDLE_KBPS_DELAY_0 *ebpf.MapSpec `ebpf:"IPV6_HANDLE_KBPS_DELAY_0"`
+	IPV6HANDLE_KBPS_DELAY_1 *ebpf.MapSpec `ebpf:"IPV6_HANDLE_KBPS_DELAY_1"`
+	IP_HANDLE_KBPS_DELAY_0  *ebpf.MapSpec `ebpf:"IP_HANDLE_KBPS_DELAY_0"`
+	IP_HANDLE_KBPS_DELAY_1  *ebpf.MapSpec `ebpf:"IP_HANDLE_KBPS_DELAY_1"`
+	LINK_GENERATION         *ebpf.MapSpec `ebpf:"LINK_GENERATION"`
+	LINK_PACING             *ebpf.MapSpec `ebpf:"LINK_PACING"`
+	LINK_STATS              *ebpf.MapSpec `ebpf:"LINK_STATS"`
+	REACHABLE_SET           *ebpf.MapSpec `ebpf:"REACHABLE_SET"`
+	REACHABLE_SET_SHARED    *ebpf.MapSpec `ebpf:"REACHABLE_SET_SHARED"`
+	REDIRECT_TARGETS        *ebpf.MapSpec `ebpf:"REDIRECT_TARGETS"`
+	VM_GENERATION           *ebpf.MapSpec `ebpf:"VM_GENERATION"`
 }
 
 // edtObjects contains all objects after they have been loaded into the kernel.
@@ -92,18 +134,32 @@ func (o *edtObjects) Close() error {
 //
 // It can be passed to loadEdtObjects or ebpf.CollectionSpec.LoadAndAssign.
 type edtMaps struct {
-	IPV6HANDLE_KBPS_DELAY *ebpf.Map `ebpf:"IPV6_HANDLE_KBPS_DELAY"`
-	IP_HANDLE_KBPS_DELAY  *ebpf.Map `ebpf:"IP_HANDLE_KBPS_DELAY"`
-	Ipv4FlowMap           *ebpf.Map `ebpf:"ipv4_flow_map"`
-	Ipv6FlowMap           *ebpf.Map `ebpf:"ipv6_flow_map"`
+	IPV6HANDLE_KBPS_DELAY_0 *ebpf.Map `ebpf:"IPV6_HANDLE_KBPS_DELAY_0"`
+	IPV6HANDLE_KBPS_DELAY_1 *ebpf.Map `ebpf:"IPV6_HANDLE_KBPS_DELAY_1"`
+	IP_HANDLE_KBPS_DELAY_0  *ebpf.Map `ebpf:"IP_HANDLE_KBPS_DELAY_0"`
+	IP_HANDLE_KBPS_DELAY_1  *ebpf.Map `ebpf:"IP_HANDLE_KBPS_DELAY_1"`
+	LINK_GENERATION         *ebpf.Map `ebpf:"LINK_GENERATION"`
+	LINK_PACING             *ebpf.Map `ebpf:"LINK_PACING"`
+	LINK_STATS              *ebpf.Map `ebpf:"LINK_STATS"`
+	REACHABLE_SET           *ebpf.Map `ebpf:"REACHABLE_SET"`
+	REACHABLE_SET_SHARED    *ebpf.Map `ebpf:"REACHABLE_SET_SHARED"`
+	REDIRECT_TARGETS        *ebpf.Map `ebpf:"REDIRECT_TARGETS"`
+	VM_GENERATION           *ebpf.Map `ebpf:"VM_GENERATION"`
 }
 
 func (m *edtMaps) Close() error {
 	return _EdtClose(
-		m.IPV6HANDLE_KBPS_DELAY,
-		m.IP_HANDLE_KBPS_DELAY,
-		m.Ipv4FlowMap,
-		m.Ipv6FlowMap,
+		m.IPV6HANDLE_KBPS_DELAY_0,
+		m.IPV6HANDLE_KBPS_DELAY_1,
+		m.IP_HANDLE_KBPS_DELAY_0,
+		m.IP_HANDLE_KBPS_DELAY_1,
+		m.LINK_GENERATION,
+		m.LINK_PACING,
+		m.LINK_STATS,
+		m.REACHABLE_SET,
+		m.REACHABLE_SET_SHARED,
+		m.REDIRECT_TARGETS,
+		m.VM_GENERATION,
 	)
 }
 
@@ -111,12 +167,14 @@ func (m *edtMaps) Close() error {
 //
 // It can be passed to loadEdtObjects or ebpf.CollectionSpec.LoadAndAssign.
 type edtPrograms struct {
-	TcMain *ebpf.Program `ebpf:"tc_main"`
+	TcMain     *ebpf.Program `ebpf:"tc_main"`
+	TcRedirect *ebpf.Program `ebpf:"tc_redirect"`
 }
 
 func (p *edtPrograms) Close() error {
 	return _EdtClose(
 		p.TcMain,
+		p.TcRedirect,
 	)
 }
 
@@ -0,0 +1,339 @@
+//go:build linux && amd64
+// +build linux,amd64
+
+/*
+* This file is part of Celestial (https://github.com/OpenFogStack/celestial).
+* Copyright (c) 2024 Soeren Becker, Nils Japke, Tobias Pfandzelter, The
+* OpenFogStack Team.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, version 3.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+**/
+
+package ebpfem
+
+import (
+	"net"
+
+	"github.com/cilium/ebpf"
+	"github.com/pkg/errors"
+	log "github.com/sirupsen/logrus"
+
+	"github.com/OpenFogStack/celestial/pkg/orchestrator"
+)
+
+// Link updates are double-buffered: there are two generations of the link
+// tables and the reachable set, and the datapath reads through the one in
+// LINK_GENERATION. stage writes changes into the inactive generation, commit
+// flips LINK_GENERATION. A failed or ongoing update is thus never visible to
+// packets. Since the inactive generation is one commit behind, stage also
+// rewrites everything that changed with the last commit.
+
+func newDirty() dirty {
+	return dirty{
+		links: make(map[string]struct{}),
+		words: make(map[uint32]struct{}),
+	}
+}
+
+func (d dirty) empty() bool {
+	return len(d.links) == 0 && len(d.words) == 0
+}
+
+func (d dirty) add(o dirty) {
+	for k := range o.links {
+		d.links[k] = struct{}{}
+	}
+
+	for w := range o.words {
+		d.words[w] = struct{}{}
+	}
+}
+
+func (v *vm) getLink(target net.IPNet) *link {
+	l, ok := v.links[target.String()]
+	if ok {
+		return l
+	}
+
+	// links are blocked until they are unblocked
+	l = &link{
+		target: target,
+		hbd: handleKbpsDelay{
+			throttleRateKbps: DEFAULT_BANDWIDTH_KBPS,
+			delayUs:          DEFAULT_LATENCY_US,
+		},
+		blocked: true,
+	}
+
+	v.links[target.String()] = l
+
+	return l
+}
+
+// setReachable sets or clears the bit of a machine in our copy of the
+// reachable set. Returns true if the bit changed, in which case its word needs
+// to be written to the REACHABLE_SET map.
+func (v *vm) setReachable(index uint32, reachable bool) bool {
+	word, bit := index/64, uint64(1)<<(index%64)
+
+	old := v.reachable[word]
+	if reachable {
+		v.reachable[word] = old | bit
+	} else {
+		v.reachable[word] = old &^ bit
+	}
+
+	return v.reachable[word] != old
+}
+
+// allowSelf makes the machine's own network, i.e., its gateway on the host,
+// reachable in both generations. Traffic from there is not shaped.
+func (v *vm) allowSelf(self net.IPNet) error {
+	l := v.getLink(self)
+	l.blocked = false
+	l.hbd = handleKbpsDelay{
+		throttleRateKbps: UNLIMITED_BANDWIDTH_KBPS,
+	}
+
+	d := newDirty()
+	d.links[self.String()] = struct{}{}
+
+	if index, ok := machineIndex(self); ok && v.setReachable(index, true) {
+		d.words[index/64] = struct{}{}
+	}
+
+	for gen := uint32(0); gen < 2; gen++ {
+		err := v.write(gen, d)
+		if err != nil {
+			return errors.WithStack(err)
+		}
+	}
+
+	return nil
+}
+
+// apply applies link updates to our copy of the link state and returns what
+// needs to be written into the link tables.
+func (v *vm) apply(updates []orchestrator.NetLinkUpdate) dirty {
+	d := newDirty()
+
+	for _, u := range updates {
+		l := v.getLink(u.Target)
+
+		if u.BlockedChanged {
+			l.blocked = u.Blocked
+		}
+
+		if u.LatencyChanged {
+			l.hbd.delayUs = u.LatencyUs
+		}
+
+		if u.BandwidthChanged {
+			l.hbd.throttleRateKbps = uint32(u.BandwidthKbps)
+		}
+
+		d.links[u.Target.String()] = struct{}{}
+
+		if index, ok := machineIndex(u.Target); ok && v.setReachable(index, !l.blocked) {
+			d.words[index/64] = struct{}{}
+		}
+	}
+
+	return d
+}
+
+// stage applies link updates to our copy of the link state and writes them
+// into the inactive generation.
+func (v *vm) stage(updates []orchestrator.NetLinkUpdate) error {
+	d := v.apply(updates)
+
+	v.staged.add(d)
+
+	// the inactive generation also misses everything from the last commit
+	d.add(v.behind)
+
+	err := v.write(1-v.gen, d)
+	if err != nil {
+		// rewrite all of it next time
+		v.behind.add(d)
+		v.stageFailed = true
+		return errors.WithStack(err)
+	}
+
+	v.behind = newDirty()
+	v.stageFailed = false
+
+	return nil
+}
+
+// applyNow applies link updates to our copy of the link state and writes them
+// into both generations, so they are visible right away without a commit that
+// would also publish what is staged. Only staged changes of the same links
+// become visible with them.
+func (v *vm) applyNow(updates []orchestrator.NetLinkUpdate) error {
+	d := v.apply(updates)
+
+	for _, gen := range []uint32{v.gen, 1 - v.gen} {
+		err := v.write(gen, d)
+		if err != nil {
+			// rewrite it into the inactive generation with the next stage and
+			// into the other one after the next commit, which waits for that
+			v.behind.add(d)
+			v.staged.add(d)
+			v.stageFailed = true
+			return errors.WithStack(err)
+		}
+	}
+
+	return nil
+}
+
+// commit makes the inactive generation the active one.
+func (v *vm) commit() error {
+	if v.staged.empty() {
+		return nil
+	}
+
+	if v.stageFailed {
+		return errors.New("inactive link table generation is incomplete, not committing")
+	}
+
+	next := 1 - v.gen
+
+	var err error
+	if v.shared {
+		err = v.objs.VM_GENERATION.Put(v.ifindex, next)
+	} else {
+		err = v.objs.LINK_GENERATION.Put(uint32(0), next)
+	}
+	if err != nil {
+		return errors.WithStack(err)
+	}
+
+	v.gen = next
+
+	// the now inactive generation misses what we just committed
+	v.behind = v.staged
+	v.staged = newDirty()
+
+	return nil
+}
+
+// write writes links and reachable set words from our copy of the link state
+// into a generation of the link tables.
+func (v *vm) write(gen uint32, d dirty) error {
+	ipv4Keys := make([]ipv4LpmKey, 0, len(d.links))
+	ipv6Keys := make([]ipv6LpmKey, 0, len(d.links))
+	hbds := make([]handleKbpsDelay, 0, len(d.links))
+
+	for k := range d.links {
+		l := v.links[k]
+
+		// dropped by the reachable set, the link table entry is not used
+		if _, inReachableSet := machineIndex(l.target); l.blocked && inReachableSet {
+			continue
+		}
+
+		ipv4Key, ipv6Key, err := parseNetToKeys(v.ifindex, l.target)
+		if err != nil {
+			return errors.WithStack(err)
+		}
+
+		ipv4Keys = append(ipv4Keys, ipv4Key)
+		ipv6Keys = append(ipv6Keys, ipv6Key)
+
+		if l.blocked {
+			hbds = append(hbds, handleKbpsDelay{
+				throttleRateKbps: BLOCKED_BANDWIDTH_KBPS,
+				delayUs:          BLOCKED_LATENCY_US,
+			})
+			continue
+		}
+
+		hbds = append(hbds, l.hbd)
+	}
+
+	log.Tracef("writing %d links and %d reachable set words into generation %d", len(hbds), len(d.words), gen)
+
+	ipv4Table, ipv6Table := v.objs.IP_HANDLE_KBPS_DELAY_0, v.objs.IPV6HANDLE_KBPS_DELAY_0
+	if gen == 1 {
+		ipv4Table, ipv6Table = v.objs.IP_HANDLE_KBPS_DELAY_1, v.objs.IPV6HANDLE_KBPS_DELAY_1
+	}
+
+	if len(hbds) > 0 {
+		err := putBatch(ipv4Table, ipv4Keys, hbds)
+		if err != nil {
+			return errors.WithStack(err)
+		}
+
+		err = putBatch(ipv6Table, ipv6Keys, hbds)
+		if err != nil {
+			return errors.WithStack(err)
+		}
+	}
+
+	if len(d.words) > 0 {
+		words := make([]uint32, 0, len(d.words))
+		bits := make([]uint64, 0, len(d.words))
+
+		for w := range d.words {
+			words = append(words, gen*REACHABLE_WORDS+w)
+			bits = append(bits, v.reachable[w])
+		}
+
+		var err error
+		if v.shared {
+			keys := make([]reachableKey, len(words))
+			for i, w := range words {
+				keys[i] = reachableKey{
+					ifindex: v.ifindex,
+					word:    w,
+				}
+			}
+
+			err = putBatch(v.objs.REACHABLE_SET_SHARED, keys, bits)
+		} else {
+			err = putBatch(v.objs.REACHABLE_SET, words, bits)
+		}
+		if err != nil {
+			return errors.WithStack(err)
+		}
+	}
+
+	return nil
+}
+
+// putBatch writes all keys and values into a map in one batch. Should the
+// kernel not support batch operations on the map, we fall back to updating
+// one element at a time.
+func putBatch[K, V any](m *ebpf.Map, keys []K, values []V) error {
+	_, err := m.BatchUpdate(keys, values, nil)
+	if err == nil {
+		return nil
+	}
+
+	if !errors.Is(err, ebpf.ErrNotSupported) {
+		return errors.WithStack(err)
+	}
+
+	log.Tracef("batch update not supported, falling back to single updates")
+
+	for i := range keys {
+		err = m.Put(keys[i], values[i])
+		if err != nil {
+			return errors.WithStack(err)
+		}
+	}
+
+	return nil
+}
@@ -22,7 +22,12 @@
 package ebpfem
 
 import (
+	"math"
+	"net"
 	"sync"
+	"time"
+
+	"github.com/cilium/ebpf"
 
 	"github.com/OpenFogStack/celestial/pkg/orchestrator"
 )
@@ -33,11 +38,99 @@ const (
 
 	BLOCKED_LATENCY_US     = 1_000_000_000
 	BLOCKED_BANDWIDTH_KBPS = 0
+
+	// effectively no pacing, the departure delay of a packet rounds to 0
+	UNLIMITED_BANDWIDTH_KBPS = math.MaxUint32
 )
 
+// keep in sync with maps.h
+const (
+	REACHABLE_MAX_GROUPS  = 16
+	REACHABLE_GROUP_SHIFT = 14
+	REACHABLE_WORDS       = (REACHABLE_MAX_GROUPS << REACHABLE_GROUP_SHIFT) / 64
+)
+
+// handleKbpsDelay mirrors struct handle_kbps_delay in maps.h. lastTstamp is
+// pacing state owned by the datapath, we always write it as zero. Links to
+// machines are paced through LINK_PACING instead, so rewriting them does not
+// reset their pacing.
 type handleKbpsDelay struct {
 	throttleRateKbps uint32
 	delayUs          uint32
+	lastTstamp       uint64
+}
+
+// Config selects the variant of the eBPF program that is loaded. The options
+// are passed as constants, so that the verifier can prune what is switched
+// off from the per-packet path.
+type Config struct {
+	// Shared loads one program and map set for all machines on the host
+	Shared bool
+	// IPv4 and IPv6 select the address families that are shaped, traffic of
+	// the other family passes unchanged
+	IPv4 bool
+	IPv6 bool
+	// Delay enables latency injection, otherwise only bandwidth is emulated
+	Delay bool
+	// TimeHorizon is how far into the future packets may be scheduled before
+	// they are dropped
+	TimeHorizon time.Duration
+	// ECNHorizon is how far into the future packets may be scheduled before
+	// they are ECN marked, 0 disables marking
+	ECNHorizon time.Duration
+	// Redirect forwards traffic between machines on the host from tap to tap
+	// in the datapath, instead of through the host network stack
+	Redirect bool
+}
+
+// DefaultConfig shapes IPv4 and IPv6 with latency and bandwidth, and does not
+// ECN mark.
+func DefaultConfig() Config {
+	return Config{
+		IPv4:        true,
+		IPv6:        true,
+		Delay:       true,
+		TimeHorizon: 2 * time.Second,
+	}
+}
+
+// link tables and counters are sized for all links of all machines on a
+// host in shared mode
+const SHARED_MAX_LINKS = 1 << 22
+
+// ipv4LpmKey mirrors struct ipv4_lpm_key in maps.h, addr is in network byte
+// order.
+type ipv4LpmKey struct {
+	prefixLen uint32
+	ifindex   uint32
+	addr      [4]byte
+}
+
+// ipv6LpmKey mirrors struct ipv6_lpm_key in maps.h.
+type ipv6LpmKey struct {
+	prefixLen uint32
+	ifindex   uint32
+	addr      [16]byte
+}
+
+// reachableKey mirrors struct reachable_key in maps.h.
+type reachableKey struct {
+	ifindex uint32
+	word    uint32
+}
+
+// link is our copy of the state of a link, keyed by its target network.
+type link struct {
+	target  net.IPNet
+	hbd     handleKbpsDelay
+	blocked bool
+}
+
+// dirty is a set of links (by target network) and reachable set words that
+// need to be written into a generation of the link tables.
+type dirty struct {
+	links map[string]struct{}
+	words map[uint32]struct{}
 }
 
 type vm struct {
@@ -45,12 +138,38 @@ type vm struct {
 
 	// ebpf specific
 	objs *edtObjects
-	hbd  map[string]*handleKbpsDelay
+	// objs are shared with all other machines
+	shared  bool
+	ifindex uint32
+
+	// our copy of the link state, the link tables and the reachable set are
+	// written from this
+	links map[string]*link
+	// our copy of the REACHABLE_SET bitmap, word index to bits
+	reachable map[uint32]uint64
+
+	// generation of the link tables the datapath currently reads
+	gen uint32
+	// behind is what the inactive generation is missing compared to the
+	// active one, staged is what has been written into the inactive
+	// generation since the last commit
+	behind dirty
+	staged dirty
+	// stageFailed is set when the inactive generation is partially written
+	stageFailed bool
 
 	sync.Mutex
 }
 
 type EBPFem struct {
 	vms map[orchestrator.MachineID]*vm
+
+	config Config
+
+	// in shared mode, all machines use the same objs
+	objs *edtObjects
+	// REDIRECT_TARGETS of all objs, if redirect is enabled
+	redirect *ebpf.Map
+
 	sync.RWMutex
 }
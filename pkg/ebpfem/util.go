@@ -24,69 +24,185 @@ package ebpfem
 //Adapted from: https://github.com/srnbckr/ebpf-network-emulation/blob/main/internal/utils/tc_helpers.go
 
 import (
-	"bytes"
-	"encoding/binary"
 	"net"
 
+	"github.com/cilium/ebpf"
 	"github.com/pkg/errors"
 	log "github.com/sirupsen/logrus"
 	"github.com/vishvananda/netlink"
 	"golang.org/x/sys/unix"
+
+	"github.com/OpenFogStack/celestial/pkg/orchestrator"
 )
 
-func incrementIP(ip net.IP) {
-	for j := len(ip) - 1; j >= 0; j-- {
-		ip[j]++
-		if ip[j] > 0 {
-			break
-		}
+// boolToConst converts a flag into a constant for our eBPF program.
+func boolToConst(b bool) uint32 {
+	if b {
+		return 1
 	}
+	return 0
 }
 
-func parseIPToLong(ip net.IP) (uint32, error) {
-	var l uint32
-	err := binary.Read(bytes.NewBuffer(ip.To4()), binary.LittleEndian, &l)
+// loadObjects loads the variant of our eBPF program and maps selected by the
+// config, either for a single machine or shared by all machines on the host.
+// If redirect is enabled, the objects use redirect as their REDIRECT_TARGETS.
+func loadObjects(c Config, redirect *ebpf.Map) (*edtObjects, error) {
+	if !c.IPv4 && !c.IPv6 {
+		return nil, errors.New("at least one of IPv4 and IPv6 must be enabled")
+	}
+
+	if c.TimeHorizon <= 0 {
+		return nil, errors.Errorf("time horizon must be positive, is %s", c.TimeHorizon)
+	}
+
+	if c.ECNHorizon < 0 || c.ECNHorizon >= c.TimeHorizon {
+		return nil, errors.Errorf("ECN horizon %s must be between 0 and the time horizon %s", c.ECNHorizon, c.TimeHorizon)
+	}
+
+	spec, err := loadEdt()
 	if err != nil {
-		return 0, errors.Wrap(err, "cannot convert IP to uint32")
+		return nil, errors.WithStack(err)
 	}
-	return l, nil
-}
 
-// parseNetToLongs parses IP address from net.IP into []uint32 (with reversed order), returning all
-// IPs in the subnet. We need these as keys in our eBPF map.
-func parseNetToLongs(target net.IPNet) ([]uint32, error) {
-	var longs []uint32
+	err = spec.RewriteConstants(map[string]interface{}{
+		"SHARED_MODE":     boolToConst(c.Shared),
+		"ENABLE_IPV4":     boolToConst(c.IPv4),
+		"ENABLE_IPV6":     boolToConst(c.IPv6),
+		"ENABLE_DELAY":    boolToConst(c.Delay),
+		"TIME_HORIZON_NS": uint64(c.TimeHorizon.Nanoseconds()),
+		"ECN_HORIZON_NS":  uint64(c.ECNHorizon.Nanoseconds()),
+	})
+	if err != nil {
+		return nil, errors.WithStack(err)
+	}
 
-	// Get the start and end IP addresses in the subnet
-	startIP := target.IP.Mask(target.Mask)
-	endIP := make(net.IP, len(startIP))
-	copy(endIP, startIP)
+	if c.Shared {
+		for _, m := range []string{"IP_HANDLE_KBPS_DELAY_0", "IP_HANDLE_KBPS_DELAY_1", "IPV6_HANDLE_KBPS_DELAY_0", "IPV6_HANDLE_KBPS_DELAY_1", "LINK_STATS", "LINK_PACING"} {
+			spec.Maps[m].MaxEntries = SHARED_MAX_LINKS
+		}
 
-	// Magic generated by ChatGPT
-	for i := range endIP {
-		endIP[i] |= ^target.Mask[i]
+		// not used in shared mode
+		spec.Maps["REACHABLE_SET"].MaxEntries = 1
+	} else {
+		// only used in shared mode
+		spec.Maps["VM_GENERATION"].MaxEntries = 1
+		spec.Maps["REACHABLE_SET_SHARED"].MaxEntries = 1
 	}
 
-	// Iterate through all IP addresses in the subnet and add them to the slice
-	for ip := startIP; !ip.Equal(endIP); incrementIP(ip) {
-		l, err := parseIPToLong(ip)
-		if err != nil {
-			return nil, errors.Wrap(err, "cannot convert IP to uint32")
+	var opts *ebpf.CollectionOptions
+
+	if c.Redirect {
+		if redirect == nil {
+			return nil, errors.New("redirect is enabled but there is no redirect map")
+		}
+
+		opts = &ebpf.CollectionOptions{
+			MapReplacements: map[string]*ebpf.Map{
+				"REDIRECT_TARGETS": redirect,
+			},
 		}
-		longs = append(longs, l)
-		//log.Tracef("Added IP %s as long %d", ip.String(), l)
+	} else {
+		// only used with redirect
+		spec.Maps["REDIRECT_TARGETS"].MaxEntries = 1
+	}
+
+	objs := &edtObjects{}
+
+	err = spec.LoadAndAssign(objs, opts)
+	if err != nil {
+		return nil, errors.WithStack(err)
+	}
+
+	return objs, nil
+}
+
+// parseNetToKeys converts a target network into the keys of our IPv4 and IPv6
+// LPM trie link tables for a tap. The IPv6 network is the IPv4 network
+// embedded into fd00::/64 (see getNet in pkg/virt), i.e., a /30 becomes a
+// /126.
+func parseNetToKeys(ifindex uint32, target net.IPNet) (ipv4LpmKey, ipv6LpmKey, error) {
+	ip := target.IP.Mask(target.Mask).To4()
+
+	if ip == nil {
+		return ipv4LpmKey{}, ipv6LpmKey{}, errors.Errorf("%s is not an IPv4 network", target.String())
 	}
 
-	// Add the last IP address in the subnet
-	l, err := parseIPToLong(endIP)
+	ones, bits := target.Mask.Size()
+
+	if bits != 32 {
+		return ipv4LpmKey{}, ipv6LpmKey{}, errors.Errorf("%s does not have an IPv4 mask", target.String())
+	}
+
+	// the ifindex is always matched in full
+	k4 := ipv4LpmKey{
+		prefixLen: uint32(32 + ones),
+		ifindex:   ifindex,
+	}
+	copy(k4.addr[:], ip)
+
+	// fd00::[a]:[b]:[c]:[d], each byte of the IPv4 address is its own group
+	k6 := ipv6LpmKey{
+		prefixLen: uint32(32 + ones + 96),
+		ifindex:   ifindex,
+	}
+	k6.addr[0] = 0xfd
+	for i := 0; i < 4; i++ {
+		k6.addr[8+2*i+1] = ip[i]
+	}
+
+	return k4, k6, nil
+}
+
+// machineIndex returns the index of the machine owning the target network in
+// the reachable set. The second return value is false if the machine is not
+// covered by the reachable set.
+func machineIndex(target net.IPNet) (uint32, bool) {
+	ip := target.IP.To4()
+
+	if ip == nil || ip[0] != 10 || ip[1] >= REACHABLE_MAX_GROUPS {
+		return 0, false
+	}
+
+	// 10.[group].[id>>6].[id<<2], see getNet in pkg/virt
+	return uint32(ip[1])<<REACHABLE_GROUP_SHIFT | uint32(ip[2])<<6 | uint32(ip[3])>>2, true
+}
+
+// machineNet is the inverse of machineIndex, it returns the network of the
+// machine with the given index in the same form as the targets we get.
+func machineNet(index uint32) net.IPNet {
+	return idNet(orchestrator.MachineID{
+		Group: uint8(index >> REACHABLE_GROUP_SHIFT),
+		Id:    index & (1<<REACHABLE_GROUP_SHIFT - 1),
+	})
+}
+
+// idNet returns the network of a machine, see getNet in pkg/virt.
+func idNet(id orchestrator.MachineID) net.IPNet {
+	return net.IPNet{
+		IP:   net.IP{10, id.Group, byte(id.Id >> 6), byte(id.Id<<2) + 2},
+		Mask: net.CIDRMask(30, 32),
+	}
+}
+
+// newRedirectMap creates a REDIRECT_TARGETS map for all objects on the host.
+func newRedirectMap() (*ebpf.Map, error) {
+	spec, err := loadEdt()
+	if err != nil {
+		return nil, errors.WithStack(err)
+	}
+
+	m, err := ebpf.NewMap(spec.Maps["REDIRECT_TARGETS"])
 	if err != nil {
-		return nil, errors.Wrap(err, "cannot convert IP to uint32")
+		return nil, errors.WithStack(err)
 	}
 
-	longs = append(longs, l)
-	//log.Tracef("Added IP %s as long %d", endIP.String(), l)
+	return m, nil
+}
 
-	return longs, nil
+// redirectIndex is the key of a machine in REDIRECT_TARGETS, see
+// machine_index in net.c. Unlike machineIndex, it covers all groups.
+func redirectIndex(id orchestrator.MachineID) uint32 {
+	return uint32(id.Group)<<REACHABLE_GROUP_SHIFT | id.Id
 }
 
 func getIface(name string) (netlink.Link, error) {
@@ -56,4 +56,64 @@ type Path struct {
 	BandwidthKbps uint64     `json:"bandwidth_kbits,omitempty"`
 	Blocked       bool       `json:"blocked,omitempty"`
 	Segments      []Segment  `json:"segments"`
+	// Error is only set in Paths, for a target that has no path
+	Error string `json:"error,omitempty"`
+}
+
+// PathsRequest is the body of `POST /paths/{source_group}/{source_id}`. A
+// ground station target is identified by its name.
+type PathsRequest struct {
+	Targets []Identifier `json:"targets"`
+}
+
+// Paths is returned by `POST /paths/{source_group}/{source_id}`, with one
+// path per target in the order of the request. The path of an unknown target
+// only has its target and an error.
+type Paths struct {
+	Paths []Path `json:"paths"`
+}
+
+type LinkStats struct {
+	Target        Identifier `json:"target"`
+	DelayUs       uint32     `json:"delay_us,omitempty"`
+	BandwidthKbps uint64     `json:"bandwidth_kbits,omitempty"`
+	Blocked       bool       `json:"blocked,omitempty"`
+	Packets       uint64     `json:"packets"`
+	Bytes         uint64     `json:"bytes"`
+	Drops         uint64     `json:"drops"`
+	ECNMarks      uint64     `json:"ecn_marks"`
+}
+
+// Stats is returned by `/stats/{source_group}/{source_id}`.
+type Stats struct {
+	Source Identifier  `json:"source"`
+	Links  []LinkStats `json:"links"`
+}
+
+// BootHistogram counts activations by duration. Counts[0] counts durations
+// below UpperBoundsMs[0], Counts[i] durations below UpperBoundsMs[i], and the
+// last bucket all durations longer than that.
+type BootHistogram struct {
+	Count         uint64    `json:"count"`
+	MeanMs        float64   `json:"mean_ms"`
+	UpperBoundsMs []float64 `json:"upper_bounds_ms"`
+	Counts        []uint64  `json:"counts"`
+}
+
+// BootStats is returned by `/boot`.
+type BootStats struct {
+	Prepare BootHistogram `json:"prepare"`
+	Start   BootHistogram `json:"start"`
+	Guest   BootHistogram `json:"guest"`
+	Restore BootHistogram `json:"restore"`
+}
+
+// BootTimes is returned by `/boot/{group}/{id}`.
+type BootTimes struct {
+	Machine   Identifier `json:"machine"`
+	Restored  bool       `json:"restored"`
+	PrepareMs float64    `json:"prepare_ms"`
+	StartMs   float64    `json:"start_ms"`
+	Booted    bool       `json:"booted"`
+	GuestMs   float64    `json:"guest_ms,omitempty"`
 }
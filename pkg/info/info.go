@@ -23,6 +23,7 @@ import (
 	"net"
 	"net/http"
 	"strconv"
+	"time"
 
 	"github.com/gorilla/mux"
 	"github.com/pkg/errors"
@@ -288,6 +289,94 @@ func (i *infoserver) getGST(w http.ResponseWriter, r *http.Request) {
 	write(w, resp)
 }
 
+// resolveNode returns the machine with the given shell and sat path
+// variables, where shell "gst" means that sat is the name of a ground
+// station. On error, it also returns the HTTP status code to respond with.
+func (i *infoserver) resolveNode(shell string, sat string) (orchestrator.MachineID, int, error) {
+	if shell == "gst" {
+		n, err := i.Orchestrator.InfoGetNodeByName(sat)
+		if err != nil {
+			return orchestrator.MachineID{}, http.StatusNotFound, errors.Wrap(err, "could not find gst node")
+		}
+		return orchestrator.MachineID{
+			Group: n.ID.ID.Group,
+			Id:    n.ID.ID.Id,
+		}, 0, nil
+	}
+
+	g, err := strconv.ParseUint(shell, 10, 32)
+
+	if err != nil {
+		return orchestrator.MachineID{}, http.StatusBadRequest, errors.Wrapf(err, "could not parse shell %s", shell)
+	}
+
+	id, err := strconv.ParseUint(sat, 10, 32)
+
+	if err != nil {
+		return orchestrator.MachineID{}, http.StatusBadRequest, errors.Wrapf(err, "could not parse sat %s", sat)
+	}
+
+	return orchestrator.MachineID{
+		Group: uint8(g),
+		Id:    uint32(id),
+	}, 0, nil
+}
+
+// path returns the path between two machines.
+func (i *infoserver) path(source orchestrator.MachineID, target orchestrator.MachineID) (Path, error) {
+	p, err := i.Orchestrator.InfoGetPath(source, target)
+
+	if err != nil {
+		return Path{}, errors.Wrap(err, fmt.Sprintf("could not find path between %s and %s", source, target))
+	}
+
+	sourceName, _ := i.Orchestrator.InfoGetNodeNameByID(p.Source)
+	targetName, _ := i.Orchestrator.InfoGetNodeNameByID(p.Target)
+
+	s := Path{
+		Source: Identifier{
+			Shell: p.Source.Group,
+			ID:    p.Source.Id,
+			Name:  sourceName,
+		},
+		Target: Identifier{
+			Shell: p.Target.Group,
+			ID:    p.Target.Id,
+			Name:  targetName,
+		},
+	}
+
+	if !p.Blocked {
+		s.DelayUs = p.LatencyUs
+		s.BandwidthKbps = p.BandwidthKbps
+		s.Segments = make([]Segment, len(p.Segments))
+
+		for j, seg := range p.Segments {
+			sourceName, _ = i.Orchestrator.InfoGetNodeNameByID(seg.Source)
+			targetName, _ = i.Orchestrator.InfoGetNodeNameByID(seg.Target)
+
+			s.Segments[j] = Segment{
+				Source: Identifier{
+					Shell: seg.Source.Group,
+					ID:    seg.Source.Id,
+					Name:  sourceName,
+				},
+				Target: Identifier{
+					Shell: seg.Target.Group,
+					ID:    seg.Target.Id,
+					Name:  targetName,
+				},
+				DelayUs:       seg.LatencyUs,
+				BandwidthKbps: seg.BandwidthKbps,
+			}
+		}
+	} else {
+		s.Blocked = true
+	}
+
+	return s, nil
+}
+
 func (i *infoserver) getPath(w http.ResponseWriter, r *http.Request) {
 	v := mux.Vars(r)
 
@@ -311,72 +400,115 @@ func (i *infoserver) getPath(w http.ResponseWriter, r *http.Request) {
 		return
 	}
 
-	var source orchestrator.MachineID
+	source, code, err := i.resolveNode(v["source_shell"], v["source_sat"])
+	if err != nil {
+		errRes(w, code, err)
+		return
+	}
 
-	if v["source_shell"] == "gst" {
-		n, err := i.Orchestrator.InfoGetNodeByName(v["source_sat"])
-		if err != nil {
-			errRes(w, http.StatusNotFound, errors.Wrap(err, "could not find gst node"))
-			return
-		}
-		source = orchestrator.MachineID{
-			Group: n.ID.ID.Group,
-			Id:    n.ID.ID.Id,
-		}
-	} else {
-		sourceShell, err := strconv.ParseUint(v["source_shell"], 10, 32)
+	target, code, err := i.resolveNode(v["target_shell"], v["target_sat"])
+	if err != nil {
+		errRes(w, code, err)
+		return
+	}
 
-		if err != nil {
-			errRes(w, http.StatusBadRequest, errors.Wrap(err, "could not parse source_shell"))
-			return
-		}
+	s, err := i.path(source, target)
+	if err != nil {
+		errRes(w, http.StatusInternalServerError, err)
+		return
+	}
 
-		sourceSat, err := strconv.ParseUint(v["source_sat"], 10, 32)
+	resp, err := json.Marshal(s)
 
-		if err != nil {
-			errRes(w, http.StatusBadRequest, errors.Wrap(err, "could not parse source_sat"))
-			return
-		}
+	if err != nil {
+		errRes(w, http.StatusInternalServerError, errors.Wrap(err, "could not marshal response"))
+		return
+	}
 
-		source = orchestrator.MachineID{
-			Group: uint8(sourceShell),
-			Id:    uint32(sourceSat),
-		}
+	write(w, resp)
+}
+
+// getPaths returns the paths from a source to many targets at once, e.g., for
+// SRv6 route managers that update the segment lists of all their routes each
+// timestep.
+func (i *infoserver) getPaths(w http.ResponseWriter, r *http.Request) {
+	v := mux.Vars(r)
+
+	source, code, err := i.resolveNode(v["source_shell"], v["source_sat"])
+	if err != nil {
+		errRes(w, code, err)
+		return
 	}
 
-	var target orchestrator.MachineID
+	var req PathsRequest
 
-	if v["target_shell"] == "gst" {
-		n, err := i.Orchestrator.InfoGetNodeByName(v["target_sat"])
-		if err != nil {
-			errRes(w, http.StatusNotFound, errors.Wrap(err, "could not find gst node"))
-			return
-		}
-		target = orchestrator.MachineID{
-			Group: n.ID.ID.Group,
-			Id:    n.ID.ID.Id,
+	err = json.NewDecoder(r.Body).Decode(&req)
+
+	if err != nil {
+		errRes(w, http.StatusBadRequest, errors.Wrap(err, "could not parse request"))
+		return
+	}
+
+	s := Paths{
+		Paths: make([]Path, len(req.Targets)),
+	}
+
+	for j, t := range req.Targets {
+		target := orchestrator.MachineID{
+			Group: t.Shell,
+			Id:    t.ID,
 		}
-	} else {
-		targetShell, err := strconv.ParseUint(v["target_shell"], 10, 32)
 
-		if err != nil {
-			errRes(w, http.StatusBadRequest, errors.Wrap(err, "could not parse source_shell"))
-			return
+		var err error
+
+		if t.Name != "" {
+			target, _, err = i.resolveNode("gst", t.Name)
 		}
 
-		targetSat, err := strconv.ParseUint(v["target_sat"], 10, 32)
+		if err == nil {
+			s.Paths[j], err = i.path(source, target)
+		}
 
+		// one bad target should not fail the paths to all others
 		if err != nil {
-			errRes(w, http.StatusBadRequest, errors.Wrap(err, "could not parse source_sat"))
-			return
+			log.Debugf("%s", err.Error())
+			s.Paths[j] = Path{
+				Target: t,
+				Error:  err.Error(),
+			}
 		}
+	}
 
-		target = orchestrator.MachineID{
-			Group: uint8(targetShell),
-			Id:    uint32(targetSat),
-		}
+	resp, err := json.Marshal(s)
+
+	if err != nil {
+		errRes(w, http.StatusInternalServerError, errors.Wrap(err, "could not marshal response"))
+		return
 	}
-	p, err := i.Orchestrator.InfoGetPath(source, target)
+
+	write(w, resp)
+}
+
+func (i *infoserver) getStats(w http.ResponseWriter, r *http.Request) {
+	v := mux.Vars(r)
+
+	if _, ok := v["source_shell"]; !ok || v["source_shell"] == "" {
+		errRes(w, http.StatusBadRequest, errors.New("source_shell not specified"))
+		return
+	}
+
+	if _, ok := v["source_sat"]; !ok || v["source_sat"] == "" {
+		errRes(w, http.StatusBadRequest, errors.New("source_sat not specified"))
+		return
+	}
+
+	source, code, err := i.resolveNode(v["source_shell"], v["source_sat"])
+	if err != nil {
+		errRes(w, code, err)
+		return
+	}
+
+	l, err := i.Orchestrator.InfoGetLinkStats(source)
 
 	if err != nil {
 		errRes(
@@ -384,54 +516,43 @@ func (i *infoserver) getPath(w http.ResponseWriter, r *http.Request) {
 			http.StatusInternalServerError,
 			errors.Wrap(
 				err,
-				fmt.Sprintf("could not find path between %s and %s", source, target),
+				fmt.Sprintf("could not get link stats for %s", source),
 			),
 		)
 		return
 	}
 
-	sourceName, _ := i.Orchestrator.InfoGetNodeNameByID(p.Source)
-	targetName, _ := i.Orchestrator.InfoGetNodeNameByID(p.Target)
+	sourceName, _ := i.Orchestrator.InfoGetNodeNameByID(source)
 
-	s := Path{
+	s := Stats{
 		Source: Identifier{
-			Shell: p.Source.Group,
-			ID:    p.Source.Id,
+			Shell: source.Group,
+			ID:    source.Id,
 			Name:  sourceName,
 		},
-		Target: Identifier{
-			Shell: p.Target.Group,
-			ID:    p.Target.Id,
-			Name:  targetName,
-		},
+		Links: make([]LinkStats, len(l)),
 	}
 
-	if !p.Blocked {
-		s.DelayUs = p.LatencyUs
-		s.BandwidthKbps = p.BandwidthKbps
-		s.Segments = make([]Segment, len(p.Segments))
+	for j, link := range l {
+		targetName, _ := i.Orchestrator.InfoGetNodeNameByID(link.Target)
 
-		for j, seg := range p.Segments {
-			sourceName, _ = i.Orchestrator.InfoGetNodeNameByID(seg.Source)
-			targetName, _ = i.Orchestrator.InfoGetNodeNameByID(seg.Target)
+		s.Links[j] = LinkStats{
+			Target: Identifier{
+				Shell: link.Target.Group,
+				ID:    link.Target.Id,
+				Name:  targetName,
+			},
+			Blocked:  link.Blocked,
+			Packets:  link.Packets,
+			Bytes:    link.Bytes,
+			Drops:    link.Drops,
+			ECNMarks: link.ECNMarks,
+		}
 
-			s.Segments[j] = Segment{
-				Source: Identifier{
-					Shell: seg.Source.Group,
-					ID:    seg.Source.Id,
-					Name:  sourceName,
-				},
-				Target: Identifier{
-					Shell: seg.Target.Group,
-					ID:    seg.Target.Id,
-					Name:  targetName,
-				},
-				DelayUs:       seg.LatencyUs,
-				BandwidthKbps: seg.BandwidthKbps,
-			}
+		if !link.Blocked {
+			s.Links[j].DelayUs = link.LatencyUs
+			s.Links[j].BandwidthKbps = link.BandwidthKbps
 		}
-	} else {
-		s.Blocked = true
 	}
 
 	resp, err := json.Marshal(s)
@@ -444,6 +565,112 @@ func (i *infoserver) getPath(w http.ResponseWriter, r *http.Request) {
 	write(w, resp)
 }
 
+func ms(d time.Duration) float64 {
+	return float64(d) / float64(time.Millisecond)
+}
+
+func bootHistogram(h orchestrator.BootHistogram) BootHistogram {
+	b := BootHistogram{
+		Count:         h.Count,
+		UpperBoundsMs: make([]float64, orchestrator.BootHistogramBuckets-1),
+		Counts:        h.Counts[:],
+	}
+
+	if h.Count > 0 {
+		b.MeanMs = ms(h.Sum) / float64(h.Count)
+	}
+
+	for j := range b.UpperBoundsMs {
+		b.UpperBoundsMs[j] = float64(uint64(1) << j)
+	}
+
+	return b
+}
+
+func (i *infoserver) getBootStats(w http.ResponseWriter, r *http.Request) {
+	s, err := i.Orchestrator.InfoGetBootStats()
+
+	if err != nil {
+		errRes(w, http.StatusInternalServerError, errors.Wrap(err, "could not get boot stats"))
+		return
+	}
+
+	resp, err := json.Marshal(BootStats{
+		Prepare: bootHistogram(s.Prepare),
+		Start:   bootHistogram(s.Start),
+		Guest:   bootHistogram(s.Guest),
+		Restore: bootHistogram(s.Restore),
+	})
+
+	if err != nil {
+		errRes(w, http.StatusInternalServerError, errors.Wrap(err, "could not marshal response"))
+		return
+	}
+
+	write(w, resp)
+}
+
+func (i *infoserver) getBootTimes(w http.ResponseWriter, r *http.Request) {
+	v := mux.Vars(r)
+
+	if _, ok := v["shell"]; !ok || v["shell"] == "" {
+		errRes(w, http.StatusBadRequest, errors.New("shell not specified"))
+		return
+	}
+
+	if _, ok := v["sat"]; !ok || v["sat"] == "" {
+		errRes(w, http.StatusBadRequest, errors.New("sat not specified"))
+		return
+	}
+
+	m, code, err := i.resolveNode(v["shell"], v["sat"])
+	if err != nil {
+		errRes(w, code, err)
+		return
+	}
+
+	t, err := i.Orchestrator.InfoGetBootTimes(m)
+
+	if err != nil {
+		errRes(
+			w,
+			http.StatusInternalServerError,
+			errors.Wrap(
+				err,
+				fmt.Sprintf("could not get boot times for %s", m),
+			),
+		)
+		return
+	}
+
+	name, _ := i.Orchestrator.InfoGetNodeNameByID(m)
+
+	b := BootTimes{
+		Machine: Identifier{
+			Shell: m.Group,
+			ID:    m.Id,
+			Name:  name,
+		},
+		Restored:  t.Restored,
+		PrepareMs: ms(t.Prepare),
+		StartMs:   ms(t.Start),
+		Booted:    t.Booted,
+	}
+
+	if t.Booted {
+		b.GuestMs = ms(t.Guest)
+	}
+
+	resp, err := json.Marshal(b)
+
+	if err != nil {
+		errRes(w, http.StatusInternalServerError, errors.Wrap(err, "could not marshal response"))
+		return
+	}
+
+	write(w, resp)
+}
+
 // Start starts our information server that provides information about
 // the constellation.
 func Start(port uint64, o *orchestrator.Orchestrator) error {
@@ -461,6 +688,10 @@ func Start(port uint64, o *orchestrator.Orchestrator) error {
 	r.HandleFunc("/shell/{shell:[1-9][0-9]*}/{sat:[0-9]+}", i.getSat).Methods("GET")
 	r.HandleFunc("/gst/{name}", i.getGST).Methods("GET")
 	r.HandleFunc("/path/{source_shell}/{source_sat}/{target_shell}/{target_sat}", i.getPath).Methods("GET")
+	r.HandleFunc("/paths/{source_shell}/{source_sat}", i.getPaths).Methods("POST")
+	r.HandleFunc("/stats/{source_shell}/{source_sat}", i.getStats).Methods("GET")
+	r.HandleFunc("/boot", i.getBootStats).Methods("GET")
+	r.HandleFunc("/boot/{shell}/{sat}", i.getBootTimes).Methods("GET")
 
 	err := http.ListenAndServe(net.JoinHostPort("", strconv.Itoa(int(port))), r)
 
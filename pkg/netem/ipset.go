@@ -32,7 +32,7 @@ func (v *vm) configureIPSet(id orchestrator.MachineID) error {
 	// come up with a chain name and ip blockset name
 	v.chainName = fmt.Sprintf("CT-%d-%d", id.Group, id.Id)
 
-	v.ipBlockSet = fmt.Sprintf("CT-%d-%d-bl", id.Group, id.Id)
+	v.ipAllowSet = fmt.Sprintf("CT-%d-%d-al", id.Group, id.Id)
 
 	// remove old stuff, but ignore any errors
 	// adding the -w flag to iptables makes it wait for the lock
@@ -49,8 +49,8 @@ func (v *vm) configureIPSet(id orchestrator.MachineID) error {
 	cmd = exec.Command(IPTABLES_BIN, "-w", "-X", v.chainName)
 	_ = cmd.Run()
 
-	// ipset destroy [IP_BLOCK_SET]
-	cmd = exec.Command(IPSET_BIN, "destroy", v.ipBlockSet)
+	// ipset destroy [IP_ALLOW_SET]
+	cmd = exec.Command(IPSET_BIN, "destroy", v.ipAllowSet)
 	_ = cmd.Run()
 
 	// create new stuff
@@ -68,15 +68,17 @@ func (v *vm) configureIPSet(id orchestrator.MachineID) error {
 		return errors.Wrapf(err, "%#v: output: %s", cmd.Args, out)
 	}
 
-	// ipset create [IP_BLOCK_SET] hash:ip netmask 30 TODO: make this configurable
-	cmd = exec.Command(IPSET_BIN, "create", v.ipBlockSet, "hash:ip", "netmask", "30")
+	// ipset create [IP_ALLOW_SET] hash:ip netmask 30 TODO: make this configurable
+	cmd = exec.Command(IPSET_BIN, "create", v.ipAllowSet, "hash:ip", "netmask", "30")
 
 	if out, err := cmd.CombinedOutput(); err != nil {
 		return errors.Wrapf(err, "%#v: output: %s", cmd.Args, out)
 	}
 
-	// iptables -w -A [CHAIN_NAME] -m set --match-set [IP_BLOCK_SET] dst -j REJECT --reject-with icmp-net-unreachable
-	cmd = exec.Command(IPTABLES_BIN, "-w", "-A", v.chainName, "-m", "set", "--match-set", v.ipBlockSet, "dst", "-j", "REJECT", "--reject-with", "icmp-net-unreachable")
+	// links are blocked by default: a single rule rejects all traffic to
+	// machines that are not in the allow set
+	// iptables -w -A [CHAIN_NAME] -d 10.0.0.0/8 -m set ! --match-set [IP_ALLOW_SET] dst -j REJECT --reject-with icmp-net-unreachable
+	cmd = exec.Command(IPTABLES_BIN, "-w", "-A", v.chainName, "-d", "10.0.0.0/8", "-m", "set", "!", "--match-set", v.ipAllowSet, "dst", "-j", "REJECT", "--reject-with", "icmp-net-unreachable")
 
 	if out, err := cmd.CombinedOutput(); err != nil {
 		return errors.Wrapf(err, "%#v: output: %s", cmd.Args, out)
@@ -106,8 +108,8 @@ func (v *vm) removeIPSet() error {
 		return errors.Wrapf(err, "%#v: output: %s", cmd.Args, out)
 	}
 
-	// ipset destroy [IP_BLOCK_SET]
-	cmd = exec.Command(IPSET_BIN, "destroy", v.ipBlockSet)
+	// ipset destroy [IP_ALLOW_SET]
+	cmd = exec.Command(IPSET_BIN, "destroy", v.ipAllowSet)
 
 	if out, err := cmd.CombinedOutput(); err != nil {
 		return errors.Wrapf(err, "%#v: output: %s", cmd.Args, out)
@@ -117,10 +119,10 @@ func (v *vm) removeIPSet() error {
 }
 
 func (v *vm) blockNet(target net.IPNet) error {
-	log.Trace("blocking ", target.String(), " in ", v.ipBlockSet)
+	log.Trace("blocking ", target.String(), " in ", v.ipAllowSet)
 
-	// ipset add [IP_BLOCK_SET] [TARGET_NETWORK] -exist
-	cmd := exec.Command(IPSET_BIN, "add", v.ipBlockSet, target.String(), "-exist")
+	// ipset del [IP_ALLOW_SET] [TARGET_NETWORK] -exist
+	cmd := exec.Command(IPSET_BIN, "del", v.ipAllowSet, target.String(), "-exist")
 
 	if out, err := cmd.CombinedOutput(); err != nil {
 		return errors.Wrapf(err, "%#v: output: %s", cmd.Args, out)
@@ -131,9 +133,9 @@ func (v *vm) blockNet(target net.IPNet) error {
 
 func (v *vm) unblockNet(target net.IPNet) error {
 
-	log.Trace("unblocking ", target.String(), " in ", v.ipBlockSet)
-	// ipset del [IP_BLOCK_SET] [TARGET_NETWORK]
-	cmd := exec.Command(IPSET_BIN, "del", v.ipBlockSet, target.String())
+	log.Trace("unblocking ", target.String(), " in ", v.ipAllowSet)
+	// ipset add [IP_ALLOW_SET] [TARGET_NETWORK] -exist
+	cmd := exec.Command(IPSET_BIN, "add", v.ipAllowSet, target.String(), "-exist")
 
 	if out, err := cmd.CombinedOutput(); err != nil {
 		return errors.Wrapf(err, "%#v: output: %s", cmd.Args, out)
@@ -45,7 +45,7 @@ type vm struct {
 
 	// ipset specific configuration
 	chainName  string
-	ipBlockSet string
+	ipAllowSet string
 
 	// tc specific configuration
 	handle uint16
@@ -186,7 +186,8 @@ func (n *Netem) checkLink(source orchestrator.MachineID, target net.IPNet) error
 		return err
 	}
 
-	n.vms[source].links[fromIPNet(target)] = &link{tcIndex: index}
+	// until unblocked, the link is blocked by the default rule
+	n.vms[source].links[fromIPNet(target)] = &link{tcIndex: index, blocked: true}
 
 	return nil
 }
@@ -282,19 +283,66 @@ func (n *Netem) BlockLink(source orchestrator.MachineID, target net.IPNet) error
 	v.Lock()
 	defer v.Unlock()
 
-	err := n.checkLink(source, target)
+	// links are blocked by default, so there is no need to create a qdisc
+	// for a link that has never been unblocked
+	err := v.blockNet(target)
 
 	if err != nil {
 		return err
 	}
 
-	err = v.blockNet(target)
+	if l, ok := n.vms[source].links[fromIPNet(target)]; ok {
+		l.blocked = true
+	}
 
-	if err != nil {
-		return err
+	return nil
+}
+
+// UpdateLinks applies a batch of link updates. tc and ipset have no bulk
+// interface that fits our per-link classes, so we simply apply the updates
+// one after another.
+func (n *Netem) UpdateLinks(source orchestrator.MachineID, updates []orchestrator.NetLinkUpdate) error {
+	for _, u := range updates {
+		if u.BlockedChanged {
+			var err error
+			if u.Blocked {
+				err = n.BlockLink(source, u.Target)
+			} else {
+				err = n.UnblockLink(source, u.Target)
+			}
+
+			if err != nil {
+				return err
+			}
+		}
+
+		if u.LatencyChanged {
+			err := n.SetLatency(source, u.Target, u.LatencyUs)
+
+			if err != nil {
+				return err
+			}
+		}
+
+		if u.BandwidthChanged {
+			err := n.SetBandwidth(source, u.Target, u.BandwidthKbps)
+
+			if err != nil {
+				return err
+			}
+		}
 	}
 
-	n.vms[source].links[fromIPNet(target)].blocked = true
+	return nil
+}
 
+// CommitLinks does nothing, netem applies link updates right away.
+func (n *Netem) CommitLinks() error {
 	return nil
 }
+
+// LinkStats is not supported by netem, the tc counters are per class and
+// are not kept for blocked links.
+func (n *Netem) LinkStats(source orchestrator.MachineID) ([]orchestrator.NetLinkStats, error) {
+	return nil, errors.New("link statistics are not supported by the netem backend")
+}
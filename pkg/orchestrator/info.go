@@ -19,6 +19,7 @@ package orchestrator
 
 import (
 	"net"
+	"sort"
 	"strings"
 
 	"github.com/pkg/errors"
@@ -50,6 +51,15 @@ type SegmentInfo struct {
 	BandwidthKbps uint64
 }
 
+type LinkStatsInfo struct {
+	Source        MachineID
+	Target        MachineID
+	LatencyUs     uint32
+	BandwidthKbps uint64
+	Blocked       bool
+	LinkStats
+}
+
 type PathInfo struct {
 	Source        MachineID
 	Target        MachineID
@@ -59,46 +69,44 @@ type PathInfo struct {
 	Blocked       bool
 }
 
+// The Info methods read the snapshot of the last update, they never wait for
+// an update in progress.
+
 func (o *Orchestrator) InfoGetIPAddressByID(id MachineID) (net.IP, error) {
-	if !o.initialized {
+	s := o.snapshot.Load()
+	if s == nil {
 		return nil, errors.New("orchestrator not initialized")
 	}
 
-	ip, err := o.virt.GetIPAddress(id)
+	ip, ok := s.ip(id)
 
-	if err != nil {
-		return net.IP{}, errors.Wrap(err, "could not get IP address")
+	if !ok {
+		return net.IP{}, errors.Errorf("could not get IP address: unknown machine %s", id)
 	}
 
-	return ip.IP, nil
+	return ip, nil
 }
 
 func (o *Orchestrator) InfoGetIPAddressByName(name string) (net.IP, error) {
-	var id MachineID
-	ok := false
-
-	for m, i := range o.machineNames {
-		if strings.EqualFold(m, name) {
-			id = i
-			ok = true
-		}
+	s := o.snapshot.Load()
+	if s == nil {
+		return nil, errors.New("orchestrator not initialized")
 	}
 
+	id, ok := s.nodes.byName[strings.ToLower(name)]
+
 	if !ok {
 		return net.IP{}, errors.Errorf("machine with name %s not found", name)
 	}
 
-	ip, err := o.virt.GetIPAddress(id)
-
-	if err != nil {
-		return net.IP{}, errors.Wrap(err, "could not get IP address")
-	}
+	ip, _ := s.ip(id)
 
-	return ip.IP, nil
+	return ip, nil
 }
 
 func (o *Orchestrator) InfoGetNodeByIP(ip net.IP) (NodeInfo, error) {
-	if !o.initialized {
+	s := o.snapshot.Load()
+	if s == nil {
 		return NodeInfo{}, errors.New("orchestrator not initialized")
 	}
 
@@ -119,15 +127,14 @@ func (o *Orchestrator) InfoGetNodeByIP(ip net.IP) (NodeInfo, error) {
 		n.ID.Name = o.machines[id].name
 	}
 
-	if o.State.MachinesState[id] == ACTIVE {
-		n.Active = true
-	}
+	n.Active = s.active(id)
 
 	return n, nil
 }
 
 func (o *Orchestrator) InfoGetConstellation() (ConstellationInfo, error) {
-	if !o.initialized {
+	s := o.snapshot.Load()
+	if s == nil {
 		return ConstellationInfo{}, errors.New("orchestrator not initialized")
 	}
 
@@ -145,9 +152,7 @@ func (o *Orchestrator) InfoGetConstellation() (ConstellationInfo, error) {
 			},
 		}
 
-		if o.State.MachinesState[m] == ACTIVE {
-			n.Active = true
-		}
+		n.Active = s.active(m)
 
 		g[m.Group][m.Id] = n
 	}
@@ -171,7 +176,8 @@ func (o *Orchestrator) InfoGetConstellation() (ConstellationInfo, error) {
 }
 
 func (o *Orchestrator) InfoGetGroup(group uint8) (GroupInfo, error) {
-	if !o.initialized {
+	s := o.snapshot.Load()
+	if s == nil {
 		return GroupInfo{}, errors.New("orchestrator not initialized")
 	}
 
@@ -189,9 +195,7 @@ func (o *Orchestrator) InfoGetGroup(group uint8) (GroupInfo, error) {
 			},
 		}
 
-		if o.State.MachinesState[m] == ACTIVE {
-			n.Active = true
-		}
+		n.Active = s.active(m)
 
 		g[m.Id] = n
 	}
@@ -209,7 +213,8 @@ func (o *Orchestrator) InfoGetGroup(group uint8) (GroupInfo, error) {
 }
 
 func (o *Orchestrator) InfoGetNodeByID(id MachineID) (NodeInfo, error) {
-	if !o.initialized {
+	s := o.snapshot.Load()
+	if s == nil {
 		return NodeInfo{}, errors.New("orchestrator not initialized")
 	}
 
@@ -224,9 +229,7 @@ func (o *Orchestrator) InfoGetNodeByID(id MachineID) (NodeInfo, error) {
 		n.ID.Name = o.machines[id].name
 	}
 
-	if o.State.MachinesState[id] == ACTIVE {
-		n.Active = true
-	}
+	n.Active = s.active(id)
 
 	return n, nil
 }
@@ -246,7 +249,8 @@ func (o *Orchestrator) InfoGetNodeNameByID(id MachineID) (string, error) {
 }
 
 func (o *Orchestrator) InfoGetNodeByName(name string) (NodeInfo, error) {
-	if !o.initialized {
+	s := o.snapshot.Load()
+	if s == nil {
 		return NodeInfo{}, errors.New("orchestrator not initialized")
 	}
 
@@ -263,17 +267,99 @@ func (o *Orchestrator) InfoGetNodeByName(name string) (NodeInfo, error) {
 		},
 	}
 
-	if o.State.MachinesState[id] == ACTIVE {
-		n.Active = true
-	}
+	n.Active = s.active(id)
 
 	return n, nil
 }
 
 func (o *Orchestrator) InfoGetPath(source, destination MachineID) (PathInfo, error) {
-	if !o.initialized {
+	s := o.snapshot.Load()
+	if s == nil {
 		return PathInfo{}, errors.New("orchestrator not initialized")
 	}
 
-	return path(source, destination, o.State.NetworkState)
+	return s.path(source, destination)
+}
+
+// InfoGetLinkStats returns the traffic counters of all links of a source
+// machine that have seen traffic, next to their configured parameters. Only
+// machines on this host have counters.
+func (o *Orchestrator) InfoGetLinkStats(source MachineID) ([]LinkStatsInfo, error) {
+	s := o.snapshot.Load()
+	if s == nil {
+		return nil, errors.New("orchestrator not initialized")
+	}
+
+	if _, ok := s.index[source]; !ok {
+		return nil, errors.Errorf("machine %s not found", source)
+	}
+
+	stats, err := o.virt.GetLinkStats(source)
+
+	if err != nil {
+		return nil, errors.Wrap(err, "could not get link stats")
+	}
+
+	l := make([]LinkStatsInfo, 0, len(stats))
+
+	for target, ls := range stats {
+		i := LinkStatsInfo{
+			Source:    source,
+			Target:    target,
+			LinkStats: ls,
+		}
+
+		if link, ok := s.get(source, target); ok {
+			i.LatencyUs = link.LatencyUs
+			i.BandwidthKbps = link.BandwidthKbps
+			i.Blocked = link.Blocked
+		}
+
+		l = append(l, i)
+	}
+
+	sort.Slice(l, func(a, b int) bool {
+		if l[a].Target.Group != l[b].Target.Group {
+			return l[a].Target.Group < l[b].Target.Group
+		}
+		return l[a].Target.Id < l[b].Target.Id
+	})
+
+	return l, nil
+}
+
+// InfoGetBootTimes returns the phases of the last activation of a machine.
+// Only machines on this host have boot times.
+func (o *Orchestrator) InfoGetBootTimes(machine MachineID) (BootTimes, error) {
+	if !o.initialized {
+		return BootTimes{}, errors.New("orchestrator not initialized")
+	}
+
+	if _, ok := o.machines[machine]; !ok {
+		return BootTimes{}, errors.Errorf("machine %s not found", machine)
+	}
+
+	t, err := o.virt.GetBootTimes(machine)
+
+	if err != nil {
+		return BootTimes{}, errors.Wrap(err, "could not get boot times")
+	}
+
+	return t, nil
+}
+
+// InfoGetBootStats returns histograms of the activations of all machines on
+// this host.
+func (o *Orchestrator) InfoGetBootStats() (BootStats, error) {
+	if !o.initialized {
+		return BootStats{}, errors.New("orchestrator not initialized")
+	}
+
+	s, err := o.virt.GetBootStats()
+
+	if err != nil {
+		return BootStats{}, errors.Wrap(err, "could not get boot stats")
+	}
+
+	return s, nil
 }
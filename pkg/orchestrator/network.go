@@ -49,41 +49,152 @@ func (l Link) String() string {
 	return fmt.Sprintf("%dus %dkbps (next: %s)", l.LatencyUs, l.BandwidthKbps, l.Next.String())
 }
 
-func path(a, b MachineID, n NetworkState) (PathInfo, error) {
+// LinkTable is the dense link state of the emulation. Every machine is
+// assigned a compact index at Initialize and the parameters of the link from
+// machine i to machine j are stored at i*n+j of each column. Compared to
+// nested maps of pointers, this keeps a whole row of links in a few
+// contiguous arrays and leaves nothing for the garbage collector to scan.
+type LinkTable struct {
+	n     int
+	ids   []MachineID
+	index map[MachineID]uint32
+
+	blocked       []bool
+	latencyUs     []uint32
+	bandwidthKbps []uint64
+	next          []uint32
+}
+
+// newLinkTable creates a LinkTable for the given machines with all links
+// blocked. Indices are assigned in (group, id) order.
+func newLinkTable(machines []MachineID) *LinkTable {
+	ids := make([]MachineID, len(machines))
+	copy(ids, machines)
+
+	sort.Slice(ids, func(a, b int) bool {
+		if ids[a].Group != ids[b].Group {
+			return ids[a].Group < ids[b].Group
+		}
+		return ids[a].Id < ids[b].Id
+	})
+
+	n := len(ids)
+
+	t := &LinkTable{
+		n:             n,
+		ids:           ids,
+		index:         make(map[MachineID]uint32, n),
+		blocked:       make([]bool, n*n),
+		latencyUs:     make([]uint32, n*n),
+		bandwidthKbps: make([]uint64, n*n),
+		next:          make([]uint32, n*n),
+	}
+
+	for i, m := range ids {
+		t.index[m] = uint32(i)
+	}
+
+	for i := range t.blocked {
+		t.blocked[i] = true
+	}
+
+	return t
+}
+
+// idx returns the position of the link from a to b in the table.
+func (t *LinkTable) idx(a, b MachineID) (int, bool) {
+	i, ok := t.index[a]
+	if !ok {
+		return 0, false
+	}
+
+	j, ok := t.index[b]
+	if !ok {
+		return 0, false
+	}
+
+	return int(i)*t.n + int(j), true
+}
+
+// get returns the link from a to b.
+func (t *LinkTable) get(a, b MachineID) (Link, bool) {
+	k, ok := t.idx(a, b)
+	if !ok {
+		return Link{}, false
+	}
+
+	return t.link(k), true
+}
+
+func (t *LinkTable) link(k int) Link {
+	return Link{
+		Blocked:       t.blocked[k],
+		LatencyUs:     t.latencyUs[k],
+		BandwidthKbps: t.bandwidthKbps[k],
+		Next:          t.ids[t.next[k]],
+	}
+}
+
+func (t *LinkTable) size() int {
+	return t.n
+}
+
+// links are link states that paths can be walked on, i.e., a LinkTable or a
+// snapshot of one.
+type links interface {
+	get(a, b MachineID) (Link, bool)
+	size() int
+}
+
+func path(a, b MachineID, t links) (PathInfo, error) {
 	if a == b {
 		return PathInfo{}, errors.Errorf("cannot give path from %s to itself", a)
 	}
 
 	log.Tracef("path from %s to %s", a.String(), b.String())
 
+	l, ok := t.get(a, b)
+	if !ok {
+		return PathInfo{}, errors.Errorf("no link from %s to %s", a.String(), b.String())
+	}
+
 	p := PathInfo{
 		Source: a,
 		Target: b,
 	}
 
-	if n[a][b].Blocked {
+	if l.Blocked {
 		log.Tracef("path from %s to %s is blocked", a.String(), b.String())
 		p.Blocked = true
 		return p, nil
 	}
 
-	p.LatencyUs = n[a][b].LatencyUs
-	p.BandwidthKbps = n[a][b].BandwidthKbps
+	p.LatencyUs = l.LatencyUs
+	p.BandwidthKbps = l.BandwidthKbps
 	p.Segments = make([]SegmentInfo, 0)
 
+	// a path can have at most n-1 segments, anything longer is a loop
 	for a != b {
-		hop := n[a][b]
+		if len(p.Segments) >= t.size() {
+			return PathInfo{}, errors.Errorf("next hops from %s to %s form a loop", p.Source.String(), b.String())
+		}
+
+		hop, ok := t.get(a, b)
+		if !ok {
+			return PathInfo{}, errors.Errorf("no link from %s to %s", a.String(), b.String())
+		}
 		log.Tracef("next hop from %s to %s: %s", a.String(), b.String(), hop.String())
 
-		if _, ok := n[a][hop.Next]; !ok {
+		segment, ok := t.get(a, hop.Next)
+		if !ok {
 			return PathInfo{}, errors.Errorf("could not find next hop %s for %s", hop.Next.String(), a.String())
 		}
 
 		s := SegmentInfo{
 			Source:        a,
 			Target:        hop.Next,
-			LatencyUs:     n[a][hop.Next].LatencyUs,
-			BandwidthKbps: n[a][hop.Next].BandwidthKbps,
+			LatencyUs:     segment.LatencyUs,
+			BandwidthKbps: segment.BandwidthKbps,
 		}
 
 		p.Segments = append(p.Segments, s)
@@ -41,7 +41,7 @@ func Test_path(t *testing.T) {
 				b: MachineID{Id: 0},
 				n: NetworkState{
 					MachineID{Id: 0}: {
-						MachineID{Id: 1}: &Link{
+						MachineID{Id: 1}: {
 							Blocked:       false,
 							LatencyUs:     1,
 							BandwidthKbps: 1,
@@ -51,7 +51,7 @@ func Test_path(t *testing.T) {
 						},
 					},
 					MachineID{Id: 1}: {
-						MachineID{Id: 0}: &Link{
+						MachineID{Id: 0}: {
 							Blocked:       false,
 							LatencyUs:     1,
 							BandwidthKbps: 1,
@@ -69,8 +69,8 @@ func Test_path(t *testing.T) {
 				BandwidthKbps: 1,
 				Segments: []SegmentInfo{
 					{
-						Source:        MachineID{Id: 0},
-						Target:        MachineID{Id: 1},
+						Source:        MachineID{Id: 1},
+						Target:        MachineID{Id: 0},
 						LatencyUs:     1,
 						BandwidthKbps: 1,
 					},
@@ -85,7 +85,7 @@ func Test_path(t *testing.T) {
 				b: MachineID{Id: 1},
 				n: NetworkState{
 					MachineID{Id: 0}: {
-						MachineID{Id: 1}: &Link{
+						MachineID{Id: 1}: {
 							Blocked:       false,
 							LatencyUs:     1,
 							BandwidthKbps: 1,
@@ -95,7 +95,7 @@ func Test_path(t *testing.T) {
 						},
 					},
 					MachineID{Id: 1}: {
-						MachineID{Id: 0}: &Link{
+						MachineID{Id: 0}: {
 							Blocked:       false,
 							LatencyUs:     1,
 							BandwidthKbps: 1,
@@ -129,7 +129,7 @@ func Test_path(t *testing.T) {
 				b: MachineID{Id: 0},
 				n: NetworkState{
 					MachineID{Id: 0}: {
-						MachineID{Id: 1}: &Link{
+						MachineID{Id: 1}: {
 							Blocked:       false,
 							LatencyUs:     2,
 							BandwidthKbps: 1,
@@ -137,7 +137,7 @@ func Test_path(t *testing.T) {
 								Id: 2,
 							},
 						},
-						MachineID{Id: 2}: &Link{
+						MachineID{Id: 2}: {
 							Blocked:       false,
 							LatencyUs:     1,
 							BandwidthKbps: 1,
@@ -147,7 +147,7 @@ func Test_path(t *testing.T) {
 						},
 					},
 					MachineID{Id: 1}: {
-						MachineID{Id: 0}: &Link{
+						MachineID{Id: 0}: {
 							Blocked:       false,
 							LatencyUs:     2,
 							BandwidthKbps: 1,
@@ -155,7 +155,7 @@ func Test_path(t *testing.T) {
 								Id: 2,
 							},
 						},
-						MachineID{Id: 2}: &Link{
+						MachineID{Id: 2}: {
 							Blocked:       false,
 							LatencyUs:     1,
 							BandwidthKbps: 1,
@@ -165,7 +165,7 @@ func Test_path(t *testing.T) {
 						},
 					},
 					MachineID{Id: 2}: {
-						MachineID{Id: 0}: &Link{
+						MachineID{Id: 0}: {
 							Blocked:       false,
 							LatencyUs:     1,
 							BandwidthKbps: 1,
@@ -173,7 +173,7 @@ func Test_path(t *testing.T) {
 								Id: 0,
 							},
 						},
-						MachineID{Id: 1}: &Link{
+						MachineID{Id: 1}: {
 							Blocked:       false,
 							LatencyUs:     1,
 							BandwidthKbps: 1,
@@ -209,7 +209,7 @@ func Test_path(t *testing.T) {
 	}
 	for _, tt := range tests {
 		t.Run(tt.name, func(t *testing.T) {
-			got, err := path(tt.args.a, tt.args.b, tt.args.n)
+			got, err := path(tt.args.a, tt.args.b, linkTableFrom(tt.args.n))
 			if (err != nil) != tt.wantErr {
 				t.Errorf("path() error = %v, wantErr %v", err, tt.wantErr)
 				return
@@ -220,3 +220,26 @@ func Test_path(t *testing.T) {
 		})
 	}
 }
+
+// linkTableFrom creates a LinkTable that holds the links in n, all other
+// links are blocked.
+func linkTableFrom(n NetworkState) *LinkTable {
+	ids := make([]MachineID, 0, len(n))
+	for m := range n {
+		ids = append(ids, m)
+	}
+
+	t := newLinkTable(ids)
+
+	for a, links := range n {
+		for b, l := range links {
+			k, _ := t.idx(a, b)
+			t.blocked[k] = l.Blocked
+			t.latencyUs[k] = l.LatencyUs
+			t.bandwidthKbps[k] = l.BandwidthKbps
+			t.next[k] = t.index[l.Next]
+		}
+	}
+
+	return t
+}
@@ -29,20 +29,35 @@ import (
 )
 
 type Orchestrator struct {
-	// State is the description of the desired state of the emulation (as determined by simulation)
-	State
+	// links is the desired state of all links in the emulation (as determined by simulation)
+	links *LinkTable
+	// rowLocks has one lock per row in links
+	rowLocks []sync.Mutex
+	// dirtyRows marks the rows in links that changed since the last snapshot,
+	// it is guarded by rowLocks
+	dirtyRows []bool
+	// machinesState is the desired state of all machines in the emulation (as determined by simulation)
+	machinesState MachinesState
 
 	machines     map[MachineID]*machine
 	machineNames map[string]MachineID
 
+	// snapshot is the state of the emulation after the last update, see
+	// snapshot
+	snapshot atomic.Pointer[snapshot]
+	nodes    *nodeTable
+
 	virt VirtualizationBackend
+	// workers is the number of goroutines that apply updates in parallel
+	workers int
 
 	initialized bool
 }
 
 func New(vb VirtualizationBackend) *Orchestrator {
 	return &Orchestrator{
-		virt: vb,
+		virt:    vb,
+		workers: runtime.NumCPU(),
 	}
 }
 
@@ -80,104 +95,50 @@ func (o *Orchestrator) Initialize(machineList map[MachineID]MachineConfig, machi
 	}
 
 	// init state
-	o.State = State{
-		NetworkState:  make(NetworkState),
-		MachinesState: make(MachinesState),
+	ids := make([]MachineID, 0, len(o.machines))
+	for m := range o.machines {
+		ids = append(ids, m)
 	}
 
+	// by default, all links are blocked
+	o.links = newLinkTable(ids)
+	o.rowLocks = make([]sync.Mutex, len(ids))
+	o.dirtyRows = make([]bool, len(ids))
+	o.machinesState = make(MachinesState)
+
 	// register all machines
-	var wg sync.WaitGroup
-	var e error
+	start := time.Now()
 	progressMachines := atomic.Uint32{}
 
 	for m := range o.machines {
-		wg.Add(1)
-		go func(mid MachineID, mmachine *machine) {
-			defer wg.Done()
-			err := o.virt.RegisterMachine(mid, mmachine.name, mmachine.Host, mmachine.config)
-
-			if err != nil {
-				e = errors.WithStack(err)
-			}
-
-			progressMachines.Add(1)
-		}(m, o.machines[m])
-
-		o.State.MachinesState[m] = STOPPED
-	}
-
-	shown := 0
-	total := len(o.machines)
-	for state := 0; state < total; state = int(progressMachines.Load()) {
-		if state > shown && state%100 == 0 {
-			log.Debugf("machine init progress: %d/%d", progressMachines.Load(), total)
-			shown = state
-		}
-	}
-
-	wg.Wait()
-	if e != nil {
-		return errors.WithStack(e)
+		o.machinesState[m] = STOPPED
 	}
 
-	log.Debugf("starting link init")
-
-	// init networking
-	// by default, all links are blocked
-	wg = sync.WaitGroup{}
-	e = nil
-	progressLinks := atomic.Uint32{}
+	done := make(chan error, 1)
+	go func() {
+		done <- forEach(len(ids), o.workers, func(i int) error {
+			defer progressMachines.Add(1)
 
-	start := time.Now()
-
-	for m := range o.machines {
-		o.State.NetworkState[m] = make(map[MachineID]*Link)
-
-		wg.Add(1)
-		go func(source MachineID, links map[MachineID]*Link) {
-			defer wg.Done()
-			//log.Tracef("blocking all links from %s", source)
-
-			for otherMachine := range o.machines {
-				// exclude self
-				if source == otherMachine {
-					continue
-				}
-
-				//log.Tracef("blocking link %s -> %s", source, otherMachine)
-				err := o.virt.BlockLink(source, otherMachine)
-				if err != nil {
-					e = errors.WithStack(err)
-				}
-
-				links[otherMachine] = &Link{
-					// likely better to have all links blocked at the beginning
-					Blocked: true,
-				}
-
-				// progress
-				progressLinks.Add(1)
-			}
-			//log.Tracef("done blocking all links from %s", source)
+			m := o.machines[ids[i]]
+			return errors.WithStack(o.virt.RegisterMachine(ids[i], m.name, m.Host, m.config))
+		})
+	}()
 
-		}(m, o.State.NetworkState[m])
+	err := waitProgress(done, "machine init", &progressMachines, len(ids))
+	if err != nil {
+		return errors.WithStack(err)
 	}
 
-	shown = 0
-	total = len(o.machines) * (len(o.machines) - 1)
-	for state := 0; state < total; state = int(progressLinks.Load()) {
-		if state > shown && state%100 == 0 {
-			log.Debugf("link init progress: %d/%d", progressLinks.Load(), total)
-			shown = state
-		}
-	}
+	// the backend blocks all links of a machine when it is registered, there
+	// is no need to block links one by one
+	log.Debugf("registered %d machines in %s, all links blocked", len(o.machines), time.Since(start))
 
-	wg.Wait()
-	if e != nil {
-		return errors.WithStack(e)
+	o.nodes, err = newNodeTable(o)
+	if err != nil {
+		return errors.WithStack(err)
 	}
 
-	log.Debugf("done blocking all links in %s", time.Since(start))
+	o.snapshot.Store(blockedSnapshot(o.nodes, o.links, o.machinesState))
 
 	o.initialized = true
 
@@ -186,6 +147,22 @@ func (o *Orchestrator) Initialize(machineList map[MachineID]MachineConfig, machi
 	return nil
 }
 
+// waitProgress waits for the result on done and logs the progress counter
+// every second in the meantime.
+func waitProgress(done <-chan error, what string, progress *atomic.Uint32, total int) error {
+	ticker := time.NewTicker(time.Second)
+	defer ticker.Stop()
+
+	for {
+		select {
+		case err := <-done:
+			return err
+		case <-ticker.C:
+			log.Debugf("%s progress: %d/%d", what, progress.Load(), total)
+		}
+	}
+}
+
 func (o *Orchestrator) Stop() error {
 	log.Debugf("stopping orchestrator")
 	err := o.virt.Stop()
@@ -197,117 +174,100 @@ func (o *Orchestrator) Stop() error {
 	return nil
 }
 
+// Update applies a complete state update at once.
 func (o *Orchestrator) Update(s *State) error {
-	// run the update procedure and apply changes
-
-	// 1. update all the links
-	linkUpdateStart := time.Now()
-	var wg sync.WaitGroup
-	var e error
-
-	for m, ls := range s.NetworkState {
-		wg.Add(1)
-		go func(source MachineID, links map[MachineID]*Link) {
-			defer wg.Done()
-			for target, l := range links {
-				if l.Blocked && !o.State.NetworkState[source][target].Blocked {
-					log.Tracef("blocking link %s -> %s", source, target)
-					err := o.virt.BlockLink(source, target)
-					if err != nil {
-						e = errors.WithStack(err)
-					}
-					o.State.NetworkState[source][target].Blocked = true
-				}
-
-				if !l.Blocked && o.State.NetworkState[source][target].Blocked {
-					log.Tracef("unblocking link %s -> %s", source, target)
-					err := o.virt.UnblockLink(source, target)
-					if err != nil {
-						e = errors.WithStack(err)
-					}
-					o.State.NetworkState[source][target].Blocked = false
-				}
-
-				if l.Blocked {
-					continue
-				}
-
-				log.Tracef("updating link %s -> %s", source, target)
-				if l.Next != o.State.NetworkState[source][target].Next {
-					log.Tracef("setting next hop %s -> %s to %s ", source, target, l.Next)
-					o.State.NetworkState[source][target].Next = l.Next
-				}
-
-				if l.LatencyUs != o.State.NetworkState[source][target].LatencyUs {
-					log.Tracef("changing latency %s -> %s from %d to %d", source, target, l.LatencyUs, o.State.NetworkState[source][target].LatencyUs)
-					err := o.virt.SetLatency(source, target, l.LatencyUs)
-					if err != nil {
-						e = errors.WithStack(err)
-					}
-					o.State.NetworkState[source][target].LatencyUs = l.LatencyUs
-				}
-
-				if l.BandwidthKbps != o.State.NetworkState[source][target].BandwidthKbps {
-					log.Tracef("setting bandwidth %s -> %s to %d", source, target, l.BandwidthKbps)
-					err := o.virt.SetBandwidth(source, target, l.BandwidthKbps)
-					if err != nil {
-						e = errors.WithStack(err)
-					}
-					o.State.NetworkState[source][target].BandwidthKbps = l.BandwidthKbps
-				}
-			}
-		}(m, ls)
-	}
+	u := o.BeginUpdate()
+	u.AddLinks(s.NetworkState)
+	u.AddMachines(s.MachinesState)
 
-	wg.Wait()
-	if e != nil {
-		return errors.WithStack(e)
+	_, err := u.Finish()
+	return errors.WithStack(err)
+}
+
+// updateLinks applies the link changes of one source machine to the link
+// table and passes them to the backend in a single batch. It only writes the
+// table row of its source, the rows of different sources can be updated
+// concurrently. Changes of the same source, e.g., from different chunks of a
+// streamed update, are never passed to the backend concurrently.
+func (o *Orchestrator) updateLinks(source MachineID, links map[MachineID]Link) error {
+	// collect all changes for this source, so that the backend can apply them
+	// in one go
+	updates := make([]LinkUpdate, 0, len(links))
+
+	t := o.links
+
+	i, ok := t.index[source]
+	if !ok {
+		return errors.Errorf("unknown machine %s", source)
 	}
 
-	log.Debugf("link update took %s", time.Since(linkUpdateStart))
-
-	// 2. update all the machines
-	machineUpdateStart := time.Now()
-	wg = sync.WaitGroup{}
-	e = nil
-
-	for m, state := range s.MachinesState {
-		if state == STOPPED && o.State.MachinesState[m] == ACTIVE {
-			wg.Add(1)
-			go func(machine MachineID) {
-				defer wg.Done()
-				// stop machine
-				err := o.virt.StopMachine(machine)
-				if err != nil {
-					e = errors.WithStack(err)
-				}
-			}(m)
-			o.State.MachinesState[m] = STOPPED
-			continue
+	o.rowLocks[i].Lock()
+	defer o.rowLocks[i].Unlock()
+
+	// the row goes into the next snapshot if anything changed, including
+	// next hops, which are not passed to the backend
+	changed := false
+	defer func() {
+		if changed {
+			o.dirtyRows[i] = true
 		}
+	}()
 
-		if state == ACTIVE && o.State.MachinesState[m] == STOPPED {
-			wg.Add(1)
-			go func(machine MachineID) {
-				defer wg.Done()
-				// start machine
-				err := o.virt.StartMachine(machine)
-				if err != nil {
-					e = errors.WithStack(err)
-				}
-			}(m)
-			o.State.MachinesState[m] = ACTIVE
-			continue
+	for target, l := range links {
+		k, ok := t.idx(source, target)
+		if !ok {
+			return errors.Errorf("unknown link %s -> %s", source, target)
 		}
-	}
 
-	wg.Wait()
-	if e != nil {
-		return errors.WithStack(e)
+		u := LinkUpdate{
+			Target: target,
+		}
+
+		if l.Blocked != t.blocked[k] {
+			log.Tracef("setting blocked %s -> %s to %t", source, target, l.Blocked)
+			u.Blocked = l.Blocked
+			u.BlockedChanged = true
+			t.blocked[k] = l.Blocked
+			changed = true
+		}
+
+		if !l.Blocked {
+			next, ok := t.index[l.Next]
+			if !ok {
+				return errors.Errorf("unknown next hop %s for link %s -> %s", l.Next, source, target)
+			}
+
+			if next != t.next[k] {
+				log.Tracef("setting next hop %s -> %s to %s ", source, target, l.Next)
+				t.next[k] = next
+				changed = true
+			}
+
+			if l.LatencyUs != t.latencyUs[k] {
+				log.Tracef("changing latency %s -> %s from %d to %d", source, target, t.latencyUs[k], l.LatencyUs)
+				u.LatencyUs = l.LatencyUs
+				u.LatencyChanged = true
+				t.latencyUs[k] = l.LatencyUs
+				changed = true
+			}
+
+			if l.BandwidthKbps != t.bandwidthKbps[k] {
+				log.Tracef("setting bandwidth %s -> %s to %d", source, target, l.BandwidthKbps)
+				u.BandwidthKbps = l.BandwidthKbps
+				u.BandwidthChanged = true
+				t.bandwidthKbps[k] = l.BandwidthKbps
+				changed = true
+			}
+		}
+
+		if u.BlockedChanged || u.LatencyChanged || u.BandwidthChanged {
+			updates = append(updates, u)
+		}
 	}
-	log.Debugf("machine update took %s", time.Since(machineUpdateStart))
 
-	log.Info("orchestrator updated")
+	if len(updates) == 0 {
+		return nil
+	}
 
-	return nil
+	return errors.WithStack(o.virt.UpdateLinks(source, updates))
 }
@@ -0,0 +1,65 @@
+/*
+* This file is part of Celestial (https://github.com/OpenFogStack/celestial).
+* Copyright (c) 2024 Tobias Pfandzelter, The OpenFogStack Team.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, version 3.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+**/
+
+package orchestrator
+
+import (
+	stderrors "errors"
+	"sync"
+	"sync/atomic"
+
+	"github.com/pkg/errors"
+)
+
+// forEach runs f for the jobs 0 to n-1 on at most workers goroutines. Each
+// worker takes the next job as soon as it is done with its last one, so a few
+// expensive jobs do not hold up the others. Put the expensive jobs first for
+// the best balance. Each worker collects its own errors, all of them are
+// returned together.
+func forEach(n int, workers int, f func(i int) error) error {
+	if workers > n {
+		workers = n
+	}
+
+	var next atomic.Int64
+	errs := make([][]error, workers)
+
+	var wg sync.WaitGroup
+
+	for w := 0; w < workers; w++ {
+		wg.Add(1)
+		go func(w int) {
+			defer wg.Done()
+
+			for i := int(next.Add(1) - 1); i < n; i = int(next.Add(1) - 1) {
+				err := f(i)
+				if err != nil {
+					errs[w] = append(errs[w], err)
+				}
+			}
+		}(w)
+	}
+
+	wg.Wait()
+
+	all := make([]error, 0)
+	for _, e := range errs {
+		all = append(all, e...)
+	}
+
+	return errors.WithStack(stderrors.Join(all...))
+}
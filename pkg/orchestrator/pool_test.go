@@ -0,0 +1,89 @@
+/*
+* This file is part of Celestial (https://github.com/OpenFogStack/celestial).
+* Copyright (c) 2024 Tobias Pfandzelter, The OpenFogStack Team.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, version 3.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+**/
+
+package orchestrator
+
+import (
+	"sync/atomic"
+	"testing"
+
+	"github.com/pkg/errors"
+)
+
+func Test_forEach(t *testing.T) {
+	tests := []struct {
+		name     string
+		n        int
+		workers  int
+		failing  int
+		wantErrs int
+	}{
+		{
+			name:    "test1",
+			n:       100,
+			workers: 4,
+		}, {
+			name:     "test2",
+			n:        100,
+			workers:  4,
+			failing:  10,
+			wantErrs: 10,
+		}, {
+			name:    "test3",
+			n:       2,
+			workers: 8,
+		}, {
+			name:    "test4",
+			n:       0,
+			workers: 8,
+		},
+	}
+	for _, tt := range tests {
+		t.Run(tt.name, func(t *testing.T) {
+			runs := make([]atomic.Uint32, tt.n)
+
+			err := forEach(tt.n, tt.workers, func(i int) error {
+				runs[i].Add(1)
+
+				if i < tt.failing {
+					return errors.Errorf("job %d failed", i)
+				}
+
+				return nil
+			})
+
+			for i := range runs {
+				if runs[i].Load() != 1 {
+					t.Errorf("forEach() ran job %d %d times, want 1", i, runs[i].Load())
+				}
+			}
+
+			if (err != nil) != (tt.wantErrs > 0) {
+				t.Fatalf("forEach() error = %v, want %d errors", err, tt.wantErrs)
+			}
+
+			if err == nil {
+				return
+			}
+
+			var joined interface{ Unwrap() []error }
+			if !errors.As(err, &joined) || len(joined.Unwrap()) != tt.wantErrs {
+				t.Errorf("forEach() error = %v, want %d errors", err, tt.wantErrs)
+			}
+		})
+	}
+}
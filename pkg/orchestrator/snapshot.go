@@ -0,0 +1,241 @@
+/*
+* This file is part of Celestial (https://github.com/OpenFogStack/celestial).
+* Copyright (c) 2024 Tobias Pfandzelter, The OpenFogStack Team.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, version 3.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+**/
+
+package orchestrator
+
+import (
+	"net"
+	"strings"
+	"sync"
+
+	"github.com/pkg/errors"
+)
+
+// nodeTable holds the lookup tables of the machines for the info and DNS
+// servers. Machines, their names, and their addresses do not change after
+// Initialize, so all snapshots share one nodeTable.
+type nodeTable struct {
+	// byName has the case-folded names of machines
+	byName map[string]MachineID
+	// ips are the addresses of the machines by link table index
+	ips []net.IP
+}
+
+func newNodeTable(o *Orchestrator) (*nodeTable, error) {
+	n := &nodeTable{
+		byName: make(map[string]MachineID, len(o.machineNames)),
+		ips:    make([]net.IP, len(o.links.ids)),
+	}
+
+	for name, id := range o.machineNames {
+		n.byName[strings.ToLower(name)] = id
+	}
+
+	for i, id := range o.links.ids {
+		ip, err := o.virt.GetIPAddress(id)
+		if err != nil {
+			return nil, errors.Wrapf(err, "could not get IP address of %s", id)
+		}
+
+		n.ips[i] = ip.IP
+	}
+
+	return n, nil
+}
+
+// linkRow is a copy of the links of one source machine, see LinkTable.
+type linkRow struct {
+	blocked       []bool
+	latencyUs     []uint32
+	bandwidthKbps []uint64
+	next          []uint32
+}
+
+// newLinkRow copies row i of a link table.
+func newLinkRow(t *LinkTable, i int) *linkRow {
+	lo, hi := i*t.n, (i+1)*t.n
+
+	return &linkRow{
+		blocked:       append([]bool(nil), t.blocked[lo:hi]...),
+		latencyUs:     append([]uint32(nil), t.latencyUs[lo:hi]...),
+		bandwidthKbps: append([]uint64(nil), t.bandwidthKbps[lo:hi]...),
+		next:          append([]uint32(nil), t.next[lo:hi]...),
+	}
+}
+
+// snapshot is an immutable copy of the state of the emulation after an
+// update. The orchestrator publishes a new snapshot with every update behind
+// an atomic pointer, so readers such as the info and DNS servers never wait
+// for an update, never slow it down, and never see half of one.
+//
+// Rows that did not change in an update are shared with the previous
+// snapshot, only changed rows are copied.
+type snapshot struct {
+	nodes *nodeTable
+
+	ids   []MachineID
+	index map[MachineID]uint32
+	rows  []*linkRow
+	// states are the machine states by link table index
+	states []MachineState
+
+	// paths memoizes the paths that were asked for, by source and target
+	// index
+	paths sync.Map
+}
+
+// blockedSnapshot creates the snapshot of a new link table, in which all links
+// are blocked (see newLinkTable). All of its rows are the same, so they share
+// a single row instead of copying the whole table.
+func blockedSnapshot(nodes *nodeTable, t *LinkTable, states MachinesState) *snapshot {
+	r := &linkRow{
+		blocked:       make([]bool, t.n),
+		latencyUs:     make([]uint32, t.n),
+		bandwidthKbps: make([]uint64, t.n),
+		next:          make([]uint32, t.n),
+	}
+
+	for j := range r.blocked {
+		r.blocked[j] = true
+	}
+
+	s := &snapshot{
+		nodes:  nodes,
+		ids:    t.ids,
+		index:  t.index,
+		rows:   make([]*linkRow, t.n),
+		states: make([]MachineState, t.n),
+	}
+
+	for i, id := range t.ids {
+		s.rows[i] = r
+		s.states[i] = states[id]
+	}
+
+	return s
+}
+
+// newSnapshot creates a snapshot of a link table and machine states.
+// Rows that are not dirty are taken from prev, which may be nil if all rows
+// are dirty.
+func newSnapshot(prev *snapshot, nodes *nodeTable, t *LinkTable, dirty []bool, states MachinesState, workers int) *snapshot {
+	s := &snapshot{
+		nodes:  nodes,
+		ids:    t.ids,
+		index:  t.index,
+		rows:   make([]*linkRow, t.n),
+		states: make([]MachineState, t.n),
+	}
+
+	copied := make([]int, 0, t.n)
+
+	for i := range s.rows {
+		if prev == nil || dirty[i] {
+			copied = append(copied, i)
+			continue
+		}
+
+		s.rows[i] = prev.rows[i]
+	}
+
+	// copying a row cannot fail
+	_ = forEach(len(copied), workers, func(j int) error {
+		s.rows[copied[j]] = newLinkRow(t, copied[j])
+		return nil
+	})
+
+	for i, id := range t.ids {
+		s.states[i] = states[id]
+	}
+
+	return s
+}
+
+func (s *snapshot) size() int {
+	return len(s.ids)
+}
+
+// get returns the link from a to b.
+func (s *snapshot) get(a, b MachineID) (Link, bool) {
+	i, ok := s.index[a]
+	if !ok {
+		return Link{}, false
+	}
+
+	j, ok := s.index[b]
+	if !ok {
+		return Link{}, false
+	}
+
+	r := s.rows[i]
+
+	return Link{
+		Blocked:       r.blocked[j],
+		LatencyUs:     r.latencyUs[j],
+		BandwidthKbps: r.bandwidthKbps[j],
+		Next:          s.ids[r.next[j]],
+	}, true
+}
+
+// active returns whether a machine is active.
+func (s *snapshot) active(id MachineID) bool {
+	i, ok := s.index[id]
+	if !ok {
+		return false
+	}
+
+	return s.states[i] == ACTIVE
+}
+
+// ip returns the address of a machine.
+func (s *snapshot) ip(id MachineID) (net.IP, bool) {
+	i, ok := s.index[id]
+	if !ok {
+		return nil, false
+	}
+
+	return s.nodes.ips[i], true
+}
+
+// path returns the path from a to b, it is only walked the first time it is
+// asked for. The segments of the path are shared and must not be modified.
+func (s *snapshot) path(a, b MachineID) (PathInfo, error) {
+	i, ok := s.index[a]
+	if !ok {
+		return PathInfo{}, errors.Errorf("no link from %s to %s", a.String(), b.String())
+	}
+
+	j, ok := s.index[b]
+	if !ok {
+		return PathInfo{}, errors.Errorf("no link from %s to %s", a.String(), b.String())
+	}
+
+	key := uint64(i)<<32 | uint64(j)
+
+	if p, ok := s.paths.Load(key); ok {
+		return p.(PathInfo), nil
+	}
+
+	p, err := path(a, b, s)
+	if err != nil {
+		return PathInfo{}, err
+	}
+
+	s.paths.Store(key, p)
+
+	return p, nil
+}
@@ -17,7 +17,11 @@
 
 package orchestrator
 
-import "fmt"
+import (
+	"fmt"
+	"net"
+	"time"
+)
 
 type MachineState uint8
 
@@ -38,6 +42,101 @@ type Link struct {
 	Next MachineID
 }
 
+// LinkChange is a change to the parameters of a link. Only the parameters
+// that are flagged as changed are applied, the others are left as they are.
+type LinkChange struct {
+	Blocked        bool
+	BlockedChanged bool
+
+	LatencyUs      uint32
+	LatencyChanged bool
+
+	BandwidthKbps    uint64
+	BandwidthChanged bool
+}
+
+// LinkUpdate is a change to the link to a target machine, it is applied in
+// bulk with the other link updates of a source machine.
+type LinkUpdate struct {
+	Target MachineID
+	LinkChange
+}
+
+// NetLinkUpdate is a LinkUpdate with the target resolved to its network.
+type NetLinkUpdate struct {
+	Target net.IPNet
+	LinkChange
+}
+
+// LinkStats are the traffic counters of a link as seen by the network
+// emulation.
+type LinkStats struct {
+	// Packets and Bytes that passed the link
+	Packets uint64
+	Bytes   uint64
+	// Drops counts packets dropped because the link is blocked or saturated
+	Drops uint64
+	// ECNMarks counts packets marked with ECN congestion experienced
+	ECNMarks uint64
+}
+
+// NetLinkStats are the LinkStats of the link to a target network.
+type NetLinkStats struct {
+	Target net.IPNet
+	LinkStats
+}
+
+// BootTimes are the durations of the phases of the last activation of a
+// machine.
+type BootTimes struct {
+	// Restored is true if the machine was restored from a snapshot instead of
+	// booted
+	Restored bool
+	// Prepare is the time to prepare the overlay and Firecracker
+	Prepare time.Duration
+	// Start is the time from starting Firecracker until the kernel was handed
+	// control, or until a snapshot was loaded and resumed
+	Start time.Duration
+	// Booted is true once the guest has signaled that it finished booting
+	Booted bool
+	// Guest is the time from kernel handoff until the guest finished booting
+	Guest time.Duration
+}
+
+// BootHistogramBuckets is the number of buckets in a BootHistogram.
+const BootHistogramBuckets = 17
+
+// BootHistogram counts durations in buckets that double in size. Counts[0]
+// counts durations below 1ms, Counts[i] durations below 2^i ms, and the last
+// bucket all longer durations.
+type BootHistogram struct {
+	Counts [BootHistogramBuckets]uint64
+	Count  uint64
+	Sum    time.Duration
+}
+
+// Add adds a duration to the histogram.
+func (h *BootHistogram) Add(d time.Duration) {
+	i := 0
+	for limit := time.Millisecond; i < BootHistogramBuckets-1 && d >= limit; limit *= 2 {
+		i++
+	}
+
+	h.Counts[i]++
+	h.Count++
+	h.Sum += d
+}
+
+// BootStats are histograms of the activation phases of all machines on a
+// host.
+type BootStats struct {
+	Prepare BootHistogram
+	Start   BootHistogram
+	Guest   BootHistogram
+	// Restore is the total time of activations from a snapshot
+	Restore BootHistogram
+}
+
 type MachineID struct {
 	// is 0 for ground stations
 	Group uint8
@@ -50,7 +149,9 @@ func (m MachineID) String() string {
 
 type Host uint8
 
-type NetworkState map[MachineID]map[MachineID]*Link
+// NetworkState is a sparse set of links, e.g., the links that changed in an
+// update. The orchestrator itself keeps the full state in a LinkTable.
+type NetworkState map[MachineID]map[MachineID]Link
 
 type MachinesState map[MachineID]MachineState
 
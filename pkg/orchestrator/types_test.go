@@ -0,0 +1,63 @@
+/*
+* This file is part of Celestial (https://github.com/OpenFogStack/celestial).
+* Copyright (c) 2024 Tobias Pfandzelter, The OpenFogStack Team.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, version 3.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+**/
+
+package orchestrator
+
+import (
+	"testing"
+	"time"
+)
+
+func TestBootHistogram_Add(t *testing.T) {
+	tests := []struct {
+		name   string
+		d      time.Duration
+		bucket int
+	}{
+		{
+			name:   "test1",
+			d:      500 * time.Microsecond,
+			bucket: 0,
+		}, {
+			name:   "test2",
+			d:      time.Millisecond,
+			bucket: 1,
+		}, {
+			name:   "test3",
+			d:      150 * time.Millisecond,
+			bucket: 8,
+		}, {
+			name:   "test4",
+			d:      time.Hour,
+			bucket: BootHistogramBuckets - 1,
+		},
+	}
+	for _, tt := range tests {
+		t.Run(tt.name, func(t *testing.T) {
+			h := BootHistogram{}
+			h.Add(tt.d)
+
+			if h.Counts[tt.bucket] != 1 {
+				t.Errorf("BootHistogram.Add(%s) counts = %v, want bucket %d", tt.d, h.Counts, tt.bucket)
+			}
+
+			if h.Count != 1 || h.Sum != tt.d {
+				t.Errorf("BootHistogram.Add(%s) count = %d, sum = %s", tt.d, h.Count, h.Sum)
+			}
+		})
+	}
+}
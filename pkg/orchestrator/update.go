@@ -0,0 +1,310 @@
+/*
+* This file is part of Celestial (https://github.com/OpenFogStack/celestial).
+* Copyright (c) 2024 Tobias Pfandzelter, The OpenFogStack Team.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, version 3.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+**/
+
+package orchestrator
+
+import (
+	stderrors "errors"
+	"fmt"
+	"sort"
+	"sync"
+	"time"
+
+	"github.com/pkg/errors"
+	log "github.com/sirupsen/logrus"
+)
+
+// UpdateTimings are the durations of the phases of one update.
+type UpdateTimings struct {
+	// Receive is the time from the start of the update until Finish was
+	// called, i.e., until the whole update was received.
+	Receive time.Duration
+	// Links is the time from the start of the update until all link updates
+	// were applied. Link updates are applied while the update is still being
+	// received, so this overlaps with Receive.
+	Links time.Duration
+	// Drain is the time Finish had to wait for link updates after the update
+	// was received.
+	Drain time.Duration
+	// Wait is the time a scheduled update was staged before its effective
+	// time.
+	Wait time.Duration
+	// Drift is how late a scheduled update was committed after its effective
+	// time.
+	Drift time.Duration
+	// Commit is the time it took to switch to the new link state.
+	Commit time.Duration
+	// Snapshot is the time it took to publish the new state for readers.
+	Snapshot time.Duration
+	// Machines is the time it took to start and stop machines.
+	Machines time.Duration
+	// Total is the wall-clock time of the whole update.
+	Total time.Duration
+}
+
+func (t UpdateTimings) String() string {
+	return fmt.Sprintf("receive %s, links %s (drain %s), wait %s, drift %s, commit %s, snapshot %s, machines %s, total %s", t.Receive, t.Links, t.Drain, t.Wait, t.Drift, t.Commit, t.Snapshot, t.Machines, t.Total)
+}
+
+// driftLogThreshold is the drift of a scheduled update above which it is
+// logged at info level. Less than that is down to the timer accuracy of a
+// host and only logged for debugging.
+const driftLogThreshold = time.Millisecond
+
+type linkJob struct {
+	source MachineID
+	links  map[MachineID]Link
+}
+
+// PendingUpdate is an update that is applied while it is still being
+// received. Link changes passed to AddLinks are handed to the link workers
+// right away, Finish waits for them and switches to the new state. A
+// PendingUpdate is not safe for concurrent use, and there may only be one
+// pending update at a time.
+type PendingUpdate struct {
+	o *Orchestrator
+
+	jobs chan linkJob
+	wg   sync.WaitGroup
+	// errs has one error list per worker
+	errs [][]error
+
+	machinesState MachinesState
+
+	// timestep and effective are set for scheduled updates, see Schedule
+	timestep  uint64
+	effective time.Time
+
+	start      time.Time
+	sources    int
+	linksDone  time.Time
+	linksMutex sync.Mutex
+}
+
+// BeginUpdate starts a new update and its link workers. The update must be
+// completed with either Finish or Abort.
+func (o *Orchestrator) BeginUpdate() *PendingUpdate {
+	u := &PendingUpdate{
+		o: o,
+		// a small buffer is enough to keep the workers busy, a full buffer
+		// slows down the receiver instead of piling up changes in memory
+		jobs:          make(chan linkJob, 2*o.workers),
+		errs:          make([][]error, o.workers),
+		machinesState: make(MachinesState),
+		start:         time.Now(),
+	}
+
+	u.wg.Add(o.workers)
+	for w := 0; w < o.workers; w++ {
+		go u.work(w)
+	}
+
+	return u
+}
+
+func (u *PendingUpdate) work(w int) {
+	defer u.wg.Done()
+
+	for j := range u.jobs {
+		err := u.o.updateLinks(j.source, j.links)
+		if err != nil {
+			u.errs[w] = append(u.errs[w], err)
+		}
+	}
+
+	u.linksMutex.Lock()
+	if now := time.Now(); now.After(u.linksDone) {
+		u.linksDone = now
+	}
+	u.linksMutex.Unlock()
+}
+
+// AddLinks queues the link changes in ns, which may be one chunk of the
+// update. The chunk must not be modified afterwards. Chunks are applied in no
+// particular order, so each link may only be changed once per update.
+// AddLinks blocks while all workers are busy.
+func (u *PendingUpdate) AddLinks(ns NetworkState) {
+	// sources with the most changes (usually ground stations) go first, so
+	// that no worker is left with a big one at the end
+	sources := make([]MachineID, 0, len(ns))
+	for m := range ns {
+		sources = append(sources, m)
+	}
+
+	sort.Slice(sources, func(a, b int) bool {
+		return len(ns[sources[a]]) > len(ns[sources[b]])
+	})
+
+	for _, m := range sources {
+		u.jobs <- linkJob{source: m, links: ns[m]}
+	}
+
+	u.sources += len(sources)
+}
+
+// AddMachines adds machine state changes to the update. They are applied in
+// Finish, after the links.
+func (u *PendingUpdate) AddMachines(ms MachinesState) {
+	for m, state := range ms {
+		u.machinesState[m] = state
+	}
+}
+
+// Schedule sets the wall-clock time at which the update takes effect. Link
+// changes are still staged as they arrive, but Finish waits until the
+// effective time before it commits them, so that all hosts switch at the same
+// time regardless of how long they took to receive and stage the update. If
+// staging took until after the effective time, the update is committed right
+// away and the drift is reported. The timestep is only used for reporting.
+func (u *PendingUpdate) Schedule(timestep uint64, effective time.Time) {
+	u.timestep = timestep
+	u.effective = effective
+}
+
+// wait stops the workers once all queued link changes are applied and
+// returns their errors.
+func (u *PendingUpdate) wait() error {
+	close(u.jobs)
+	u.wg.Wait()
+
+	all := make([]error, 0)
+	for _, e := range u.errs {
+		all = append(all, e...)
+	}
+
+	if len(all) == 0 {
+		return nil
+	}
+
+	return errors.WithStack(stderrors.Join(all...))
+}
+
+// Abort stops the update without switching to the new link state, e.g.,
+// because the update could not be received completely. Link changes that
+// were already applied stay staged and take effect with the next commit, they
+// are published to readers with the snapshot of that commit.
+func (u *PendingUpdate) Abort() {
+	err := u.wait()
+	if err != nil {
+		log.Errorf("error in aborted update: %s", err.Error())
+	}
+}
+
+// Finish waits for all link changes, switches to the new link state (at the
+// effective time of a scheduled update), and then applies the machine state
+// changes.
+func (u *PendingUpdate) Finish() (UpdateTimings, error) {
+	o := u.o
+	t := UpdateTimings{}
+
+	received := time.Now()
+	t.Receive = received.Sub(u.start)
+
+	// 1. wait for all the links
+	err := u.wait()
+	if err != nil {
+		return t, errors.WithStack(err)
+	}
+
+	t.Drain = time.Since(received)
+	t.Links = u.linksDone.Sub(u.start)
+
+	// everything is staged, a scheduled update now only waits for its
+	// effective time
+	if !u.effective.IsZero() {
+		t.Wait = time.Until(u.effective)
+
+		if t.Wait > 0 {
+			time.Sleep(t.Wait)
+		} else {
+			t.Wait = 0
+		}
+	}
+
+	// switch all links to the new state at once
+	commitStart := time.Now()
+
+	if !u.effective.IsZero() {
+		t.Drift = commitStart.Sub(u.effective)
+
+		if t.Wait == 0 {
+			log.Warnf("timestep %d was staged %s after its effective time", u.timestep, t.Drift)
+		}
+
+		if t.Drift > driftLogThreshold {
+			log.Infof("timestep %d: drift %s", u.timestep, t.Drift)
+		} else {
+			log.Debugf("timestep %d: drift %s", u.timestep, t.Drift)
+		}
+	}
+
+	err = o.virt.CommitLinks()
+	if err != nil {
+		return t, errors.WithStack(err)
+	}
+	t.Commit = time.Since(commitStart)
+
+	log.Debugf("link update for %d sources took %s", u.sources, t.Links)
+
+	type transition struct {
+		machine MachineID
+		state   MachineState
+	}
+
+	transitions := make([]transition, 0)
+
+	for m, state := range u.machinesState {
+		if state != o.machinesState[m] {
+			transitions = append(transitions, transition{machine: m, state: state})
+			o.machinesState[m] = state
+		}
+	}
+
+	// publish the new state, only the rows that changed are copied
+	snapshotStart := time.Now()
+	o.snapshot.Store(newSnapshot(o.snapshot.Load(), o.nodes, o.links, o.dirtyRows, o.machinesState, o.workers))
+	clear(o.dirtyRows)
+	t.Snapshot = time.Since(snapshotStart)
+
+	// 2. update all the machines
+	machineUpdateStart := time.Now()
+
+	err = forEach(len(transitions), o.workers, func(i int) error {
+		t := transitions[i]
+
+		switch t.state {
+		case STOPPED:
+			return errors.WithStack(o.virt.StopMachine(t.machine))
+		case ACTIVE:
+			return errors.WithStack(o.virt.StartMachine(t.machine))
+		}
+
+		return nil
+	})
+	if err != nil {
+		return t, errors.WithStack(err)
+	}
+
+	t.Machines = time.Since(machineUpdateStart)
+	t.Total = time.Since(u.start)
+
+	log.Debugf("machine update for %d machines took %s", len(transitions), t.Machines)
+
+	log.Infof("orchestrator updated: %s", t)
+
+	return t, nil
+}
@@ -0,0 +1,304 @@
+/*
+* This file is part of Celestial (https://github.com/OpenFogStack/celestial).
+* Copyright (c) 2024 Tobias Pfandzelter, The OpenFogStack Team.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, version 3.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+**/
+
+package orchestrator
+
+import (
+	"fmt"
+	"net"
+	"reflect"
+	"sync"
+	"testing"
+	"time"
+)
+
+// fakeBackend only records link updates and commits.
+type fakeBackend struct {
+	sync.Mutex
+	updates map[MachineID]int
+	commits int
+}
+
+func (f *fakeBackend) RegisterMachine(MachineID, string, Host, MachineConfig) error { return nil }
+func (f *fakeBackend) BlockLink(MachineID, MachineID) error                         { return nil }
+func (f *fakeBackend) UnblockLink(MachineID, MachineID) error                       { return nil }
+func (f *fakeBackend) SetLatency(MachineID, MachineID, uint32) error                { return nil }
+func (f *fakeBackend) SetBandwidth(MachineID, MachineID, uint64) error              { return nil }
+func (f *fakeBackend) UpdateLinks(source MachineID, updates []LinkUpdate) error {
+	f.Lock()
+	defer f.Unlock()
+	f.updates[source] += len(updates)
+	return nil
+}
+func (f *fakeBackend) CommitLinks() error {
+	f.Lock()
+	defer f.Unlock()
+	f.commits++
+	return nil
+}
+func (f *fakeBackend) GetLinkStats(MachineID) (map[MachineID]LinkStats, error) { return nil, nil }
+func (f *fakeBackend) GetBootTimes(MachineID) (BootTimes, error)               { return BootTimes{}, nil }
+func (f *fakeBackend) GetBootStats() (BootStats, error)                        { return BootStats{}, nil }
+func (f *fakeBackend) StopMachine(MachineID) error                             { return nil }
+func (f *fakeBackend) StartMachine(MachineID) error                            { return nil }
+func (f *fakeBackend) GetIPAddress(MachineID) (net.IPNet, error)               { return net.IPNet{}, nil }
+func (f *fakeBackend) ResolveIPAddress(net.IP) (MachineID, error)              { return MachineID{}, nil }
+func (f *fakeBackend) Stop() error                                             { return nil }
+
+func TestPendingUpdate(t *testing.T) {
+	const n = 16
+
+	ids := make([]MachineID, n)
+	machines := make(map[MachineID]MachineConfig)
+	for i := range ids {
+		ids[i] = MachineID{Group: 1, Id: uint32(i)}
+		machines[ids[i]] = MachineConfig{}
+	}
+
+	f := &fakeBackend{updates: make(map[MachineID]int)}
+	o := New(f)
+
+	err := o.Initialize(machines, map[MachineID]Host{}, map[MachineID]string{})
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	u := o.BeginUpdate()
+
+	// one chunk per target, so that every source is in every chunk
+	for j := range ids {
+		chunk := make(NetworkState)
+		for i := range ids {
+			if i == j {
+				continue
+			}
+			chunk[ids[i]] = map[MachineID]Link{
+				ids[j]: {LatencyUs: uint32(i + j), BandwidthKbps: 1000, Next: ids[j]},
+			}
+		}
+		u.AddLinks(chunk)
+	}
+
+	u.AddMachines(MachinesState{ids[0]: ACTIVE})
+
+	_, err = u.Finish()
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	if f.commits != 1 {
+		t.Errorf("got %d commits, want 1", f.commits)
+	}
+
+	for i := range ids {
+		if f.updates[ids[i]] != n-1 {
+			t.Errorf("got %d updates for %s, want %d", f.updates[ids[i]], ids[i], n-1)
+		}
+
+		for j := range ids {
+			if i == j {
+				continue
+			}
+
+			l, ok := o.links.get(ids[i], ids[j])
+			if !ok || l.Blocked || l.LatencyUs != uint32(i+j) {
+				t.Errorf("link %s -> %s: got %+v, want latency %d", ids[i], ids[j], l, i+j)
+			}
+		}
+	}
+
+	if o.machinesState[ids[0]] != ACTIVE {
+		t.Errorf("machine %s not active", ids[0])
+	}
+}
+
+func TestScheduledUpdate(t *testing.T) {
+	ids := []MachineID{{Group: 1, Id: 0}, {Group: 1, Id: 1}}
+	machines := map[MachineID]MachineConfig{ids[0]: {}, ids[1]: {}}
+
+	f := &fakeBackend{updates: make(map[MachineID]int)}
+	o := New(f)
+
+	err := o.Initialize(machines, map[MachineID]Host{}, map[MachineID]string{})
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	type args struct {
+		delay time.Duration
+	}
+	tests := []struct {
+		name     string
+		args     args
+		wantWait bool
+	}{
+		{
+			name:     "test1",
+			args:     args{delay: 50 * time.Millisecond},
+			wantWait: true,
+		},
+		{
+			// staged too late, committed right away
+			name:     "test2",
+			args:     args{delay: -50 * time.Millisecond},
+			wantWait: false,
+		},
+	}
+	for i, tt := range tests {
+		t.Run(tt.name, func(t *testing.T) {
+			effective := time.Now().Add(tt.args.delay)
+
+			u := o.BeginUpdate()
+			u.Schedule(uint64(i), effective)
+			u.AddLinks(NetworkState{
+				ids[0]: {ids[1]: {LatencyUs: uint32(i + 1), BandwidthKbps: 1000, Next: ids[1]}},
+			})
+
+			timings, err := u.Finish()
+			if err != nil {
+				t.Fatal(err)
+			}
+
+			if (timings.Wait > 0) != tt.wantWait {
+				t.Errorf("got wait %s, want wait %t", timings.Wait, tt.wantWait)
+			}
+
+			if timings.Drift < 0 {
+				t.Errorf("committed %s before the effective time", -timings.Drift)
+			}
+
+			if tt.wantWait && timings.Drift > 20*time.Millisecond {
+				t.Errorf("got drift %s", timings.Drift)
+			}
+		})
+	}
+
+	if f.commits != len(tests) {
+		t.Errorf("got %d commits, want %d", f.commits, len(tests))
+	}
+}
+
+func TestSnapshot(t *testing.T) {
+	const n = 4
+
+	ids := make([]MachineID, n)
+	machines := make(map[MachineID]MachineConfig)
+	for i := range ids {
+		ids[i] = MachineID{Group: 1, Id: uint32(i)}
+		machines[ids[i]] = MachineConfig{}
+	}
+
+	o := New(&fakeBackend{updates: make(map[MachineID]int)})
+
+	err := o.Initialize(machines, map[MachineID]Host{}, map[MachineID]string{})
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	before := o.snapshot.Load()
+
+	if before.rows[0] != before.rows[n-1] {
+		t.Errorf("expected the rows of the initial snapshot to be shared")
+	}
+
+	// a chain 0 -> 1 -> 2, only the rows of 0 and 1 change
+	err = o.Update(&State{
+		NetworkState: NetworkState{
+			ids[0]: {
+				ids[1]: {LatencyUs: 10, BandwidthKbps: 1000, Next: ids[1]},
+				ids[2]: {LatencyUs: 30, BandwidthKbps: 1000, Next: ids[1]},
+			},
+			ids[1]: {
+				ids[2]: {LatencyUs: 20, BandwidthKbps: 1000, Next: ids[2]},
+			},
+		},
+		MachinesState: MachinesState{ids[0]: ACTIVE},
+	})
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	after := o.snapshot.Load()
+
+	if l, _ := before.get(ids[0], ids[1]); !l.Blocked {
+		t.Errorf("old snapshot changed: got %+v, want blocked", l)
+	}
+
+	if before.active(ids[0]) || !after.active(ids[0]) {
+		t.Errorf("machine %s: got active %t before and %t after", ids[0], before.active(ids[0]), after.active(ids[0]))
+	}
+
+	if after.rows[2] != before.rows[2] || after.rows[0] == before.rows[0] {
+		t.Errorf("expected only changed rows to be copied")
+	}
+
+	want, err := path(ids[0], ids[2], o.links)
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	for i := 0; i < 2; i++ {
+		got, err := o.InfoGetPath(ids[0], ids[2])
+		if err != nil {
+			t.Fatal(err)
+		}
+
+		if !reflect.DeepEqual(got, want) {
+			t.Errorf("path: got %+v, want %+v", got, want)
+		}
+	}
+}
+
+// BenchmarkUpdate measures applying a timestep in which every machine changes
+// its links to the next ten machines, without a backend.
+func BenchmarkUpdate(b *testing.B) {
+	for _, n := range []int{100, 1000, 10000} {
+		b.Run(fmt.Sprintf("%d", n), func(b *testing.B) {
+			ids := make([]MachineID, n)
+			machines := make(map[MachineID]MachineConfig)
+			for i := range ids {
+				ids[i] = MachineID{Group: 1, Id: uint32(i)}
+				machines[ids[i]] = MachineConfig{}
+			}
+
+			o := New(&fakeBackend{updates: make(map[MachineID]int)})
+
+			err := o.Initialize(machines, map[MachineID]Host{}, map[MachineID]string{})
+			if err != nil {
+				b.Fatal(err)
+			}
+
+			b.ResetTimer()
+
+			for i := 0; i < b.N; i++ {
+				ns := make(NetworkState)
+				for j := range ids {
+					ns[ids[j]] = make(map[MachineID]Link)
+					for k := 1; k <= 10 && k < n; k++ {
+						target := ids[(j+k)%n]
+						ns[ids[j]][target] = Link{LatencyUs: uint32(i + k), BandwidthKbps: 1000, Next: target}
+					}
+				}
+
+				err := o.Update(&State{NetworkState: ns})
+				if err != nil {
+					b.Fatal(err)
+				}
+			}
+		})
+	}
+}
@@ -20,11 +20,23 @@ package orchestrator
 import "net"
 
 type VirtualizationBackend interface {
+	// RegisterMachine registers a machine. All links of a new machine are
+	// blocked until they are unblocked.
 	RegisterMachine(machine MachineID, name string, host Host, config MachineConfig) error
 	BlockLink(source MachineID, target MachineID) error
 	UnblockLink(source MachineID, target MachineID) error
 	SetLatency(source MachineID, target MachineID, latency uint32) error
 	SetBandwidth(source MachineID, target MachineID, bandwidth uint64) error
+	// UpdateLinks applies a batch of link updates for one source machine.
+	UpdateLinks(source MachineID, updates []LinkUpdate) error
+	// CommitLinks makes all link updates from UpdateLinks visible at once.
+	CommitLinks() error
+	// GetLinkStats returns the traffic counters of the links of a source machine.
+	GetLinkStats(source MachineID) (map[MachineID]LinkStats, error)
+	// GetBootTimes returns the phases of the last activation of a machine.
+	GetBootTimes(machine MachineID) (BootTimes, error)
+	// GetBootStats returns histograms of the activations of all machines.
+	GetBootStats() (BootStats, error)
 	StopMachine(machine MachineID) error
 	StartMachine(machine MachineID) error
 	GetIPAddress(id MachineID) (net.IPNet, error)
@@ -162,80 +162,53 @@ func (s *Server) Update(stream celestial.Celestial_UpdateServer) error {
 
 	log.Debug("server: received update stream")
 
-	parseStart := time.Now()
+	// each chunk of the stream is applied while the next ones are still
+	// arriving, only the commit waits for the end of the stream
+	u := s.o.BeginUpdate()
 
-	ns := make(orchestrator.NetworkState)
-	ms := make(map[orchestrator.MachineID]orchestrator.MachineState)
+	var parseTime time.Duration
 
 	// updates are streamed to us, we need to iterate until the stream ends
 	for update, err := stream.Recv(); err != io.EOF; update, err = stream.Recv() {
 		log.Debugf("received update")
 
 		if err != nil {
+			u.Abort()
 			return errors.WithStack(err)
 		}
 
+		parseUpdateStart := time.Now()
+
+		// the update is staged as it arrives and committed at its
+		// effective time
+		if update.EffectiveUnixUs != 0 {
+			u.Schedule(update.Timestep, time.UnixMicro(update.EffectiveUnixUs))
+		}
+
+		ns := make(orchestrator.NetworkState)
+
 		// not a fan of the indentation but we need to check
 		// for nil here...
 		if update.NetworkDiffs != nil {
-			parseUpdateStart := time.Now()
 			for _, n := range update.NetworkDiffs {
-				a := orchestrator.MachineID{
-					Group: uint8(n.Source.Group),
-					Id:    n.Source.Id,
-				}
-
-				if _, ok := ns[a]; !ok {
-					ns[a] = make(map[orchestrator.MachineID]*orchestrator.Link)
-				}
-
-				b := orchestrator.MachineID{
-					Group: uint8(n.Target.Group),
-					Id:    n.Target.Id,
-				}
-
-				if _, ok := ns[b]; !ok {
-					ns[b] = make(map[orchestrator.MachineID]*orchestrator.Link)
-				}
-
-				if n.Blocked {
-					ns[a][b] = &orchestrator.Link{
-						Blocked: true,
-					}
-					ns[b][a] = &orchestrator.Link{
-						Blocked: true,
-					}
-
-					continue
-				}
-
-				ns[a][b] = &orchestrator.Link{
-					LatencyUs:     n.LatencyUs,
-					BandwidthKbps: n.BandwidthKbps,
-					Blocked:       false,
-					Next: orchestrator.MachineID{
-						Group: uint8(n.Next.Group),
-						Id:    n.Next.Id,
-					},
-				}
-				ns[b][a] = &orchestrator.Link{
-					LatencyUs:     n.LatencyUs,
-					BandwidthKbps: n.BandwidthKbps,
-					Blocked:       false,
-					Next: orchestrator.MachineID{
-						Group: uint8(n.Prev.Group),
-						Id:    n.Prev.Id,
-					},
-				}
-
+				addLink(ns,
+					machineID(n.Source), machineID(n.Target),
+					n.Blocked, n.LatencyUs, n.BandwidthKbps,
+					machineID(n.Next), machineID(n.Prev),
+				)
 			}
-			log.Debugf("parse update time: %v", time.Since(parseUpdateStart))
 		}
 
-		if update.MachineDiffs == nil {
-			continue
+		if p := update.GetPackedNetworkDiffs(); p != nil {
+			err := addPackedLinks(ns, p)
+			if err != nil {
+				u.Abort()
+				return err
+			}
 		}
 
+		ms := make(orchestrator.MachinesState)
+
 		for _, m := range update.MachineDiffs {
 			id := orchestrator.MachineID{
 				Group: uint8(m.Id.Group),
@@ -249,18 +222,94 @@ func (s *Server) Update(stream celestial.Celestial_UpdateServer) error {
 				ms[id] = orchestrator.STOPPED
 			}
 		}
-	}
 
-	log.Debugf("parse time: %v", time.Since(parseStart))
+		parseTime += time.Since(parseUpdateStart)
+
+		u.AddLinks(ns)
+		u.AddMachines(ms)
+	}
 
-	err := s.o.Update(&orchestrator.State{
-		NetworkState:  ns,
-		MachinesState: ms,
-	})
+	t, err := u.Finish()
 
 	if err != nil {
 		return err
 	}
 
+	log.Debugf("parse time: %v of %v receive time", parseTime, t.Receive)
+
 	return stream.SendAndClose(&celestial.Empty{})
 }
+
+// machineID converts a protobuf machine ID, which may be nil for blocked
+// links, into an orchestrator machine ID.
+func machineID(m *celestial.MachineID) orchestrator.MachineID {
+	return orchestrator.MachineID{
+		Group: uint8(m.GetGroup()),
+		Id:    m.GetId(),
+	}
+}
+
+// packedMachineID decodes a machine ID of PackedNetworkDiffs, which is
+// group << 24 | id.
+func packedMachineID(m uint32) orchestrator.MachineID {
+	return orchestrator.MachineID{
+		Group: uint8(m >> 24),
+		Id:    m & (1<<24 - 1),
+	}
+}
+
+// addLink adds a network diff to ns, for both directions of the link.
+func addLink(ns orchestrator.NetworkState, a, b orchestrator.MachineID, blocked bool, latencyUs uint32, bandwidthKbps uint64, next, prev orchestrator.MachineID) {
+	if _, ok := ns[a]; !ok {
+		ns[a] = make(map[orchestrator.MachineID]orchestrator.Link)
+	}
+
+	if _, ok := ns[b]; !ok {
+		ns[b] = make(map[orchestrator.MachineID]orchestrator.Link)
+	}
+
+	if blocked {
+		ns[a][b] = orchestrator.Link{
+			Blocked: true,
+		}
+		ns[b][a] = orchestrator.Link{
+			Blocked: true,
+		}
+
+		return
+	}
+
+	ns[a][b] = orchestrator.Link{
+		LatencyUs:     latencyUs,
+		BandwidthKbps: bandwidthKbps,
+		Blocked:       false,
+		Next:          next,
+	}
+	ns[b][a] = orchestrator.Link{
+		LatencyUs:     latencyUs,
+		BandwidthKbps: bandwidthKbps,
+		Blocked:       false,
+		Next:          prev,
+	}
+}
+
+// addPackedLinks adds all network diffs of a PackedNetworkDiffs to ns. The
+// columns are read in place, nothing is allocated per link except for the
+// map entries.
+func addPackedLinks(ns orchestrator.NetworkState, p *celestial.StateUpdateRequest_PackedNetworkDiffs) error {
+	n := len(p.Source)
+
+	if len(p.Target) != n || len(p.Blocked) != n || len(p.LatencyUs) != n || len(p.BandwidthKbps) != n || len(p.Next) != n || len(p.Prev) != n {
+		return errors.Errorf("packed network diffs have columns of different length")
+	}
+
+	for i := 0; i < n; i++ {
+		addLink(ns,
+			packedMachineID(p.Source[i]), packedMachineID(p.Target[i]),
+			p.Blocked[i], p.LatencyUs[i], p.BandwidthKbps[i],
+			packedMachineID(p.Next[i]), packedMachineID(p.Prev[i]),
+		)
+	}
+
+	return nil
+}
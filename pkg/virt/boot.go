@@ -0,0 +1,142 @@
+/*
+* This file is part of Celestial (https://github.com/OpenFogStack/celestial).
+* Copyright (c) 2024 Tobias Pfandzelter, The OpenFogStack Team.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, version 3.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+**/
+
+package virt
+
+import (
+	"bytes"
+	"io"
+	"sync"
+	"time"
+
+	log "github.com/sirupsen/logrus"
+
+	"github.com/OpenFogStack/celestial/pkg/orchestrator"
+)
+
+// BOOT_SIGNAL is what Firecracker logs when the guest writes to the boot timer
+// port, which fcinit does once the guest has booted.
+var BOOT_SIGNAL = []byte("Guest-boot-time")
+
+// bootStats collects the activation phases of all machines on this host.
+type bootStats struct {
+	stats orchestrator.BootStats
+	sync.Mutex
+}
+
+// bootTimer records the activation phases of one machine.
+type bootTimer struct {
+	stats *bootStats
+
+	// guarded by stats
+	times orchestrator.BootTimes
+	// handoff is when the kernel was handed control, it is zero while no boot
+	// signal is expected
+	handoff time.Time
+}
+
+func (s *bootStats) newTimer() *bootTimer {
+	return &bootTimer{
+		stats: s,
+	}
+}
+
+func (s *bootStats) get() orchestrator.BootStats {
+	s.Lock()
+	defer s.Unlock()
+
+	return s.stats
+}
+
+// started records an activation that was prepared at prepared and started at
+// started, i.e., the kernel was handed control or the snapshot was resumed.
+func (b *bootTimer) started(begin time.Time, prepared time.Time, started time.Time, restored bool) {
+	b.stats.Lock()
+	defer b.stats.Unlock()
+
+	b.times = orchestrator.BootTimes{
+		Restored: restored,
+		Prepare:  prepared.Sub(begin),
+		Start:    started.Sub(prepared),
+	}
+
+	b.stats.stats.Prepare.Add(b.times.Prepare)
+	b.stats.stats.Start.Add(b.times.Start)
+
+	if restored {
+		b.stats.stats.Restore.Add(started.Sub(begin))
+		b.handoff = time.Time{}
+		return
+	}
+
+	b.handoff = started
+}
+
+// booted records the boot signal of the guest.
+func (b *bootTimer) booted(at time.Time) {
+	b.stats.Lock()
+	defer b.stats.Unlock()
+
+	if b.handoff.IsZero() {
+		return
+	}
+
+	b.times.Booted = true
+	b.times.Guest = at.Sub(b.handoff)
+	b.handoff = time.Time{}
+
+	b.stats.stats.Guest.Add(b.times.Guest)
+}
+
+func (b *bootTimer) get() orchestrator.BootTimes {
+	b.stats.Lock()
+	defer b.stats.Unlock()
+
+	return b.times
+}
+
+// bootSignalWriter passes the Firecracker log to w and watches it for the
+// boot signal.
+type bootSignalWriter struct {
+	w     io.Writer
+	timer *bootTimer
+	line  []byte
+}
+
+func (b *bootSignalWriter) Write(p []byte) (int, error) {
+	now := time.Now()
+
+	for rest := p; len(rest) > 0; {
+		i := bytes.IndexByte(rest, '\n')
+		if i < 0 {
+			b.line = append(b.line, rest...)
+			break
+		}
+
+		b.line = append(b.line, rest[:i]...)
+		rest = rest[i+1:]
+
+		if bytes.Contains(b.line, BOOT_SIGNAL) {
+			log.Tracef("boot signal: %s", b.line)
+			b.timer.booted(now)
+		}
+
+		b.line = b.line[:0]
+	}
+
+	return b.w.Write(p)
+}
@@ -0,0 +1,64 @@
+/*
+* This file is part of Celestial (https://github.com/OpenFogStack/celestial).
+* Copyright (c) 2024 Tobias Pfandzelter, The OpenFogStack Team.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, version 3.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+**/
+
+package virt
+
+import (
+	"bytes"
+	"testing"
+	"time"
+)
+
+func Test_bootSignalWriter(t *testing.T) {
+	s := &bootStats{}
+	timer := s.newTimer()
+
+	begin := time.Now()
+	timer.started(begin, begin.Add(time.Millisecond), begin.Add(3*time.Millisecond), false)
+
+	out := &bytes.Buffer{}
+	w := &bootSignalWriter{w: out, timer: timer}
+
+	// the signal may be split across writes
+	logs := []string{
+		"2024-01-01T00:00:00 [anonymous-instance:main] Running Firecracker\n2024-01-01T00:00:01 [anonymous-instance:fc_vcpu 0] Guest-boo",
+		"t-time =  80000 us 80 ms,  70000 CPU us 70 CPU ms\n",
+	}
+
+	for _, l := range logs {
+		_, err := w.Write([]byte(l))
+		if err != nil {
+			t.Fatal(err)
+		}
+	}
+
+	if out.String() != logs[0]+logs[1] {
+		t.Errorf("log not passed through: %q", out.String())
+	}
+
+	b := timer.get()
+
+	if !b.Booted || b.Prepare != time.Millisecond || b.Start != 2*time.Millisecond {
+		t.Errorf("got boot times %+v", b)
+	}
+
+	st := s.get()
+
+	if st.Prepare.Count != 1 || st.Start.Count != 1 || st.Guest.Count != 1 || st.Restore.Count != 0 {
+		t.Errorf("got boot stats %+v", st)
+	}
+}
@@ -62,3 +62,41 @@ func (v *Virt) blocklink(source orchestrator.MachineID, target orchestrator.Mach
 	}
 	return v.neb.BlockLink(source, n)
 }
+
+func (v *Virt) updatelinks(source orchestrator.MachineID, updates []orchestrator.LinkUpdate) error {
+	nu := make([]orchestrator.NetLinkUpdate, len(updates))
+
+	for i, u := range updates {
+		n, err := v.getNetwork(u.Target)
+		if err != nil {
+			return err
+		}
+
+		nu[i] = orchestrator.NetLinkUpdate{
+			Target:     n,
+			LinkChange: u.LinkChange,
+		}
+	}
+
+	return v.neb.UpdateLinks(source, nu)
+}
+
+func (v *Virt) getlinkstats(source orchestrator.MachineID) (map[orchestrator.MachineID]orchestrator.LinkStats, error) {
+	stats, err := v.neb.LinkStats(source)
+	if err != nil {
+		return nil, err
+	}
+
+	s := make(map[orchestrator.MachineID]orchestrator.LinkStats, len(stats))
+
+	for _, l := range stats {
+		target, err := getID(l.Target.IP)
+		if err != nil {
+			return nil, err
+		}
+
+		s[target] = l.LinkStats
+	}
+
+	return s, nil
+}
@@ -76,6 +76,56 @@ func (m *machine) removeNetwork() error {
 }
 
 func (m *machine) initialize() error {
+	// prepare our root file system
+	err := m.overlays.create(m.overlayPath(), m.disksize)
+
+	if err != nil {
+		return err
+	}
+
+	return m.createVM()
+}
+
+func (m *machine) overlayPath() string {
+	return path.Join(ROOTPATH, fmt.Sprintf("ce%s.ext4", m.name))
+}
+
+// snapshotPaths returns the paths of the memory file and the machine state
+// file of a snapshot of the machine.
+func (m *machine) snapshotPaths() (string, string) {
+	return path.Join(ROOTPATH, fmt.Sprintf("ce%s.mem", m.name)), path.Join(ROOTPATH, fmt.Sprintf("ce%s.snap", m.name))
+}
+
+// openOutputs opens the output and log files of the machine. They are only
+// opened once: a restored machine keeps writing to the same files.
+func (m *machine) openOutputs() error {
+	if m.outFile != nil {
+		return nil
+	}
+
+	files := make([]*os.File, 0, 3)
+
+	for _, ext := range []string{"out", "err", "log"} {
+		f, err := os.OpenFile(filepath.Join(OUTPUTPATH, fmt.Sprintf("%s.%s", m.name, ext)), os.O_CREATE|os.O_WRONLY|os.O_APPEND, 0644)
+
+		if err != nil {
+			for _, f := range files {
+				_ = f.Close()
+			}
+			return errors.WithStack(err)
+		}
+
+		files = append(files, f)
+	}
+
+	m.outFile, m.errFile, m.logFile = files[0], files[1], files[2]
+
+	return nil
+}
+
+// createVM creates the Firecracker machine. Options such as
+// firecracker.WithSnapshot are applied to it.
+func (m *machine) createVM(opts ...firecracker.Opt) error {
 
 	// create the network config for our firecracker vm
 	fcNetworkConfig := []firecracker.NetworkInterface{
@@ -96,37 +146,12 @@ func (m *machine) initialize() error {
 		},
 	}
 
-	// prepare our root file system
-	overlay := path.Join(ROOTPATH, fmt.Sprintf("ce%s.ext4", m.name))
-
-	// dd if=/dev/zero of=[TARGET_OVERLAY_FILE] conv=sparse bs=1M count=[DISK_SIZE]
-	cmd := exec.Command(DD_BIN, "if=/dev/zero", fmt.Sprintf("of=%s", overlay), "conv=sparse", "bs=1M", fmt.Sprintf("count=%d", m.disksize))
-
-	if out, err := cmd.CombinedOutput(); err != nil {
-		return errors.Wrapf(err, "%#v: output: %s", cmd.Args, out)
-	}
-
-	// mkfs.ext4 [TARGET_OVERLAY_FILE]
-	cmd = exec.Command(MKFS_BIN, overlay)
-
-	if out, err := cmd.CombinedOutput(); err != nil {
-		return errors.Wrapf(err, "%#v: output: %s", cmd.Args, out)
-	}
-
-	outPath := filepath.Join(OUTPUTPATH, fmt.Sprintf("%s.out", m.name))
-
-	errPath := filepath.Join(OUTPUTPATH, fmt.Sprintf("%s.err", m.name))
+	overlay := m.overlayPath()
 
-	outFile, err := os.Create(outPath)
+	err := m.openOutputs()
 
 	if err != nil {
-		return errors.WithStack(err)
-	}
-
-	errFile, err := os.Create(errPath)
-
-	if err != nil {
-		return errors.WithStack(err)
+		return err
 	}
 
 	socketPath := getSocketPath(m.name)
@@ -144,7 +169,7 @@ func (m *machine) initialize() error {
 		}
 	}
 
-	firecrackerProcessRunner, err := getFirecrackerProcessRunner(socketPath, outFile, errFile)
+	firecrackerProcessRunner, err := getFirecrackerProcessRunner(socketPath, m.outFile, m.errFile)
 
 	if err != nil {
 		return errors.WithStack(err)
@@ -152,12 +177,21 @@ func (m *machine) initialize() error {
 
 	var loglevel string
 
-	// unfortunately Firecracker is incredibly verbose
+	// unfortunately Firecracker is incredibly verbose, but it logs the boot
+	// signal at the info level, so its log goes to a separate file
 	switch log.GetLevel() {
 	case log.TraceLevel:
 		loglevel = "TRACE"
 	default:
-		loglevel = "ERROR"
+		loglevel = "INFO"
+	}
+
+	// Firecracker cannot reuse the fifo of a previous process
+	fifoPath := filepath.Join(OUTPUTPATH, fmt.Sprintf("%s.fifo", m.name))
+
+	err = os.Remove(fifoPath)
+	if err != nil && !os.IsNotExist(err) {
+		return errors.WithStack(err)
 	}
 
 	// magic!
@@ -206,8 +240,10 @@ func (m *machine) initialize() error {
 		},
 		MetricsPath:       metricsPath, // 新增此行
 		LogLevel:          loglevel,
+		LogFifo:           fifoPath,
+		FifoLogWriter:     &bootSignalWriter{w: m.logFile, timer: m.boot},
 		NetworkInterfaces: fcNetworkConfig,
-	}, firecrackerProcessRunner)
+	}, append([]firecracker.Opt{firecrackerProcessRunner}, opts...)...)
 
 	switch log.GetLevel() {
 	case log.TraceLevel:
@@ -272,6 +308,8 @@ func getFirecrackerProcessRunner(socketPath string, outFile io.Writer, errFile i
 	return firecracker.WithProcessRunner(firecracker.VMCommandBuilder{}.
 		WithBin(firecrackerBinary).
 		WithSocketPath(socketPath).
+		// fcinit signals the end of the boot on the boot timer port
+		WithArgs([]string{"--boot-timer"}).
 		WithStdout(outFile).
 		WithStderr(errFile).
 		Build(context.Background())), nil
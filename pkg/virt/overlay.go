@@ -0,0 +1,195 @@
+/*
+* This file is part of Celestial (https://github.com/OpenFogStack/celestial).
+* Copyright (c) 2024 Tobias Pfandzelter, The OpenFogStack Team.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, version 3.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+**/
+
+package virt
+
+import (
+	"fmt"
+	"os"
+	"os/exec"
+	"path"
+	"sync"
+
+	"github.com/pkg/errors"
+	log "github.com/sirupsen/logrus"
+	"golang.org/x/sys/unix"
+)
+
+// overlayPool provides the writable overlays of machines. Formatting an
+// overlay is slow, so there is one formatted template overlay per disk size
+// that is created once, in the background when the first machine with that
+// disk size is registered. Machines get a clone of that template.
+type overlayPool struct {
+	templates map[uint64]*overlayTemplate
+	sync.Mutex
+}
+
+type overlayTemplate struct {
+	path  string
+	ready chan struct{}
+	err   error
+}
+
+// prepare starts creating the template for an overlay of size MiB, if that
+// has not happened yet.
+func (p *overlayPool) prepare(size uint64) *overlayTemplate {
+	p.Lock()
+	defer p.Unlock()
+
+	if p.templates == nil {
+		p.templates = make(map[uint64]*overlayTemplate)
+	}
+
+	if t, ok := p.templates[size]; ok {
+		return t
+	}
+
+	t := &overlayTemplate{
+		path:  path.Join(ROOTPATH, fmt.Sprintf("cetemplate-%d.ext4", size)),
+		ready: make(chan struct{}),
+	}
+
+	p.templates[size] = t
+
+	go func() {
+		defer close(t.ready)
+		t.err = createOverlay(t.path, size)
+		if t.err != nil {
+			log.Errorf("could not create overlay template %s: %s", t.path, t.err.Error())
+		}
+	}()
+
+	return t
+}
+
+// create creates an overlay of size MiB at overlay by cloning the template.
+func (p *overlayPool) create(overlay string, size uint64) error {
+	t := p.prepare(size)
+
+	<-t.ready
+
+	if t.err != nil {
+		return t.err
+	}
+
+	return cloneFile(t.path, overlay)
+}
+
+// createOverlay creates a sparse file of size MiB and formats it.
+func createOverlay(overlay string, size uint64) error {
+	f, err := os.Create(overlay)
+	if err != nil {
+		return errors.WithStack(err)
+	}
+
+	err = f.Truncate(int64(size) << 20)
+	if err != nil {
+		_ = f.Close()
+		return errors.WithStack(err)
+	}
+
+	err = f.Close()
+	if err != nil {
+		return errors.WithStack(err)
+	}
+
+	// mkfs.ext4 [TARGET_OVERLAY_FILE]
+	cmd := exec.Command(MKFS_BIN, overlay)
+
+	if out, err := cmd.CombinedOutput(); err != nil {
+		return errors.Wrapf(err, "%#v: output: %s", cmd.Args, out)
+	}
+
+	return nil
+}
+
+// cloneFile copies src to dst. On file systems with reflinks (e.g., XFS or
+// btrfs) this only shares the extents of src. Otherwise, only the data
+// regions of src are copied, holes stay holes.
+func cloneFile(src string, dst string) error {
+	s, err := os.Open(src)
+	if err != nil {
+		return errors.WithStack(err)
+	}
+	defer s.Close()
+
+	d, err := os.OpenFile(dst, os.O_CREATE|os.O_WRONLY|os.O_TRUNC, 0644)
+	if err != nil {
+		return errors.WithStack(err)
+	}
+
+	err = unix.IoctlFileClone(int(d.Fd()), int(s.Fd()))
+	if err != nil {
+		log.Tracef("cannot reflink %s to %s, copying instead: %s", src, dst, err.Error())
+		err = sparseCopy(s, d)
+	}
+
+	if err != nil {
+		_ = d.Close()
+		return err
+	}
+
+	return errors.WithStack(d.Close())
+}
+
+// sparseCopy copies the data regions of src to dst in the kernel.
+func sparseCopy(src *os.File, dst *os.File) error {
+	info, err := src.Stat()
+	if err != nil {
+		return errors.WithStack(err)
+	}
+
+	size := info.Size()
+
+	err = dst.Truncate(size)
+	if err != nil {
+		return errors.WithStack(err)
+	}
+
+	sfd := int(src.Fd())
+	dfd := int(dst.Fd())
+
+	for off := int64(0); off < size; {
+		data, err := unix.Seek(sfd, off, unix.SEEK_DATA)
+		if errors.Is(err, unix.ENXIO) {
+			// only a hole left
+			return nil
+		}
+		if err != nil {
+			return errors.WithStack(err)
+		}
+
+		hole, err := unix.Seek(sfd, data, unix.SEEK_HOLE)
+		if err != nil {
+			return errors.WithStack(err)
+		}
+
+		for sOff, dOff := data, data; sOff < hole; {
+			n, err := unix.CopyFileRange(sfd, &sOff, dfd, &dOff, int(hole-sOff), 0)
+			if err != nil {
+				return errors.WithStack(err)
+			}
+			if n == 0 {
+				return errors.Errorf("unexpected end of %s at %d", src.Name(), sOff)
+			}
+		}
+
+		off = hole
+	}
+
+	return nil
+}
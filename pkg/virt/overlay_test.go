@@ -0,0 +1,85 @@
+/*
+* This file is part of Celestial (https://github.com/OpenFogStack/celestial).
+* Copyright (c) 2024 Tobias Pfandzelter, The OpenFogStack Team.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, version 3.
+*
+* This program is distributed in the hope that it will be useful, but
+* WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+**/
+
+package virt
+
+import (
+	"bytes"
+	"os"
+	"path/filepath"
+	"syscall"
+	"testing"
+)
+
+func Test_cloneFile(t *testing.T) {
+	dir := t.TempDir()
+	src := filepath.Join(dir, "src")
+	dst := filepath.Join(dir, "dst")
+
+	f, err := os.Create(src)
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	// 64 MiB with data only at the start, in the middle, and at the end
+	size := int64(64 << 20)
+	err = f.Truncate(size)
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	for _, off := range []int64{0, size / 2, size - 4096} {
+		_, err = f.WriteAt(bytes.Repeat([]byte{0xce}, 4096), off)
+		if err != nil {
+			t.Fatal(err)
+		}
+	}
+
+	err = f.Close()
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	err = cloneFile(src, dst)
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	want, err := os.ReadFile(src)
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	got, err := os.ReadFile(dst)
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	if !bytes.Equal(got, want) {
+		t.Fatalf("content of %s differs from %s", dst, src)
+	}
+
+	info, err := os.Stat(dst)
+	if err != nil {
+		t.Fatal(err)
+	}
+
+	// the holes must not be filled
+	if blocks := info.Sys().(*syscall.Stat_t).Blocks * 512; blocks >= size/2 {
+		t.Errorf("clone allocates %d bytes for %d bytes of data", blocks, 3*4096)
+	}
+}
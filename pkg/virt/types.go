@@ -19,7 +19,9 @@ package virt
 
 import (
 	"net"
+	"os"
 	"sync"
+	"time"
 
 	"github.com/firecracker-microvm/firecracker-go-sdk"
 
@@ -33,6 +35,8 @@ const (
 	STARTED
 	STOPPED
 	KILLED
+	// RELEASED machines are stopped and only exist as a snapshot on disk
+	RELEASED
 )
 
 const HOST_INTERFACE = "ens4"
@@ -45,7 +49,6 @@ var (
 	IP6TABLES_BIN string
 	IP_BIN       string
 	SYSCTL_BIN   string
-	DD_BIN       string
 	MKFS_BIN     string
 )
 
@@ -62,6 +65,8 @@ type machine struct {
 	name string
 
 	state state
+	// stoppedAt is when the machine was last suspended
+	stoppedAt time.Time
 
 	vcpucount  uint8
 	ram        uint64
@@ -72,7 +77,17 @@ type machine struct {
 
 	network network
 
+	overlays *overlayPool
+	boot     *bootTimer
+
 	vm *firecracker.Machine
+	// outFile, errFile and logFile outlive vm, which is recreated on every
+	// restore
+	outFile *os.File
+	errFile *os.File
+	logFile *os.File
+
+	sync.Mutex
 }
 
 // Virt provides virtualization functionality using firecracker.
@@ -81,8 +96,16 @@ type Virt struct {
 	initDelay     uint64 // ignored
 	pb            PeeringBackend
 	neb           NetworkEmulationBackend
+	// releaseAfter is how long a machine may be stopped until it is
+	// released, 0 means never
+	releaseAfter time.Duration
+	done         chan struct{}
+	// stopOnce closes done, Stop may be called more than once
+	stopOnce sync.Once
 
 	machines map[orchestrator.MachineID]*machine
+	overlays overlayPool
+	boot     bootStats
 	sync.RWMutex
 }
 
@@ -95,10 +118,32 @@ type PeeringBackend interface {
 
 // NetworkEmulationBackend is the interface for the network emulation backend.
 type NetworkEmulationBackend interface {
+	// Register prepares network emulation for a machine. Links are blocked by
+	// default: until a link is unblocked, the backend drops its traffic
+	// without needing a per-link entry, e.g., a missing link table entry or a
+	// single default drop rule.
 	Register(id orchestrator.MachineID, tap string) error
 	SetBandwidth(source orchestrator.MachineID, target net.IPNet, bandwidth uint64) error
 	SetLatency(source orchestrator.MachineID, target net.IPNet, latency uint32) error
 	UnblockLink(source orchestrator.MachineID, target net.IPNet) error
 	BlockLink(source orchestrator.MachineID, target net.IPNet) error
+	// UpdateLinks applies a batch of link updates for one source machine.
+	// Backends that cannot do this in bulk may loop over the updates.
+	UpdateLinks(source orchestrator.MachineID, updates []orchestrator.NetLinkUpdate) error
+	// CommitLinks makes all link updates from UpdateLinks visible at once.
+	// Backends that apply updates right away do nothing here.
+	CommitLinks() error
+	// LinkStats returns the traffic counters of the links of a source machine.
+	LinkStats(source orchestrator.MachineID) ([]orchestrator.NetLinkStats, error)
 	Stop() error
 }
+
+// LocalForwardingBackend is implemented by network emulation backends that
+// can forward traffic between machines on this host themselves, without the
+// host network stack. Traffic to machines on other hosts still goes through
+// the peering backend.
+type LocalForwardingBackend interface {
+	// AddLocal makes a registered machine with the given MAC address
+	// reachable directly from the other machines on this host.
+	AddLocal(id orchestrator.MachineID, mac net.HardwareAddr) error
+}
@@ -21,7 +21,9 @@ import (
 	"fmt"
 	"os/exec"
 	"sync"
+	"time"
 
+	"github.com/pkg/errors"
 	log "github.com/sirupsen/logrus"
 
 	"github.com/OpenFogStack/celestial/pkg/orchestrator"
@@ -46,12 +48,6 @@ func checkCommands() (err error) {
 		return err
 	}
 
-	DD_BIN, err = exec.LookPath("dd")
-
-	if err != nil {
-		return err
-	}
-
 	MKFS_BIN, err = exec.LookPath("mkfs.ext4")
 
 	if err != nil {
@@ -67,8 +63,9 @@ func checkCommands() (err error) {
 	return nil
 }
 
-// New creates a new virt backend.
-func New(hostInterface string, initDelay uint64, pb PeeringBackend, neb NetworkEmulationBackend) (*Virt, error) {
+// New creates a new virt backend. Machines that are stopped for at least
+// releaseAfter are snapshotted to disk to free their memory, 0 disables this.
+func New(hostInterface string, initDelay uint64, releaseAfter time.Duration, pb PeeringBackend, neb NetworkEmulationBackend) (*Virt, error) {
 
 	err := checkCommands()
 
@@ -81,6 +78,8 @@ func New(hostInterface string, initDelay uint64, pb PeeringBackend, neb NetworkE
 		initDelay:     initDelay,
 		pb:            pb,
 		neb:           neb,
+		releaseAfter:  releaseAfter,
+		done:          make(chan struct{}),
 		machines:      make(map[orchestrator.MachineID]*machine),
 	}
 
@@ -90,6 +89,10 @@ func New(hostInterface string, initDelay uint64, pb PeeringBackend, neb NetworkE
 		return nil, err
 	}
 
+	if releaseAfter > 0 {
+		go v.releaseStopped()
+	}
+
 	return v, nil
 }
 
@@ -191,6 +194,55 @@ func (v *Virt) SetBandwidth(source orchestrator.MachineID, target orchestrator.M
 	return v.setbandwidth(source, target, bandwidth)
 }
 
+// UpdateLinks applies a batch of link updates for one source machine using the network emulation backend.
+func (v *Virt) UpdateLinks(source orchestrator.MachineID, updates []orchestrator.LinkUpdate) error {
+	// check that the source machine is on this host, otherwise discard
+	v.RLock()
+	_, ok := v.machines[source]
+	defer v.RUnlock()
+	if !ok {
+		return nil
+	}
+
+	return v.updatelinks(source, updates)
+}
+
+// CommitLinks makes all link updates visible using the network emulation backend.
+func (v *Virt) CommitLinks() error {
+	return v.neb.CommitLinks()
+}
+
+// GetLinkStats returns the traffic counters of the links of a source machine from the network emulation backend.
+func (v *Virt) GetLinkStats(source orchestrator.MachineID) (map[orchestrator.MachineID]orchestrator.LinkStats, error) {
+	// only machines on this host have link stats
+	v.RLock()
+	_, ok := v.machines[source]
+	defer v.RUnlock()
+	if !ok {
+		return nil, errors.Errorf("machine %s is not on this host", source)
+	}
+
+	return v.getlinkstats(source)
+}
+
+// GetBootTimes returns the phases of the last activation of a machine.
+func (v *Virt) GetBootTimes(machine orchestrator.MachineID) (orchestrator.BootTimes, error) {
+	// only machines on this host are booted here
+	v.RLock()
+	m, ok := v.machines[machine]
+	defer v.RUnlock()
+	if !ok {
+		return orchestrator.BootTimes{}, errors.Errorf("machine %s is not on this host", machine)
+	}
+
+	return m.boot.get(), nil
+}
+
+// GetBootStats returns histograms of the activations of all machines on this host.
+func (v *Virt) GetBootStats() (orchestrator.BootStats, error) {
+	return v.boot.get(), nil
+}
+
 func (v *Virt) StopMachine(machine orchestrator.MachineID) error {
 	// check that the source machine is on this host, otherwise discard
 	v.RLock()
@@ -216,6 +268,8 @@ func (v *Virt) StartMachine(machine orchestrator.MachineID) error {
 }
 
 func (v *Virt) Stop() error {
+	v.stopOnce.Do(func() { close(v.done) })
+
 	log.Debugf("stopping %d machines", len(v.machines))
 	var wg sync.WaitGroup
 	for m := range v.machines {
@@ -20,12 +20,21 @@
 package virt
 
 import (
+	"archive/zip"
+	"encoding/binary"
+	"flag"
 	"fmt"
+	"io"
+	"os"
+	"path"
+	"strconv"
+	"strings"
 	"sync"
 	"sync/atomic"
 	"testing"
 	"time"
 
+	"github.com/pkg/errors"
 	log "github.com/sirupsen/logrus"
 
 	"github.com/OpenFogStack/celestial/pkg/ebpfem"
@@ -48,15 +57,24 @@ func TestMain(m *testing.M) {
 }
 
 func createNMachines(v *Virt, n int) error {
-	// create the machines (but only the network part)
-
-	progress := 0
-	for i := 0; i < n; i++ {
+	ids := make([]orchestrator.MachineID, n)
 
-		id := orchestrator.MachineID{
+	for i := range ids {
+		ids[i] = orchestrator.MachineID{
 			Group: 1,
 			Id:    uint32(i),
 		}
+	}
+
+	return createMachines(v, ids)
+}
+
+func createMachines(v *Virt, ids []orchestrator.MachineID) error {
+	// create the machines (but only the network part)
+
+	n := len(ids)
+	progress := 0
+	for _, id := range ids {
 
 		mNetwork, err := getNet(id)
 
@@ -250,7 +268,15 @@ func removeAllLinks(v *Virt) error {
 	return nil
 }
 
-func runNebBenchmark(b *testing.B, backend string, num int) {
+var (
+	benchMachines  = flag.String("bench-machines", "1,10,100,1000", "Comma-separated numbers of machines to run the benchmarks with")
+	benchTrace     = flag.String("bench-trace", "", "Celestial .zip file to replay a timestep of in BenchmarkTimestep instead of a synthetic diff")
+	benchTimestep  = flag.String("bench-trace-timestep", "", "Timestep of -bench-trace to replay, by default the one with the most link diffs")
+	benchBackends  = []string{"ebpf", "netem"}
+	benchLatencyUs = uint32(100)
+)
+
+func newBenchVirt(backend string) *Virt {
 	var n NetworkEmulationBackend
 	switch backend {
 	case "netem":
@@ -261,82 +287,469 @@ func runNebBenchmark(b *testing.B, backend string, num int) {
 		panic("unknown backend")
 	}
 
-	v, err := New(NET_IF, 0, nil, n)
+	v, err := New(NET_IF, 0, 0, nil, n)
 
 	if err != nil {
 		panic(err)
 	}
 
-	b.StartTimer()
+	return v
+}
 
-	err = createNMachines(v, num)
+func teardown(v *Virt) {
+	err := v.neb.Stop()
 
 	if err != nil {
 		panic(err)
 	}
 
-	err = blockAllLinks(v)
+	err = removeAllLinks(v)
 
 	if err != nil {
 		panic(err)
 	}
+}
+
+// runPhases runs a benchmark for every backend and number of machines. Only
+// phase is timed, setup prepares the machines for it and is not timed.
+func runPhases(b *testing.B, setup func(v *Virt, num int) error, phase func(v *Virt) error) {
+	for _, num := range benchSizes() {
+		for _, backend := range benchBackends {
+			b.Run(fmt.Sprintf("%s%d", backend, num), func(b *testing.B) {
+				for i := 0; i < b.N; i++ {
+					b.StopTimer()
+
+					v := newBenchVirt(backend)
+
+					err := setup(v, num)
+
+					if err != nil {
+						b.Fatal(err)
+					}
+
+					b.StartTimer()
+
+					err = phase(v)
+
+					b.StopTimer()
+
+					if err != nil {
+						b.Fatal(err)
+					}
+
+					teardown(v)
+				}
+			})
+		}
+	}
+}
+
+func benchSizes() []int {
+	sizes := make([]int, 0)
+
+	for _, s := range strings.Split(*benchMachines, ",") {
+		n, err := strconv.Atoi(strings.TrimSpace(s))
+		if err != nil {
+			panic(err)
+		}
+
+		sizes = append(sizes, n)
+	}
+
+	return sizes
+}
+
+// BenchmarkRegister measures creating the network of machines and registering
+// them with the network emulation, which also blocks all their links.
+func BenchmarkRegister(b *testing.B) {
+	for _, num := range benchSizes() {
+		for _, backend := range benchBackends {
+			b.Run(fmt.Sprintf("%s%d", backend, num), func(b *testing.B) {
+				for i := 0; i < b.N; i++ {
+					b.StopTimer()
+					v := newBenchVirt(backend)
+					b.StartTimer()
+
+					err := createNMachines(v, num)
+
+					b.StopTimer()
+
+					if err != nil {
+						b.Fatal(err)
+					}
+
+					teardown(v)
+				}
+			})
+		}
+	}
+}
+
+// BenchmarkUnblock measures unblocking all links between machines one by one.
+func BenchmarkUnblock(b *testing.B) {
+	runPhases(b, createNMachines, unblockAllLinks)
+}
+
+// BenchmarkBlock measures blocking all links between machines one by one after
+// they were unblocked.
+func BenchmarkBlock(b *testing.B) {
+	runPhases(b, func(v *Virt, num int) error {
+		err := createNMachines(v, num)
+		if err != nil {
+			return err
+		}
+		return unblockAllLinks(v)
+	}, blockAllLinks)
+}
+
+// BenchmarkLatency measures setting the latency of all links one by one.
+func BenchmarkLatency(b *testing.B) {
+	runPhases(b, func(v *Virt, num int) error {
+		err := createNMachines(v, num)
+		if err != nil {
+			return err
+		}
+		return unblockAllLinks(v)
+	}, func(v *Virt) error {
+		return latencyAllLinks(v, benchLatencyUs)
+	})
+}
+
+// BenchmarkTimestep measures applying the link changes of one timestep in
+// bulk, as the orchestrator does. With -bench-trace, a timestep of a real
+// trace is replayed with its machines, otherwise every machine changes its
+// links to the next ten machines.
+func BenchmarkTimestep(b *testing.B) {
+	var diff map[orchestrator.MachineID][]orchestrator.LinkUpdate
+
+	if *benchTrace != "" {
+		var err error
+		diff, err = readTraceTimestep(*benchTrace, *benchTimestep)
+
+		if err != nil {
+			b.Fatal(err)
+		}
+
+		ids := make([]orchestrator.MachineID, 0, len(diff))
+		for id := range diff {
+			ids = append(ids, id)
+		}
+
+		for _, backend := range benchBackends {
+			b.Run(fmt.Sprintf("%s-trace%d", backend, len(ids)), func(b *testing.B) {
+				for i := 0; i < b.N; i++ {
+					b.StopTimer()
+					v := newBenchVirt(backend)
+
+					err := createMachines(v, ids)
+					if err != nil {
+						b.Fatal(err)
+					}
+
+					b.StartTimer()
+
+					err = applyDiff(v, diff)
+
+					b.StopTimer()
+
+					if err != nil {
+						b.Fatal(err)
+					}
+
+					teardown(v)
+				}
+			})
+		}
+
+		return
+	}
 
-	err = unblockAllLinks(v)
+	runPhases(b, func(v *Virt, num int) error {
+		diff = syntheticDiff(num, 10)
+		return createNMachines(v, num)
+	}, func(v *Virt) error {
+		return applyDiff(v, diff)
+	})
+}
 
+// BenchmarkTeardown measures stopping the network emulation and removing the
+// network of all machines.
+func BenchmarkTeardown(b *testing.B) {
+	for _, num := range benchSizes() {
+		for _, backend := range benchBackends {
+			b.Run(fmt.Sprintf("%s%d", backend, num), func(b *testing.B) {
+				for i := 0; i < b.N; i++ {
+					b.StopTimer()
+					v := newBenchVirt(backend)
+
+					err := createNMachines(v, num)
+					if err != nil {
+						b.Fatal(err)
+					}
+
+					err = unblockAllLinks(v)
+					if err != nil {
+						b.Fatal(err)
+					}
+
+					b.StartTimer()
+					teardown(v)
+				}
+			})
+		}
+	}
+}
+
+// applyDiff applies the link updates of all sources in parallel and commits
+// them.
+func applyDiff(v *Virt, diff map[orchestrator.MachineID][]orchestrator.LinkUpdate) error {
+	var wg sync.WaitGroup
+	errs := make(chan error, len(diff))
+
+	for source, updates := range diff {
+		wg.Add(1)
+		go func(source orchestrator.MachineID, updates []orchestrator.LinkUpdate) {
+			defer wg.Done()
+
+			err := v.updatelinks(source, updates)
+			if err != nil {
+				errs <- err
+			}
+		}(source, updates)
+	}
+
+	wg.Wait()
+	close(errs)
+
+	for err := range errs {
+		return err
+	}
+
+	return v.neb.CommitLinks()
+}
+
+// syntheticDiff unblocks the links of every machine to the next k machines
+// and sets their latency and bandwidth.
+func syntheticDiff(num int, k int) map[orchestrator.MachineID][]orchestrator.LinkUpdate {
+	diff := make(map[orchestrator.MachineID][]orchestrator.LinkUpdate, num)
+
+	for i := 0; i < num; i++ {
+		source := orchestrator.MachineID{Group: 1, Id: uint32(i)}
+
+		for j := 1; j <= k && j < num; j++ {
+			diff[source] = append(diff[source], orchestrator.LinkUpdate{
+				Target: orchestrator.MachineID{Group: 1, Id: uint32((i + j) % num)},
+				LinkChange: orchestrator.LinkChange{
+					BlockedChanged:   true,
+					LatencyUs:        benchLatencyUs * uint32(j),
+					LatencyChanged:   true,
+					BandwidthKbps:    1_000_000,
+					BandwidthChanged: true,
+				},
+			})
+		}
+	}
+
+	return diff
+}
+
+// TRACE_LINK_DIFF_SIZE is the size of a link diff in a trace, see
+// LINK_DIFF_DTYPE in celestial/types.py. TRACE_V1_LINK_DIFF_SIZE is the size
+// in version 1 traces, see _V1_DIFF_LINK_DTYPE in celestial/zip_serializer.py.
+const (
+	TRACE_LINK_DIFF_SIZE    = 25
+	TRACE_V1_LINK_DIFF_SIZE = 21
+	TRACE_INDEX_ENTRY_SIZE  = 40
+)
+
+// readTraceTimestep reads the link diffs of a timestep from a Celestial .zip
+// file as link updates of both directions.
+func readTraceTimestep(filename string, timestep string) (map[orchestrator.MachineID][]orchestrator.LinkUpdate, error) {
+	f, err := os.Open(filename)
 	if err != nil {
-		panic(err)
+		return nil, errors.WithStack(err)
 	}
+	defer f.Close()
 
-	err = latencyAllLinks(v, 100)
+	info, err := f.Stat()
+	if err != nil {
+		return nil, errors.WithStack(err)
+	}
 
+	r, err := zip.NewReader(f, info.Size())
 	if err != nil {
-		panic(err)
+		return nil, errors.WithStack(err)
+	}
+
+	members := make(map[string]*zip.File)
+	for _, m := range r.File {
+		members[path.Base(m.Name)] = m
 	}
 
-	b.StopTimer()
+	if _, ok := members["v"]; !ok {
+		return readTraceTimestepV1(members, filename, timestep)
+	}
 
-	err = v.neb.Stop()
+	x, ok := members["x"]
+	if !ok {
+		return nil, errors.Errorf("no index in %s", filename)
+	}
 
+	index, err := readTraceMember(x)
 	if err != nil {
-		panic(err)
+		return nil, errors.WithStack(err)
 	}
 
-	err = removeAllLinks(v)
+	// <i8 t, <u8 link_offset, <u8 link_count, <u8 machine_offset, <u8 machine_count
+	var offset, count uint64
+	found := false
+
+	for e := index; len(e) >= TRACE_INDEX_ENTRY_SIZE; e = e[TRACE_INDEX_ENTRY_SIZE:] {
+		t := strconv.FormatInt(int64(binary.LittleEndian.Uint64(e[0:8])), 10)
+		o := binary.LittleEndian.Uint64(e[8:16])
+		c := binary.LittleEndian.Uint64(e[16:24])
+
+		if timestep != "" {
+			if t == timestep {
+				offset, count, found = o, c, true
+				break
+			}
+			continue
+		}
+
+		if !found || c > count {
+			offset, count, found = o, c, true
+		}
+	}
+
+	if !found {
+		return nil, errors.Errorf("no link diffs for timestep %q in %s", timestep, filename)
+	}
 
+	l, ok := members["L"]
+	if !ok {
+		return nil, errors.Errorf("no link diffs in %s", filename)
+	}
+
+	// the blocks are stored uncompressed, so we can read just this one
+	start, err := l.DataOffset()
 	if err != nil {
-		panic(err)
+		return nil, errors.WithStack(err)
 	}
-}
 
-func Benchmark(b *testing.B) {
-	var benchmarks []struct {
-		name    string
-		backend string
-		num     int
-	}
-
-	for _, num := range []int{1, 10, 100, 1000} { // 10000
-		for _, backend := range []string{"ebpf", "netem"} {
-			benchmarks = append(benchmarks, struct {
-				name    string
-				backend string
-				num     int
-			}{
-				fmt.Sprintf("%s%d", backend, num),
-				backend,
-				num,
-			})
+	b := make([]byte, count*TRACE_LINK_DIFF_SIZE)
+	_, err = f.ReadAt(b, start+int64(offset*TRACE_LINK_DIFF_SIZE))
+	if err != nil {
+		return nil, errors.WithStack(err)
+	}
+
+	log.Infof("replaying %d link diffs from %s", count, filename)
+
+	diff := make(map[orchestrator.MachineID][]orchestrator.LinkUpdate)
+
+	unpack := func(p uint32) orchestrator.MachineID {
+		return orchestrator.MachineID{Group: uint8(p >> 24), Id: p & (1<<24 - 1)}
+	}
+
+	for d := b; len(d) > 0; d = d[TRACE_LINK_DIFF_SIZE:] {
+		// <u4 source, <u4 target, <u4 latency_us, <u4 bandwidth_kbits, ? blocked, <u4 next_hop, <u4 prev_hop
+		source := unpack(binary.LittleEndian.Uint32(d[0:4]))
+		target := unpack(binary.LittleEndian.Uint32(d[4:8]))
+
+		c := orchestrator.LinkChange{
+			Blocked:        d[16] != 0,
+			BlockedChanged: true,
 		}
+
+		if !c.Blocked {
+			c.LatencyUs = binary.LittleEndian.Uint32(d[8:12])
+			c.LatencyChanged = true
+			c.BandwidthKbps = uint64(binary.LittleEndian.Uint32(d[12:16]))
+			c.BandwidthChanged = true
+		}
+
+		diff[source] = append(diff[source], orchestrator.LinkUpdate{Target: target, LinkChange: c})
+		diff[target] = append(diff[target], orchestrator.LinkUpdate{Target: source, LinkChange: c})
 	}
 
-	for _, bm := range benchmarks {
-		b.Run(bm.name, func(b *testing.B) {
-			for i := 0; i < b.N; i++ {
-				runNebBenchmark(b, bm.backend, bm.num)
+	return diff, nil
+}
+
+func readTraceMember(file *zip.File) ([]byte, error) {
+	rc, err := file.Open()
+	if err != nil {
+		return nil, errors.WithStack(err)
+	}
+	defer rc.Close()
+
+	b, err := io.ReadAll(rc)
+	if err != nil {
+		return nil, errors.WithStack(err)
+	}
+
+	return b, nil
+}
+
+// readTraceTimestepV1 reads a timestep of a version 1 trace, which has one
+// compressed file of link diffs per timestep.
+func readTraceTimestepV1(members map[string]*zip.File, filename string, timestep string) (map[orchestrator.MachineID][]orchestrator.LinkUpdate, error) {
+	var file *zip.File
+
+	for name, f := range members {
+		if !strings.HasPrefix(name, "l") {
+			continue
+		}
+
+		if timestep != "" {
+			if name == "l"+timestep {
+				file = f
+				break
 			}
+			continue
+		}
+
+		if file == nil || f.UncompressedSize64 > file.UncompressedSize64 {
+			file = f
+		}
+	}
+
+	if file == nil {
+		return nil, errors.Errorf("no link diffs for timestep %q in %s", timestep, filename)
+	}
+
+	b, err := readTraceMember(file)
+	if err != nil {
+		return nil, errors.WithStack(err)
+	}
 
-			//fmt.Println("number of iterations: ", b.N)
-			//fmt.Println("elapsed:", b.Elapsed()/time.Duration(b.N))
-		})
+	if len(b)%TRACE_V1_LINK_DIFF_SIZE != 0 {
+		return nil, errors.Errorf("%s has %d bytes, not a multiple of %d", file.Name, len(b), TRACE_V1_LINK_DIFF_SIZE)
 	}
+
+	log.Infof("replaying %d link diffs from %s", len(b)/TRACE_V1_LINK_DIFF_SIZE, file.Name)
+
+	diff := make(map[orchestrator.MachineID][]orchestrator.LinkUpdate)
+
+	for d := b; len(d) > 0; d = d[TRACE_V1_LINK_DIFF_SIZE:] {
+		// <BHBHII?BHBH
+		source := orchestrator.MachineID{Group: d[0], Id: uint32(binary.LittleEndian.Uint16(d[1:3]))}
+		target := orchestrator.MachineID{Group: d[3], Id: uint32(binary.LittleEndian.Uint16(d[4:6]))}
+
+		c := orchestrator.LinkChange{
+			Blocked:        d[14] != 0,
+			BlockedChanged: true,
+		}
+
+		if !c.Blocked {
+			c.LatencyUs = binary.LittleEndian.Uint32(d[6:10])
+			c.LatencyChanged = true
+			c.BandwidthKbps = uint64(binary.LittleEndian.Uint32(d[10:14]))
+			c.BandwidthChanged = true
+		}
+
+		diff[source] = append(diff[source], orchestrator.LinkUpdate{Target: target, LinkChange: c})
+		diff[target] = append(diff[target], orchestrator.LinkUpdate{Target: source, LinkChange: c})
+	}
+
+	return diff, nil
 }
@@ -19,7 +19,10 @@ package virt
 
 import (
 	"context"
+	"os"
+	"time"
 
+	"github.com/firecracker-microvm/firecracker-go-sdk"
 	"github.com/pkg/errors"
 	log "github.com/sirupsen/logrus"
 
@@ -31,6 +34,10 @@ func (v *Virt) transition(id orchestrator.MachineID, state state) error {
 	m := v.machines[id]
 	v.RUnlock()
 
+	// the machine may be released in the background at the same time
+	m.Lock()
+	defer m.Unlock()
+
 	if m.state == state {
 		return nil
 	}
@@ -44,6 +51,10 @@ func (v *Virt) transition(id orchestrator.MachineID, state state) error {
 				return err
 			}
 			m.state = STOPPED
+			m.stoppedAt = time.Now()
+			return nil
+		case RELEASED:
+			// already stopped
 			return nil
 		case REGISTERED:
 			// not started yet, so nothing to do
@@ -69,6 +80,14 @@ func (v *Virt) transition(id orchestrator.MachineID, state state) error {
 			}
 			m.state = STARTED
 			return nil
+
+		case RELEASED:
+			err := restoreMachine(m)
+			if err != nil {
+				return err
+			}
+			m.state = STARTED
+			return nil
 		default:
 			log.Tracef("cannot transition %s from %d to %d", id, m.state, state)
 		}
@@ -88,6 +107,10 @@ func (v *Virt) transition(id orchestrator.MachineID, state state) error {
 				return err
 			}
 			return nil
+		case RELEASED:
+			// there is no Firecracker process left
+			removeSnapshot(m)
+			return nil
 		default:
 			log.Tracef("cannot transition %s from %d to %d", id, m.state, state)
 		}
@@ -104,6 +127,12 @@ func (v *Virt) register(id orchestrator.MachineID, m *machine, config orchestrat
 	m.diskimage = config.DiskImage
 	m.kernel = config.Kernel
 	m.bootparams = config.BootParams
+	m.overlays = &v.overlays
+	m.boot = v.boot.newTimer()
+
+	// formatting the overlay of the first machine with this disk size can
+	// start now, so that it is ready when the machine is started
+	v.overlays.prepare(m.disksize)
 
 	// create the network
 
@@ -119,6 +148,14 @@ func (v *Virt) register(id orchestrator.MachineID, m *machine, config orchestrat
 		return err
 	}
 
+	if lf, ok := v.neb.(LocalForwardingBackend); ok {
+		err = lf.AddLocal(id, m.network.mac)
+
+		if err != nil {
+			return err
+		}
+	}
+
 	return nil
 }
 
@@ -148,6 +185,8 @@ func resumeMachine(m *machine) error {
 
 func startMachine(m *machine) error {
 	log.Trace("Starting machine ", m.name)
+	begin := time.Now()
+
 	// perform init tasks
 	err := m.initialize()
 
@@ -155,5 +194,127 @@ func startMachine(m *machine) error {
 		return err
 	}
 
-	return m.vm.Start(context.Background())
+	prepared := time.Now()
+
+	err = m.vm.Start(context.Background())
+
+	if err != nil {
+		return err
+	}
+
+	m.boot.started(begin, prepared, time.Now(), false)
+
+	return nil
+}
+
+// releaseMachine takes a snapshot of a suspended machine and stops its
+// Firecracker process, so that its memory is given back to the host.
+func releaseMachine(m *machine) error {
+	log.Trace("Releasing machine ", m.name)
+
+	mem, snap := m.snapshotPaths()
+
+	err := m.vm.CreateSnapshot(context.Background(), mem, snap)
+
+	if err != nil {
+		return errors.WithStack(err)
+	}
+
+	err = m.vm.StopVMM()
+
+	if err != nil {
+		return errors.WithStack(err)
+	}
+
+	log.Trace("Released machine ", m.name)
+
+	return nil
+}
+
+// restoreMachine starts a new Firecracker process for a released machine
+// from its snapshot and resumes it.
+func restoreMachine(m *machine) error {
+	log.Trace("Restoring machine ", m.name)
+
+	begin := time.Now()
+
+	mem, snap := m.snapshotPaths()
+
+	err := m.createVM(firecracker.WithSnapshot(mem, snap, func(c *firecracker.SnapshotConfig) {
+		c.ResumeVM = true
+	}))
+
+	if err != nil {
+		return err
+	}
+
+	prepared := time.Now()
+
+	err = m.vm.Start(context.Background())
+
+	if err != nil {
+		return errors.WithStack(err)
+	}
+
+	m.boot.started(begin, prepared, time.Now(), true)
+
+	// the memory file is only needed again after the next release
+	removeSnapshot(m)
+
+	log.Trace("Restored machine ", m.name)
+
+	return nil
+}
+
+func removeSnapshot(m *machine) {
+	mem, snap := m.snapshotPaths()
+
+	for _, p := range []string{mem, snap} {
+		err := os.Remove(p)
+		if err != nil && !os.IsNotExist(err) {
+			log.Errorf("could not remove snapshot file %s: %s", p, err.Error())
+		}
+	}
+}
+
+// releaseStopped releases machines that have been stopped for at least
+// v.releaseAfter, until v.done is closed.
+func (v *Virt) releaseStopped() {
+	ticker := time.NewTicker(v.releaseAfter / 2)
+	defer ticker.Stop()
+
+	for {
+		select {
+		case <-v.done:
+			return
+		case <-ticker.C:
+		}
+
+		v.RLock()
+		machines := make([]*machine, 0, len(v.machines))
+		for _, m := range v.machines {
+			machines = append(machines, m)
+		}
+		v.RUnlock()
+
+		released := 0
+
+		for _, m := range machines {
+			m.Lock()
+			if m.state == STOPPED && time.Since(m.stoppedAt) >= v.releaseAfter {
+				err := releaseMachine(m)
+				if err != nil {
+					log.Errorf("could not release machine %s: %s", m.name, err.Error())
+				} else {
+					m.state = RELEASED
+					released++
+				}
+			}
+			m.Unlock()
+		}
+
+		if released > 0 {
+			log.Debugf("released %d stopped machines", released)
+		}
+	}
 }
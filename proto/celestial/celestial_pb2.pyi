@@ -270,18 +270,81 @@ class StateUpdateRequest(google.protobuf.message.Message):
         def HasField(self, field_name: typing_extensions.Literal["next", b"next", "prev", b"prev", "source", b"source", "target", b"target"]) -> builtins.bool: ...
         def ClearField(self, field_name: typing_extensions.Literal["bandwidth_kbps", b"bandwidth_kbps", "blocked", b"blocked", "latency_us", b"latency_us", "next", b"next", "prev", b"prev", "source", b"source", "target", b"target"]) -> None: ...
 
+    @typing_extensions.final
+    class PackedNetworkDiffs(google.protobuf.message.Message):
+        """PackedNetworkDiffs is a columnar form of network_diffs: entry i of
+        each array belongs to the same link. Machine IDs are encoded as
+        group << 24 | id, next and prev are ignored for blocked links.
+        """
+
+        DESCRIPTOR: google.protobuf.descriptor.Descriptor
+
+        SOURCE_FIELD_NUMBER: builtins.int
+        TARGET_FIELD_NUMBER: builtins.int
+        BLOCKED_FIELD_NUMBER: builtins.int
+        LATENCY_US_FIELD_NUMBER: builtins.int
+        BANDWIDTH_KBPS_FIELD_NUMBER: builtins.int
+        NEXT_FIELD_NUMBER: builtins.int
+        PREV_FIELD_NUMBER: builtins.int
+        @property
+        def source(self) -> google.protobuf.internal.containers.RepeatedScalarFieldContainer[builtins.int]: ...
+        @property
+        def target(self) -> google.protobuf.internal.containers.RepeatedScalarFieldContainer[builtins.int]: ...
+        @property
+        def blocked(self) -> google.protobuf.internal.containers.RepeatedScalarFieldContainer[builtins.bool]: ...
+        @property
+        def latency_us(self) -> google.protobuf.internal.containers.RepeatedScalarFieldContainer[builtins.int]: ...
+        @property
+        def bandwidth_kbps(self) -> google.protobuf.internal.containers.RepeatedScalarFieldContainer[builtins.int]: ...
+        @property
+        def next(self) -> google.protobuf.internal.containers.RepeatedScalarFieldContainer[builtins.int]: ...
+        @property
+        def prev(self) -> google.protobuf.internal.containers.RepeatedScalarFieldContainer[builtins.int]: ...
+        def __init__(
+            self,
+            *,
+            source: collections.abc.Iterable[builtins.int] | None = ...,
+            target: collections.abc.Iterable[builtins.int] | None = ...,
+            blocked: collections.abc.Iterable[builtins.bool] | None = ...,
+            latency_us: collections.abc.Iterable[builtins.int] | None = ...,
+            bandwidth_kbps: collections.abc.Iterable[builtins.int] | None = ...,
+            next: collections.abc.Iterable[builtins.int] | None = ...,
+            prev: collections.abc.Iterable[builtins.int] | None = ...,
+        ) -> None: ...
+        def ClearField(self, field_name: typing_extensions.Literal["bandwidth_kbps", b"bandwidth_kbps", "blocked", b"blocked", "latency_us", b"latency_us", "next", b"next", "prev", b"prev", "source", b"source", "target", b"target"]) -> None: ...
+
     MACHINE_DIFFS_FIELD_NUMBER: builtins.int
     NETWORK_DIFFS_FIELD_NUMBER: builtins.int
+    PACKED_NETWORK_DIFFS_FIELD_NUMBER: builtins.int
+    EFFECTIVE_UNIX_US_FIELD_NUMBER: builtins.int
+    TIMESTEP_FIELD_NUMBER: builtins.int
     @property
     def machine_diffs(self) -> google.protobuf.internal.containers.RepeatedCompositeFieldContainer[global___StateUpdateRequest.MachineDiff]: ...
     @property
     def network_diffs(self) -> google.protobuf.internal.containers.RepeatedCompositeFieldContainer[global___StateUpdateRequest.NetworkDiff]: ...
+    @property
+    def packed_network_diffs(self) -> global___StateUpdateRequest.PackedNetworkDiffs:
+        """can be sent instead of network_diffs, is much cheaper to encode and
+        decode
+        """
+    effective_unix_us: builtins.int
+    """wall-clock time in microseconds since the Unix epoch at which the
+    update takes effect, the host stages it until then
+    0 applies the update as soon as it is received
+    only needs to be set in the first message of the stream
+    """
+    timestep: builtins.int
+    """the timestep of the update, only used to report drift"""
     def __init__(
         self,
         *,
         machine_diffs: collections.abc.Iterable[global___StateUpdateRequest.MachineDiff] | None = ...,
         network_diffs: collections.abc.Iterable[global___StateUpdateRequest.NetworkDiff] | None = ...,
+        packed_network_diffs: global___StateUpdateRequest.PackedNetworkDiffs | None = ...,
+        effective_unix_us: builtins.int = ...,
+        timestep: builtins.int = ...,
     ) -> None: ...
-    def ClearField(self, field_name: typing_extensions.Literal["machine_diffs", b"machine_diffs", "network_diffs", b"network_diffs"]) -> None: ...
+    def HasField(self, field_name: typing_extensions.Literal["packed_network_diffs", b"packed_network_diffs"]) -> builtins.bool: ...
+    def ClearField(self, field_name: typing_extensions.Literal["effective_unix_us", b"effective_unix_us", "machine_diffs", b"machine_diffs", "network_diffs", b"network_diffs", "packed_network_diffs", b"packed_network_diffs", "timestep", b"timestep"]) -> None: ...
 
 global___StateUpdateRequest = StateUpdateRequest
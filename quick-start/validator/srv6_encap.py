@@ -0,0 +1,241 @@
+import ctypes as ct
+import ipaddress
+from typing import Dict, Iterable, List
+
+from bcc import BPF
+from pyroute2 import IPRoute
+
+# 每条路由最多的段数，决定了 map 条目的大小和封装后的最大包头长度
+MAX_SEGMENTS = 8
+
+# 外层 IPv6 头 + 最长的 SRH
+MAX_ENCAP_OVERHEAD = 40 + 8 + 16 * MAX_SEGMENTS
+
+# --------------------------
+# eBPF 程序：tc egress 上的 SRv6 H.Encaps
+# --------------------------
+# 目的地址按最长前缀匹配查 segment_lists，命中则在以太网头后插入外层 IPv6 头和
+# SRH，效果与 "ip -6 route ... encap seg6 mode encap segs ..." 相同，
+# 但更新路由只需写一次 map，不需要启动 ip 进程。
+EBPF_PROGRAM = r"""
+#include <uapi/linux/bpf.h>
+#include <uapi/linux/pkt_cls.h>
+#include <linux/if_ether.h>
+#include <linux/ipv6.h>
+#include <linux/in6.h>
+
+#define MAX_SEGMENTS %d
+#define NEXTHDR_ROUTING 43
+
+struct dst_key {
+    u32 prefixlen;
+    u8 addr[16];
+};
+
+// 与 struct ipv6_sr_hdr 布局相同，segments 逆序存放（segments[0] 是最后一段）
+struct srh {
+    u8 nexthdr;
+    u8 hdrlen;
+    u8 type;
+    u8 segments_left;
+    u8 last_entry;
+    u8 flags;
+    u16 tag;
+    u8 segments[MAX_SEGMENTS][16];
+};
+
+struct segment_list {
+    u32 count;
+    struct srh srh;
+};
+
+BPF_LPM_TRIE(segment_lists, struct dst_key, struct segment_list, 65536);
+
+int srv6_encap(struct __sk_buff *skb) {
+    void *data = (void *)(long)skb->data;
+    void *data_end = (void *)(long)skb->data_end;
+
+    struct ethhdr *eth = data;
+    struct ipv6hdr *ip6 = data + sizeof(*eth);
+
+    if ((void *)(ip6 + 1) > data_end)
+        return TC_ACT_OK;
+
+    if (eth->h_proto != bpf_htons(ETH_P_IPV6))
+        return TC_ACT_OK;
+
+    // 已经带路由头的包（例如内核 seg6 路由封装过的）不再封装
+    if (ip6->nexthdr == NEXTHDR_ROUTING)
+        return TC_ACT_OK;
+
+    struct dst_key key = {.prefixlen = 128};
+    __builtin_memcpy(key.addr, &ip6->daddr, 16);
+
+    struct segment_list *l = segment_lists.lookup(&key);
+    if (!l)
+        return TC_ACT_OK;
+
+    u32 n = l->count;
+    if (n == 0 || n > MAX_SEGMENTS)
+        return TC_ACT_OK;
+
+    u32 srh_len = 8 + 16 * n;
+
+    // 外层头沿用内层头的 traffic class、flow label 和 hop limit，
+    // 目的地址是第一段
+    struct ipv6hdr outer = {};
+    __builtin_memcpy(&outer, ip6, 4);
+    outer.payload_len = bpf_htons(bpf_ntohs(ip6->payload_len) + sizeof(outer) + srh_len);
+    outer.nexthdr = NEXTHDR_ROUTING;
+    outer.hop_limit = ip6->hop_limit;
+    outer.saddr = ip6->saddr;
+    __builtin_memcpy(&outer.daddr, l->srh.segments[n - 1], 16);
+
+    // 之后包指针失效，只能用 bpf_skb_store_bytes 写入
+    if (bpf_skb_adjust_room(skb, sizeof(outer) + srh_len, BPF_ADJ_ROOM_MAC, BPF_F_ADJ_ROOM_ENCAP_L3_IPV6))
+        return TC_ACT_SHOT;
+
+    u32 off = sizeof(struct ethhdr);
+
+    if (bpf_skb_store_bytes(skb, off, &outer, sizeof(outer), 0))
+        return TC_ACT_SHOT;
+
+    off += sizeof(outer);
+
+    if (bpf_skb_store_bytes(skb, off, &l->srh, 8, 0))
+        return TC_ACT_SHOT;
+
+    off += 8;
+
+    #pragma unroll
+    for (int i = 0; i < MAX_SEGMENTS; i++) {
+        if (i >= n)
+            break;
+
+        if (bpf_skb_store_bytes(skb, off + 16 * i, l->srh.segments[i], 16, 0))
+            return TC_ACT_SHOT;
+    }
+
+    return TC_ACT_OK;
+}
+""" % MAX_SEGMENTS
+
+# clsact 的 egress 挂载点
+TC_EGRESS_PARENT = "ffff:fff3"
+
+NEXTHDR_IPV6 = 41
+SRH_TYPE = 4
+
+
+class SRv6Encap:
+    """
+    在网卡的 tc egress 上做 SRv6 封装，段列表存放在以目的前缀为键的 BPF map
+    中。路由由本对象独占管理，进程退出时封装随之移除。
+    """
+
+    def __init__(self, interface: str):
+        self.bpf = BPF(text=EBPF_PROGRAM)
+        fn = self.bpf.load_func("srv6_encap", BPF.SCHED_CLS)
+        self.table = self.bpf["segment_lists"]
+
+        # 当前写入 map 的路由：目的前缀 -> 段列表
+        self.routes: Dict[str, List[str]] = {}
+
+        self.ipr = IPRoute()
+        self.ifindex = self.ipr.link_lookup(ifname=interface)[0]
+
+        self.ipr.tc("add", "clsact", self.ifindex)
+        self.ipr.tc(
+            "add-filter",
+            "bpf",
+            self.ifindex,
+            ":1",
+            fd=fn.fd,
+            name=fn.name,
+            parent=TC_EGRESS_PARENT,
+            classid=1,
+            direct_action=True,
+        )
+
+    def _key(self, dest: str):
+        net = ipaddress.IPv6Network(dest, strict=False)
+
+        key = self.table.Key()
+        key.prefixlen = net.prefixlen
+        ct.memmove(key.addr, net.network_address.packed, 16)
+
+        return key
+
+    def _leaf(self, segments: List[str]):
+        n = len(segments)
+
+        leaf = self.table.Leaf()
+        leaf.count = n
+        leaf.srh.nexthdr = NEXTHDR_IPV6
+        leaf.srh.hdrlen = 2 * n
+        leaf.srh.type = SRH_TYPE
+        leaf.srh.segments_left = n - 1
+        leaf.srh.last_entry = n - 1
+
+        # SRH 中段列表逆序存放
+        for i, seg in enumerate(reversed(segments)):
+            ct.memmove(leaf.srh.segments[i], ipaddress.IPv6Address(seg).packed, 16)
+
+        return leaf
+
+    def update(self, routes: Dict[str, List[str]]) -> None:
+        """
+        批量更新路由：目的前缀 -> 段列表，空列表表示删除该路由。只有变化的
+        路由才会写入 map，并尽量用一次批量 map 操作写入；内核不支持该 map
+        的批量操作时（例如较旧内核上的 LPM trie），退回逐条写入。
+        """
+        for dest, segments in routes.items():
+            if len(segments) > MAX_SEGMENTS:
+                raise ValueError(
+                    f"路由 {dest} 有 {len(segments)} 段，最多支持 {MAX_SEGMENTS} 段"
+                )
+
+        changed: Dict[str, List[str]] = {}
+
+        for dest, segments in routes.items():
+            if self.routes.get(dest) == segments:
+                continue
+
+            if not segments:
+                self.remove([dest])
+                continue
+
+            changed[dest] = segments
+
+        if not changed:
+            return
+
+        keys = [self._key(dest) for dest in changed]
+        leaves = [self._leaf(segments) for segments in changed.values()]
+
+        try:
+            n = len(keys)
+            self.table.items_update_batch(
+                (self.table.Key * n)(*keys), (self.table.Leaf * n)(*leaves)
+            )
+        except Exception:
+            for key, leaf in zip(keys, leaves):
+                self.table[key] = leaf
+
+        for dest, segments in changed.items():
+            self.routes[dest] = list(segments)
+
+    def remove(self, dests: Iterable[str]) -> None:
+        """删除路由，不存在的路由被忽略。"""
+        for dest in dests:
+            if dest not in self.routes:
+                continue
+
+            del self.table[self._key(dest)]
+            del self.routes[dest]
+
+    def close(self) -> None:
+        """移除 tc 程序和所有路由。"""
+        self.ipr.tc("del", "clsact", self.ifindex)
+        self.ipr.close()
+        self.routes.clear()
@@ -10,6 +10,8 @@ from typing import Dict, Optional, List, Tuple
 from dataclasses import dataclass
 from bcc import BPF
 
+from srv6_encap import MAX_ENCAP_OVERHEAD, SRv6Encap
+
 # --------------------------
 # 配置参数
 # --------------------------
@@ -18,8 +20,9 @@ CONFIG = {
     "interface": "eth0",      # 监听的网络接口
     "route_ttl": 15,          # 路由有效期（秒）
     "update_interval": 5,     # 路由更新间隔（秒）
-    "seg6_mtu": 1500,        # 设置SRv6路由的mtu值
-    "visual_api": "http://192.168.3.46:8080/api/route"  # 可视化系统API地址
+    "seg6_mtu": 1500,        # 封装后的包的最大长度
+    "visual_api": "http://192.168.3.46:8080/api/route",  # 可视化系统API地址
+    "visual_batch_api": "http://192.168.3.46:8080/api/routes"  # 批量发送路由
 }
 
 # --------------------------
@@ -42,10 +45,10 @@ class SRv6DynamicRouter:
         self.n_ipv6=self.self_ipv6-1
         self.active_routes: Dict[str, dict] = {}
 
-        # 新增线程管理变量
-        self.update_threads = {}  # 格式: { dest_ip: threading.Thread }
-        self.thread_lock = threading.Lock()  # 线程操作专用锁
-        
+        # 段列表在 eth0 的 tc egress 上封装，不再为每条路由启动 ip 进程
+        self.encap = SRv6Encap(CONFIG["interface"])
+        self._set_route_mtu()
+
         # 初始化eBPF监控
         self.bpf = BPF(text=self._load_ebpf_program())
         fn = self.bpf.load_func("trace_ipv6_out", BPF.SOCKET_FILTER)
@@ -55,6 +58,7 @@ class SRv6DynamicRouter:
         # 启动后台线程
         threading.Thread(target=self._event_loop, daemon=True).start()
         threading.Thread(target=self._cleanup_loop, daemon=True).start()
+        threading.Thread(target=self._update_loop, daemon=True).start()
         
         # 检查可视化系统连接
         self._check_visual_system()
@@ -79,6 +83,19 @@ class SRv6DynamicRouter:
         else:
             print("ℹ️ 未配置可视化系统，路由更新将不会发送到可视化系统")
 
+    def _set_route_mtu(self):
+        """
+        tc 封装在路由之后，内核不会为封装头预留空间，所以给默认路由设置一个
+        留出最长封装头的 MTU（只在启动时执行一次）
+        """
+        mtu = CONFIG["seg6_mtu"] - MAX_ENCAP_OVERHEAD
+        cmd = [
+            "ip", "-6", "route", "replace", "default",
+            "via", str(self.n_ipv6), "dev", CONFIG["interface"], "mtu", str(mtu)
+        ]
+        subprocess.run(cmd, check=True, capture_output=True, text=True)
+        print(f"✅ 默认路由MTU设置为: {mtu}")
+
     def _load_ebpf_program(self) -> str:
         """去除非必要调试函数后的安全版本"""
         return r"""
@@ -279,87 +296,59 @@ class SRv6DynamicRouter:
                 print(f"❌ 路由管理失败: {str(e)}")
 
     def _install_route(self, dest_ip: str, segments: List[str]):
-        """路由安装（严格单线程控制）"""
+        """路由安装（调用方持有 self.lock）"""
         if not segments:
             print(f"⏭️ 空节点列表，跳过路由安装: {dest_ip}")
             return
-            
+
         try:
-            # 构造动态参数命令
-            cmd = [
-                "ip", "-6", "route", "replace", dest_ip,
-                "encap", "seg6", "mode", "encap",
-                "segs", ",".join(segments),
-                "dev", CONFIG["interface"], "mtu", str(CONFIG["seg6_mtu"])
-            ]
-        
-            print(f"🛠️ 执行路由更新: {' '.join(cmd)}")
-            result = subprocess.run(cmd, capture_output=True, text=True)
-        
-            if result.returncode != 0:
-                raise subprocess.CalledProcessError(
-                    result.returncode, cmd,
-                    output=result.stdout, stderr=result.stderr
-                )
-            
-            print(f"✅ 路由更新成功: {dest_ip}")
-            
-            # 关键修改：在写入路由前判断是否为新路由
-            is_new_route = dest_ip not in self.active_routes
-            
-            # 更新路由信息
+            self.encap.update({dest_ip: segments})
+            print(f"✅ 路由更新成功: {dest_ip} segs {','.join(segments)}")
+
+            now = time.time()
+            last_used = self.active_routes.get(dest_ip, {}).get("last_used", now)
+
+            # 更新路由信息，之后由 _update_loop 统一更新
             self.active_routes[dest_ip] = {
                 "segments": segments,
                 "next_hop": segments[0],
-                "last_used": time.time(),
-                "update_time": time.time()
+                "last_used": last_used,
+                "update_time": now
             }
-
-            if is_new_route:
-                self._schedule_updater(dest_ip)
-                
-        except subprocess.CalledProcessError as e:
-            print(f"❌ 命令执行失败: {e.stderr.strip()}")
         except Exception as e:
             print(f"❌ 路由安装异常: {str(e)}")
 
-    def _schedule_updater(self, dest_ip: str):
-        """路由更新调度（严格线程去重）"""
-        with self.thread_lock:
-            # 检查是否已有存活线程
-            existing_thread = self.update_threads.get(dest_ip)
-            if existing_thread and existing_thread.is_alive():
-                print(f"⏩ 已有更新线程运行: {dest_ip}")
-                return
+    def _visual_data(self, final_ip: str, segments: List[str], path_data: dict) -> dict:
+        """构建完整的数据，包含源节点、目标节点、中间节点和原始路径数据"""
+        return {
+            "source": str(self.self_ipv6),
+            "destination": final_ip,
+            "segments": segments,  # 包含中间节点列表
+            "path_data": path_data,  # 包含原始路径数据
+            "timestamp": time.time(),
+            "node_info": {
+                "shell": self.node_info.shell,
+                "id": self.node_info.id
+            }
+        }
 
-        print(f"🕒 启动路由更新守护线程: {dest_ip}")
-        
-        def update_job():
-            while True:
-                # 检查路由是否仍然存在
-                with self.lock:
-                    if dest_ip not in self.active_routes:
-                        break
-                
-                # 执行更新
-                try:
-                    time.sleep(CONFIG["update_interval"])
-                    self._update_route(dest_ip)
-                except Exception as e:
-                    print(f"⚠️ 更新线程异常: {str(e)}")
-
-            # 线程退出时清理
-            with self.thread_lock:
-                if dest_ip in self.update_threads:
-                    del self.update_threads[dest_ip]
-            print(f"⏹️ 更新线程退出: {dest_ip}")
-
-        # 创建并记录线程
-        thread = threading.Thread(target=update_job, daemon=True)
-        thread.start()
-        
-        with self.thread_lock:
-            self.update_threads[dest_ip] = thread
+    def _send_routes_to_visual(self, routes: List[Tuple[str, List[str], dict]]):
+        """一次请求向可视化系统发送多条路由（final_ip, segments, path_data）"""
+        if not routes or not CONFIG.get("visual_batch_api"):
+            return
+
+        try:
+            resp = httpx.post(
+                CONFIG["visual_batch_api"],
+                json={"routes": [self._visual_data(*r) for r in routes]},
+                timeout=3  # 短超时，避免影响主要功能
+            )
+            if resp.status_code == 200:
+                print(f"✅ {len(routes)} 条路由信息已发送到可视化系统")
+            else:
+                print(f"⚠️ 可视化系统响应异常: {resp.status_code}")
+        except Exception as e:
+            print(f"⚠️ 发送路由信息到可视化系统失败: {str(e)}")
 
     def _send_route_to_visual(self, dest_ip: str, final_ip: str, segments: List[str], path_data: dict):
         """向可视化系统发送路由信息（完整版）
@@ -370,18 +359,7 @@ class SRv6DynamicRouter:
             return
             
         try:
-            # 构建完整的数据，包含源节点、目标节点、中间节点和原始路径数据
-            visual_data = {
-                "source": str(self.self_ipv6),
-                "destination": final_ip,
-                "segments": segments,  # 包含中间节点列表
-                "path_data": path_data,  # 包含原始路径数据
-                "timestamp": time.time(),
-                "node_info": {
-                    "shell": self.node_info.shell,
-                    "id": self.node_info.id
-                }
-            }
+            visual_data = self._visual_data(final_ip, segments, path_data)
             
             # 发送数据到可视化系统
             try:
@@ -405,35 +383,81 @@ class SRv6DynamicRouter:
             print(f"⚠️ 准备路由可视化数据失败: {str(e)}")
             # 错误不影响主要功能
             
-    def _update_route(self, dest_ip: str):
-        """路由更新实现"""
-        for _ in range(3):
+    def _update_loop(self):
+        """路由更新循环：所有路由的路径一次请求取回，变化的段列表一次写入"""
+        while True:
+            time.sleep(CONFIG["update_interval"])
             try:
-                with self.lock:
-                    if dest_ip not in self.active_routes:
-                        return
-                    
-                    print(f"🔄 更新路由: {dest_ip}")
-                    path_url = self._build_path_url(dest_ip)
-                    resp = self.http.get(path_url, timeout=5)
-                    resp.raise_for_status()
-                    
-                    # 获取原始路径数据
-                    path_data = resp.json()
-                    final_ip, new_segments = self._process_path(path_data)
-                    
-                    if new_segments != self.active_routes[dest_ip]["segments"]:
-                        self._install_route(final_ip, new_segments)
-                        # 路由变化时发送到可视化系统
-                        self._send_route_to_visual(dest_ip, final_ip, new_segments, path_data)
-                    else:
-                        print("ℹ️ 路由无变化")
-                    
-                    self.active_routes[dest_ip]["update_time"] = time.time()
-                break
+                self._update_routes()
             except Exception as e:
                 print(f"⚠️ 路由更新失败: {str(e)}")
-                time.sleep(1)
+
+    def _update_routes(self):
+        """批量更新所有路由"""
+        with self.lock:
+            dests = list(self.active_routes.keys())
+            if not dests:
+                return
+
+            # 无法解析为节点的地址不查询路径
+            known = []
+            targets = []
+            for dest_ip in dests:
+                target = self._ip_to_node_id(dest_ip)
+                if target.shell < 0:
+                    continue
+                known.append(dest_ip)
+                targets.append({"shell": target.shell, "id": target.id})
+
+            if not targets:
+                return
+
+            resp = self.http.post(
+                f"/paths/{self.node_info.shell}/{self.node_info.id}",
+                json={"targets": targets},
+                timeout=5
+            )
+            resp.raise_for_status()
+            paths = resp.json()["paths"]
+
+            changed: Dict[str, List[str]] = {}
+            visual = []
+
+            for dest_ip, path_data in zip(known, paths):
+                if path_data.get("error"):
+                    print(f"⚠️ 无法获取到 {dest_ip} 的路径: {path_data['error']}")
+                    continue
+
+                final_ip, new_segments = self._process_path(path_data)
+                if not final_ip:
+                    continue
+
+                if new_segments != self.active_routes[dest_ip]["segments"]:
+                    changed[dest_ip] = new_segments
+                    visual.append((final_ip, new_segments, path_data))
+
+            # 无中间节点的路由被删除
+            self.encap.update(changed)
+
+            now = time.time()
+            for dest_ip in dests:
+                if dest_ip in changed and not changed[dest_ip]:
+                    del self.active_routes[dest_ip]
+                    continue
+
+                info = self.active_routes[dest_ip]
+                if dest_ip in changed:
+                    info["segments"] = changed[dest_ip]
+                    info["next_hop"] = changed[dest_ip][0]
+                info["update_time"] = now
+
+        if changed:
+            print(f"🔄 批量更新路由: {len(changed)}/{len(dests)} 条有变化")
+        else:
+            print("ℹ️ 路由无变化")
+
+        # 路由变化时一次发送到可视化系统
+        self._send_routes_to_visual(visual)
 
     def _cleanup_loop(self):
         """路由清理循环（增加线程清理）"""
@@ -452,27 +476,15 @@ class SRv6DynamicRouter:
                         self._remove_route(ip)
                         del self.active_routes[ip]
 
-                # 清理无效线程记录
-                with self.thread_lock:
-                    active_routes = set(self.active_routes.keys())
-                    dead_ips = [ip for ip in self.update_threads if ip not in active_routes]
-                    for ip in dead_ips:
-                        del self.update_threads[ip]
-                        
             except Exception as e:
                 print(f"⚠️ 清理异常: {str(e)}")
 
     def _remove_route(self, dest_ip: str):
         """路由删除实现"""
         try:
-            subprocess.run(
-                ["ip", "-6", "route", "del", dest_ip],
-                check=True,
-                stdout=subprocess.DEVNULL,
-                stderr=subprocess.DEVNULL
-            )
+            self.encap.remove([dest_ip])
             print(f"🗑️ 路由删除成功: {dest_ip}")
-        except subprocess.CalledProcessError as e:
+        except Exception as e:
             print(f"❌ 路由删除失败: {str(e)}")
 
     def _event_loop(self):
@@ -541,6 +553,7 @@ if __name__ == "__main__":
     if len(sys.argv) > 1 and sys.argv[1] == "--no-visual":
         print("ℹ️ 已禁用可视化系统集成")
         CONFIG["visual_api"] = ""
+        CONFIG["visual_batch_api"] = ""
         
     try:
         router = SRv6DynamicRouter()
@@ -553,6 +566,7 @@ if __name__ == "__main__":
             with router.lock:
                 for ip in list(router.active_routes.keys()):
                     router._remove_route(ip)
+                router.encap.close()
         sys.exit(0)
     except Exception as e:
         print(f"💥 致命错误: {str(e)}")
@@ -36,7 +36,7 @@ cp id_ed25519.pub /root/.ssh/authorized_keys
 
 python3 -m pip install httpx -i https://pypi.tuna.tsinghua.edu.cn/simple/
 
-apk add bcc-tools py3-bcc ffmpeg mpv
+apk add bcc-tools py3-bcc py3-pyroute2 ffmpeg mpv
 
 wget https://githubfast.com/bluenviron/mediamtx/releases/download/v1.11.3/mediamtx_v1.11.3_linux_amd64.tar.gz #下载RTSP服务器
 
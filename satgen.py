@@ -40,10 +40,15 @@ them using pip in a virtual environment:
 Usage
 -----
 
-    python3 satgen.py [config.toml] [output-file (optional)]
+    python3 satgen.py [config.toml] [output-file (optional)] [-j workers]
 
 The output will be in the specified path or in a generated file based on a hash
 of the configuration file if no output path is specified.
+
+With -j, shells and ranges of timesteps are generated in parallel by that
+many worker processes, see celestial/satgen_parallel.py. At the start of
+each range, link delays may be off by up to twice the delay update threshold
+instead of once.
 """
 
 import sys
@@ -54,20 +59,34 @@ import tqdm
 import celestial.config
 import celestial.zip_serializer
 import celestial.satgen_connstellation
+import celestial.satgen_parallel
+
+USAGE = "Usage: python3 satgen.py [config.toml] [output-file (optional)] [-j workers]"
 
 if __name__ == "__main__":
-    if len(sys.argv) > 3 or len(sys.argv) < 2:
-        exit("Usage: python3 celestial.py [config.toml] [output-file (optional)]")
+    args = sys.argv[1:]
+
+    workers = 1
+    if "-j" in args:
+        i = args.index("-j")
+        try:
+            workers = int(args[i + 1])
+        except (IndexError, ValueError):
+            exit(USAGE)
+        del args[i : i + 2]
+
+    if len(args) > 2 or len(args) < 1 or workers < 1:
+        exit(USAGE)
 
     # read toml
     try:
-        text_config = toml.load(sys.argv[1])
+        text_config = toml.load(args[0])
     except Exception as e:
         exit(str(e))
 
     output_file = None
-    if len(sys.argv) == 3:
-        output_file = sys.argv[2]
+    if len(args) == 2:
+        output_file = args[1]
 
     # read the configuration
     config: celestial.config.Config = celestial.config.Config(text_config)
@@ -76,6 +95,14 @@ if __name__ == "__main__":
     # serializer = celestial.json_serializer.JSONSerializer(config)
     serializer = celestial.zip_serializer.ZipSerializer(config, output_file)
 
+    if workers > 1:
+        celestial.satgen_parallel.generate(config, serializer, workers)
+
+        serializer.persist()
+
+        print(f"Output written to {serializer.filename}")
+        exit(0)
+
     # init the constellation
     constellation = celestial.satgen_connstellation.SatgenConstellation(
         config, serializer